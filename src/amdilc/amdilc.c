@@ -6,8 +6,27 @@
 #define SHA1_SIZE   (20)
 #define NAME_LEN    (64)
 
+typedef struct {
+    IlcShader* shaders;
+    unsigned count;
+    const void* const* codes;
+    const unsigned* sizes;
+    const IlcOptions* options;
+    volatile LONG nextIndex;
+} IlcBatch;
+
+static INIT_ONCE mCryptProviderInitOnce = INIT_ONCE_STATIC_INIT;
 static HCRYPTPROV mCryptProvider = 0;
 
+static BOOL CALLBACK acquireCryptProvider(
+    PINIT_ONCE initOnce,
+    PVOID param,
+    PVOID* context)
+{
+    // This function is very slow (~250ms), acquire once
+    return CryptAcquireContext(&mCryptProvider, NULL, NULL, PROV_RSA_AES, CRYPT_VERIFYCONTEXT);
+}
+
 static void calcSha1(
     uint8_t* digest,
     const uint8_t* data,
@@ -17,10 +36,7 @@ static void calcSha1(
     DWORD digestSize = 0;
     DWORD dwordSize = sizeof(DWORD);
 
-    if (mCryptProvider == 0) {
-        // This function is very slow (~250ms), acquire once
-        CryptAcquireContext(&mCryptProvider, NULL, NULL, PROV_RSA_AES, CRYPT_VERIFYCONTEXT);
-    }
+    InitOnceExecuteOnce(&mCryptProviderInitOnce, acquireCryptProvider, NULL, NULL);
 
     CryptCreateHash(mCryptProvider, CALG_SHA1, 0, 0, &hash);
     CryptHashData(hash, data, size, 0);
@@ -99,6 +115,16 @@ IlcShader ilcCompileShader(
 {
     char name[NAME_LEN];
     getShaderName(name, NAME_LEN, code, size);
+
+    bool dump = isShaderDumpEnabled();
+    IlcShader shader;
+
+    // Dumping needs the decoded kernel, bypass the cache
+    if (!dump && ilcLoadCachedShader(&shader, name, size, options)) {
+        LOGV("loaded %s from cache\n", name);
+        return shader;
+    }
+
     LOGV("compiling %s...\n", name);
 
     Kernel* kernel = calloc(1, sizeof(Kernel));
@@ -108,24 +134,93 @@ IlcShader ilcCompileShader(
 
     ilcDecodeStream(kernel, (Token*)code, size / sizeof(Token));
 
-    bool dump = isShaderDumpEnabled();
-
     if (dump) {
         dumpBuffer(code, size, name, "il");
         dumpKernel(kernel, name);
     }
 
-    IlcShader shader = ilcCompileKernel(kernel, name);
+    shader = ilcCompileKernel(kernel, name);
 
     if (dump) {
         dumpBuffer((uint8_t*)shader.code, shader.codeSize, name, "spv");
     }
 
+    ilcStoreCachedShader(&shader, name, size, options);
+
     freeKernel(kernel);
     free(kernel);
     return shader;
 }
 
+static DWORD WINAPI compileBatchWorker(
+    LPVOID param)
+{
+    IlcBatch* batch = param;
+
+    // Every compilation owns its kernel and SPIR-V module, only the work index is shared
+    for (;;) {
+        unsigned index = InterlockedIncrement(&batch->nextIndex) - 1;
+        if (index >= batch->count) {
+            break;
+        }
+
+        LOGV("compiling shader %u/%u...\n", index + 1, batch->count);
+        batch->shaders[index] = ilcCompileShader(batch->codes[index], batch->sizes[index],
+                                                 batch->options);
+    }
+
+    return 0;
+}
+
+void ilcCompileShaderBatch(
+    IlcShader* shaders,
+    unsigned count,
+    const void* const* codes,
+    const unsigned* sizes,
+    const IlcOptions* options,
+    unsigned threadCount)
+{
+    IlcBatch batch = {
+        .shaders = shaders,
+        .count = count,
+        .codes = codes,
+        .sizes = sizes,
+        .options = options,
+        .nextIndex = 0,
+    };
+
+    if (threadCount == 0) {
+        SYSTEM_INFO systemInfo;
+        GetSystemInfo(&systemInfo);
+        threadCount = systemInfo.dwNumberOfProcessors;
+    }
+    if (threadCount > count) {
+        threadCount = count;
+    }
+
+    // The calling thread takes part in the work
+    unsigned workerCount = threadCount > 1 ? threadCount - 1 : 0;
+    HANDLE* workers = malloc(workerCount * sizeof(HANDLE));
+
+    for (unsigned i = 0; i < workerCount; i++) {
+        workers[i] = CreateThread(NULL, 0, compileBatchWorker, &batch, 0, NULL);
+        if (workers[i] == NULL) {
+            LOGW("failed to create worker thread (%lu)\n", GetLastError());
+        }
+    }
+
+    compileBatchWorker(&batch);
+
+    for (unsigned i = 0; i < workerCount; i++) {
+        if (workers[i] != NULL) {
+            WaitForSingleObject(workers[i], INFINITE);
+            CloseHandle(workers[i]);
+        }
+    }
+
+    free(workers);
+}
+
 void ilcDisassembleShader(
     FILE* file,
     const void* code,
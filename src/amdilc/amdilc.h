@@ -75,6 +75,15 @@ IlcShader ilcCompileShader(
     unsigned size,
     const IlcOptions* options);
 
+// Compiles count IL blobs on threadCount threads (0 picks the CPU count). Thread-safe.
+void ilcCompileShaderBatch(
+    IlcShader* shaders,
+    unsigned count,
+    const void* const* codes,
+    const unsigned* sizes,
+    const IlcOptions* options,
+    unsigned threadCount);
+
 IlcRecompiledShader ilcRecompileHullShader(
     const void* code,
     unsigned size,
@@ -0,0 +1,214 @@
+#include <stdio.h>
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include "amdilc_internal.h"
+
+#define CACHE_MAGIC     (0x43434C49) // "ILCC"
+#define PATH_LEN        (MAX_PATH)
+
+// Shader cache entries are stored one per file, named after the IL hash. The stamp below
+// must be bumped whenever a compiler change alters the generated SPIR-V or metadata, or
+// whenever the entry layout changes.
+#define CACHE_VERSION   (2)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t ilSize;
+    uint32_t optionFlags;
+    uint32_t codeSize;
+    uint32_t bindingCount;
+    uint32_t inputCount;
+    uint32_t outputCount;
+} IlcCacheHeader;
+
+static uint32_t getOptionFlags(
+    const IlcOptions* options)
+{
+    return options != NULL && options->fragmentMaskSupported ? 1 : 0;
+}
+
+static const char* getCachePath()
+{
+    const char* envValue = getenv("GRVK_SHADER_CACHE_PATH");
+
+    if (envValue == NULL || strlen(envValue) == 0) {
+        return NULL;
+    }
+
+    return envValue;
+}
+
+static bool getCacheFileName(
+    char* fileName,
+    unsigned fileNameLen,
+    const char* name)
+{
+    const char* cachePath = getCachePath();
+
+    if (cachePath == NULL) {
+        return false;
+    }
+
+    snprintf(fileName, fileNameLen, "%s\\%s.ilc", cachePath, name);
+    return true;
+}
+
+static bool readArray(
+    FILE* file,
+    void** data,
+    unsigned count,
+    size_t elemSize)
+{
+    *data = NULL;
+
+    if (count == 0) {
+        return true;
+    }
+
+    *data = malloc(count * elemSize);
+    if (*data == NULL) {
+        return false;
+    }
+
+    return fread(*data, elemSize, count, file) == count;
+}
+
+static long getRemainingFileSize(
+    FILE* file)
+{
+    long offset = ftell(file);
+    if (offset < 0 || fseek(file, 0, SEEK_END) != 0) {
+        return -1;
+    }
+
+    long end = ftell(file);
+    if (end < 0 || fseek(file, offset, SEEK_SET) != 0) {
+        return -1;
+    }
+
+    return end - offset;
+}
+
+bool ilcLoadCachedShader(
+    IlcShader* shader,
+    const char* name,
+    unsigned ilSize,
+    const IlcOptions* options)
+{
+    char fileName[PATH_LEN];
+    IlcCacheHeader header;
+
+    if (!getCacheFileName(fileName, PATH_LEN, name)) {
+        return false;
+    }
+
+    FILE* file = fopen(fileName, "rb");
+    if (file == NULL) {
+        return false;
+    }
+
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        header.magic != CACHE_MAGIC ||
+        header.version != CACHE_VERSION ||
+        header.ilSize != ilSize ||
+        header.optionFlags != getOptionFlags(options) ||
+        header.codeSize % sizeof(uint32_t) != 0) {
+        LOGV("ignoring stale cache entry %s\n", fileName);
+        fclose(file);
+        return false;
+    }
+
+    // Reject entries whose counts don't add up to the file size before allocating anything
+    uint64_t dataSize = (uint64_t)header.codeSize +
+                        (uint64_t)header.bindingCount * sizeof(IlcBinding) +
+                        (uint64_t)header.inputCount * sizeof(IlcInput) +
+                        (uint64_t)header.outputCount * sizeof(uint32_t);
+    long remainingSize = getRemainingFileSize(file);
+    if (remainingSize < 0 || (uint64_t)remainingSize != dataSize) {
+        LOGW("corrupted cache entry %s\n", fileName);
+        fclose(file);
+        return false;
+    }
+
+    *shader = (IlcShader) {
+        .codeSize = header.codeSize,
+        .code = NULL,
+        .bindingCount = header.bindingCount,
+        .bindings = NULL,
+        .inputCount = header.inputCount,
+        .inputs = NULL,
+        .outputCount = header.outputCount,
+        .outputLocations = NULL,
+        .name = NULL,
+    };
+
+    bool valid =
+        readArray(file, (void**)&shader->code, header.codeSize / sizeof(uint32_t), sizeof(uint32_t)) &&
+        readArray(file, (void**)&shader->bindings, header.bindingCount, sizeof(IlcBinding)) &&
+        readArray(file, (void**)&shader->inputs, header.inputCount, sizeof(IlcInput)) &&
+        readArray(file, (void**)&shader->outputLocations, header.outputCount, sizeof(uint32_t));
+    fclose(file);
+
+    if (!valid) {
+        LOGW("failed to read cache entry %s\n", fileName);
+        free(shader->code);
+        free(shader->bindings);
+        free(shader->inputs);
+        free(shader->outputLocations);
+        return false;
+    }
+
+    shader->name = strdup(name);
+    return true;
+}
+
+void ilcStoreCachedShader(
+    const IlcShader* shader,
+    const char* name,
+    unsigned ilSize,
+    const IlcOptions* options)
+{
+    char fileName[PATH_LEN];
+    char tmpFileName[PATH_LEN];
+
+    if (!getCacheFileName(fileName, PATH_LEN, name)) {
+        return;
+    }
+
+    // Write to a temporary file first so that concurrent readers never see a partial entry
+    snprintf(tmpFileName, PATH_LEN, "%s.%lu.%lu.tmp", fileName,
+             GetCurrentProcessId(), GetCurrentThreadId());
+
+    CreateDirectoryA(getCachePath(), NULL);
+
+    FILE* file = fopen(tmpFileName, "wb");
+    if (file == NULL) {
+        LOGW("failed to create cache entry %s\n", tmpFileName);
+        return;
+    }
+
+    const IlcCacheHeader header = {
+        .magic = CACHE_MAGIC,
+        .version = CACHE_VERSION,
+        .ilSize = ilSize,
+        .optionFlags = getOptionFlags(options),
+        .codeSize = shader->codeSize,
+        .bindingCount = shader->bindingCount,
+        .inputCount = shader->inputCount,
+        .outputCount = shader->outputCount,
+    };
+
+    bool valid =
+        fwrite(&header, sizeof(header), 1, file) == 1 &&
+        fwrite(shader->code, 1, shader->codeSize, file) == shader->codeSize &&
+        fwrite(shader->bindings, sizeof(IlcBinding), shader->bindingCount, file) == shader->bindingCount &&
+        fwrite(shader->inputs, sizeof(IlcInput), shader->inputCount, file) == shader->inputCount &&
+        fwrite(shader->outputLocations, sizeof(uint32_t), shader->outputCount, file) == shader->outputCount;
+    valid = fclose(file) == 0 && valid;
+
+    if (!valid || !MoveFileExA(tmpFileName, fileName, MOVEFILE_REPLACE_EXISTING)) {
+        LOGW("failed to store cache entry %s\n", fileName);
+        DeleteFileA(tmpFileName);
+    }
+}
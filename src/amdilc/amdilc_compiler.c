@@ -115,6 +115,18 @@ typedef struct {
     IlcSpvId functionId;
 } IlcHullPhase;
 
+typedef struct {
+    uint64_t key;
+    unsigned itemIndex; // Item index + 1, 0 if the slot is empty
+} IlcKeySlot;
+
+// Maps register, resource and sampler keys to their array index
+typedef struct {
+    unsigned entryCount;
+    unsigned slotCount;
+    IlcKeySlot* slots;
+} IlcKeyIndex;
+
 typedef struct {
     const Kernel* kernel;
     IlcSpvModule* module;
@@ -139,10 +151,13 @@ typedef struct {
     unsigned regCount;
     unsigned regSize;
     IlcRegister* regs;
+    IlcKeyIndex regIndex;
     unsigned resourceCount;
     IlcResource* resources;
+    IlcKeyIndex resourceIndex;
     unsigned samplerCount;
     IlcSampler* samplers;
+    IlcKeyIndex samplerIndex;
     unsigned controlFlowBlockCount;
     IlcControlFlowBlock* controlFlowBlocks;
     unsigned hsForkPhaseIdCount;
@@ -405,6 +420,73 @@ static void emitBinding(
     };
 }
 
+static uint64_t getKey(
+    uint32_t type,
+    uint32_t num)
+{
+    return ((uint64_t)type << 32) | num;
+}
+
+static unsigned getKeySlotIndex(
+    const IlcKeyIndex* index,
+    uint64_t key)
+{
+    // Fibonacci hashing, take the top bits
+    uint64_t hash = key * 0x9E3779B97F4A7C15ull;
+    unsigned mask = index->slotCount - 1;
+    unsigned i = (hash >> 32) & mask;
+
+    // Linear probing, stop at the first match or empty slot
+    while (index->slots[i].itemIndex != 0 && index->slots[i].key != key) {
+        i = (i + 1) & mask;
+    }
+
+    return i;
+}
+
+static unsigned findKey(
+    const IlcKeyIndex* index,
+    uint64_t key)
+{
+    if (index->slotCount == 0) {
+        return 0;
+    }
+
+    return index->slots[getKeySlotIndex(index, key)].itemIndex;
+}
+
+static void insertKey(
+    IlcKeyIndex* index,
+    uint64_t key,
+    unsigned itemIndex)
+{
+    // Keep the load factor under 3/4
+    if (4 * (index->entryCount + 1) > 3 * index->slotCount) {
+        unsigned oldSlotCount = index->slotCount;
+        IlcKeySlot* oldSlots = index->slots;
+
+        index->slotCount = oldSlotCount == 0 ? 64 : 2 * oldSlotCount;
+        index->slots = calloc(index->slotCount, sizeof(IlcKeySlot));
+
+        for (unsigned i = 0; i < oldSlotCount; i++) {
+            if (oldSlots[i].itemIndex != 0) {
+                index->slots[getKeySlotIndex(index, oldSlots[i].key)] = oldSlots[i];
+            }
+        }
+
+        free(oldSlots);
+    }
+
+    IlcKeySlot* slot = &index->slots[getKeySlotIndex(index, key)];
+
+    // Keep the first item, lookups have to return the same item as a linear search
+    if (slot->itemIndex == 0) {
+        slot->key = key;
+        slot->itemIndex = itemIndex + 1;
+        index->entryCount++;
+    }
+}
+
 static const IlcRegister* addRegister(
     IlcCompiler* compiler,
     const IlcRegister* reg,
@@ -429,6 +511,7 @@ static const IlcRegister* addRegister(
     }
 
     compiler->regs[compiler->regCount - 1] = *reg;
+    insertKey(&compiler->regIndex, getKey(reg->ilType, reg->ilNum), compiler->regCount - 1);
 
     return &compiler->regs[compiler->regCount - 1];
 }
@@ -438,15 +521,9 @@ static const IlcRegister* findRegister(
     uint32_t type,
     uint32_t num)
 {
-    for (int i = 0; i < compiler->regCount; i++) {
-        const IlcRegister* reg = &compiler->regs[i];
-
-        if (reg->ilType == type && reg->ilNum == num) {
-            return reg;
-        }
-    }
+    unsigned itemIndex = findKey(&compiler->regIndex, getKey(type, num));
 
-    return NULL;
+    return itemIndex != 0 ? &compiler->regs[itemIndex - 1] : NULL;
 }
 
 static const IlcRegister* findOrCreateRegister(
@@ -486,15 +563,9 @@ static const IlcResource* findResource(
     IlcResourceType resType,
     uint32_t ilId)
 {
-    for (int i = 0; i < compiler->resourceCount; i++) {
-        const IlcResource* resource = &compiler->resources[i];
-
-        if (resource->resType == resType && resource->ilId == ilId) {
-            return resource;
-        }
-    }
+    unsigned itemIndex = findKey(&compiler->resourceIndex, getKey(resType, ilId));
 
-    return NULL;
+    return itemIndex != 0 ? &compiler->resources[itemIndex - 1] : NULL;
 }
 
 static const IlcResource* emitPushConstant(IlcCompiler* compiler);
@@ -532,6 +603,8 @@ static const IlcResource* addResource(
     compiler->resources = realloc(compiler->resources,
                                   sizeof(IlcResource) * compiler->resourceCount);
     compiler->resources[compiler->resourceCount - 1] = *resource;
+    insertKey(&compiler->resourceIndex, getKey(resource->resType, resource->ilId),
+              compiler->resourceCount - 1);
 
     return &compiler->resources[compiler->resourceCount - 1];
 }
@@ -644,15 +717,9 @@ static const IlcSampler* findSampler(
     IlcCompiler* compiler,
     uint32_t ilId)
 {
-    for (int i = 0; i < compiler->samplerCount; i++) {
-        const IlcSampler* sampler = &compiler->samplers[i];
-
-        if (sampler->ilId == ilId) {
-            return sampler;
-        }
-    }
+    unsigned itemIndex = findKey(&compiler->samplerIndex, getKey(0, ilId));
 
-    return NULL;
+    return itemIndex != 0 ? &compiler->samplers[itemIndex - 1] : NULL;
 }
 
 static const IlcSampler* addSampler(
@@ -669,6 +736,7 @@ static const IlcSampler* addSampler(
     compiler->samplerCount++;
     compiler->samplers = realloc(compiler->samplers, sizeof(IlcSampler) * compiler->samplerCount);
     compiler->samplers[compiler->samplerCount - 1] = *sampler;
+    insertKey(&compiler->samplerIndex, getKey(0, sampler->ilId), compiler->samplerCount - 1);
 
     return &compiler->samplers[compiler->samplerCount - 1];
 }
@@ -4466,10 +4534,13 @@ IlcShader ilcCompileKernel(
         .regCount = 0,
         .regSize = 0,
         .regs = NULL,
+        .regIndex = { 0, 0, NULL },
         .resourceCount = 0,
         .resources = NULL,
+        .resourceIndex = { 0, 0, NULL },
         .samplerCount = 0,
         .samplers = NULL,
+        .samplerIndex = { 0, 0, NULL },
         .controlFlowBlockCount = 0,
         .controlFlowBlocks = NULL,
         .hsForkPhaseIdCount = 0,
@@ -4510,8 +4581,11 @@ IlcShader ilcCompileKernel(
     emitEntryPoint(&compiler);
 
     free(compiler.regs);
+    free(compiler.regIndex.slots);
     free(compiler.resources);
+    free(compiler.resourceIndex.slots);
     free(compiler.samplers);
+    free(compiler.samplerIndex.slots);
     free(compiler.controlFlowBlocks);
     free(compiler.hsForkPhaseIds);
     free(compiler.hsJoinPhaseIds);
@@ -120,6 +120,18 @@ IlcShader ilcCompileKernel(
     const Kernel* kernel,
     const char* name);
 
+bool ilcLoadCachedShader(
+    IlcShader* shader,
+    const char* name,
+    unsigned ilSize,
+    const IlcOptions* options);
+
+void ilcStoreCachedShader(
+    const IlcShader* shader,
+    const char* name,
+    unsigned ilSize,
+    const IlcOptions* options);
+
 IlcRecompiledShader ilcRecompileHullKernel(
     const uint32_t* spirvWords,
     unsigned wordCount,
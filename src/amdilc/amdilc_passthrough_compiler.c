@@ -35,6 +35,7 @@ IlcRecompiledShader ilcRecompileHullKernel(
     module.currentId = 0;
     for (int i = 0; i < ID_MAX; i++) {
         module.buffer[i] = (IlcSpvBuffer) { 0, 0, NULL };
+        module.index[i] = (IlcSpvIndex) { 0, 0, 0, NULL };
     }
 
     IlcRecompiler recompiler = (IlcRecompiler){
@@ -82,6 +82,157 @@ static void putHeader(
     putWord(buffer, 0);
 }
 
+static unsigned getIdWordIndex(
+    IlcSpvBufferId bufferId)
+{
+    // Types start with their result ID, constants with their result type
+    return bufferId == ID_CONSTANTS ? 2 : 1;
+}
+
+static uint32_t hashInstr(
+    const IlcSpvWord* words,
+    unsigned idWordIndex)
+{
+    unsigned wordCount = words[0] >> SpvWordCountShift;
+    uint32_t hash = 2166136261u;
+
+    // FNV-1a over the instruction words, minus the result ID
+    for (unsigned i = 0; i < wordCount; i++) {
+        if (i != idWordIndex) {
+            hash = (hash ^ words[i]) * 16777619u;
+        }
+    }
+
+    // Mix high bits down since the slot is picked from the low bits
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6B;
+    hash ^= hash >> 13;
+    return hash;
+}
+
+static bool isInstrEqual(
+    const IlcSpvWord* words,
+    const IlcSpvWord* otherWords,
+    unsigned idWordIndex)
+{
+    unsigned wordCount = words[0] >> SpvWordCountShift;
+
+    // First word holds both the opcode and the word count
+    if (words[0] != otherWords[0]) {
+        return false;
+    }
+
+    for (unsigned i = 1; i < wordCount; i++) {
+        if (i != idWordIndex && words[i] != otherWords[i]) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static IlcSpvIndexSlot* findIndexSlot(
+    const IlcSpvIndex* index,
+    const IlcSpvBuffer* buffer,
+    unsigned idWordIndex,
+    const IlcSpvWord* words,
+    uint32_t hash)
+{
+    unsigned mask = index->slotCount - 1;
+
+    // Linear probing, stop at the first match or empty slot
+    for (unsigned i = hash & mask; ; i = (i + 1) & mask) {
+        IlcSpvIndexSlot* slot = &index->slots[i];
+
+        if (slot->wordIndex == 0 ||
+            (slot->hash == hash &&
+             isInstrEqual(&buffer->words[slot->wordIndex - 1], words, idWordIndex))) {
+            return slot;
+        }
+    }
+}
+
+static void growIndex(
+    IlcSpvIndex* index)
+{
+    unsigned oldSlotCount = index->slotCount;
+    IlcSpvIndexSlot* oldSlots = index->slots;
+
+    index->slotCount = oldSlotCount == 0 ? 256 : 2 * oldSlotCount;
+    index->slots = calloc(index->slotCount, sizeof(IlcSpvIndexSlot));
+
+    // Keys are unique, only need to look for an empty slot
+    unsigned mask = index->slotCount - 1;
+    for (unsigned i = 0; i < oldSlotCount; i++) {
+        if (oldSlots[i].wordIndex != 0) {
+            unsigned j = oldSlots[i].hash & mask;
+            while (index->slots[j].wordIndex != 0) {
+                j = (j + 1) & mask;
+            }
+            index->slots[j] = oldSlots[i];
+        }
+    }
+
+    free(oldSlots);
+}
+
+static void updateIndex(
+    IlcSpvModule* module,
+    IlcSpvBufferId bufferId)
+{
+    IlcSpvIndex* index = &module->index[bufferId];
+    const IlcSpvBuffer* buffer = &module->buffer[bufferId];
+    unsigned idWordIndex = getIdWordIndex(bufferId);
+
+    // Catch up with instructions added since the last lookup, including the ones copied
+    // verbatim by the passthrough compiler. Only the first occurrence of an instruction
+    // is indexed, to return the same ID as a front-to-back scan of the buffer would.
+    while (index->indexedWordCount < buffer->wordCount) {
+        const IlcSpvWord* words = &buffer->words[index->indexedWordCount];
+
+        // Keep the load factor under 3/4
+        if (4 * (index->entryCount + 1) > 3 * index->slotCount) {
+            growIndex(index);
+        }
+
+        uint32_t hash = hashInstr(words, idWordIndex);
+        IlcSpvIndexSlot* slot = findIndexSlot(index, buffer, idWordIndex, words, hash);
+
+        if (slot->wordIndex == 0) {
+            slot->hash = hash;
+            slot->wordIndex = index->indexedWordCount + 1;
+            index->entryCount++;
+        }
+
+        index->indexedWordCount += words[0] >> SpvWordCountShift;
+    }
+}
+
+static IlcSpvId findInstr(
+    IlcSpvModule* module,
+    IlcSpvBufferId bufferId,
+    const IlcSpvWord* words)
+{
+    const IlcSpvIndex* index = &module->index[bufferId];
+    const IlcSpvBuffer* buffer = &module->buffer[bufferId];
+    unsigned idWordIndex = getIdWordIndex(bufferId);
+
+    updateIndex(module, bufferId);
+
+    if (index->slotCount == 0) {
+        return 0;
+    }
+
+    uint32_t hash = hashInstr(words, idWordIndex);
+    const IlcSpvIndexSlot* slot = findIndexSlot(index, buffer, idWordIndex, words, hash);
+
+    if (slot->wordIndex == 0) {
+        return 0;
+    }
+
+    return buffer->words[slot->wordIndex - 1 + idWordIndex];
+}
+
 static IlcSpvId putType(
     IlcSpvModule* module,
     SpvOp op,
@@ -90,44 +241,26 @@ static IlcSpvId putType(
     bool hasConstants,
     bool unique)
 {
-    IlcSpvBuffer* buffer = &module->buffer[hasConstants ? ID_TYPES_WITH_CONSTANTS : ID_TYPES];
-
-    if (!unique) {
-        // Check if the type is already present
-        for (int i = 0; i < buffer->wordCount;) {
-            SpvOp typeOp = buffer->words[i] & SpvOpCodeMask;
-            unsigned typeWordCount = buffer->words[i] >> SpvWordCountShift;
-            unsigned typeArgCount = typeWordCount - 2;
-
-            // Got a potential match
-            if (op == typeOp && argCount == typeArgCount) {
-                bool match = true;
-                IlcSpvId typeId = buffer->words[i + 1];
-
-                // Check that the args also match
-                for (unsigned j = 0; j < typeArgCount; j++) {
-                    if (args[j] != buffer->words[i + 2 + j]) {
-                        match = false;
-                        break;
-                    }
-                }
-
-                if (match) {
-                    return typeId;
-                }
-            }
+    IlcSpvBufferId bufferId = hasConstants ? ID_TYPES_WITH_CONSTANTS : ID_TYPES;
+    unsigned wordCount = 2 + argCount;
+    STACK_ARRAY(IlcSpvWord, words, 16, wordCount);
 
-            i += typeWordCount;
-        }
-    }
+    words[0] = op | (wordCount << SpvWordCountShift);
+    words[1] = 0;
+    memcpy(&words[2], args, argCount * sizeof(IlcSpvWord));
 
-    IlcSpvId id = ilcSpvAllocId(module);
-    putInstr(buffer, op, 2 + argCount);
-    putWord(buffer, id);
-    for (int i = 0; i < argCount; i++) {
-        putWord(buffer, args[i]);
+    // Check if the type is already present
+    IlcSpvId id = unique ? 0 : findInstr(module, bufferId, words);
+
+    if (id == 0) {
+        id = ilcSpvAllocId(module);
+        words[1] = id;
+
+        const IlcSpvBuffer instrBuffer = { wordCount, wordCount * sizeof(IlcSpvWord), words };
+        putBuffer(&module->buffer[bufferId], &instrBuffer);
     }
 
+    STACK_ARRAY_FINISH(words);
     return id;
 }
 
@@ -138,46 +271,26 @@ static IlcSpvId putConstant(
     unsigned argCount,
     const IlcSpvWord* args)
 {
-    IlcSpvBuffer* buffer = &module->buffer[ID_CONSTANTS];
+    unsigned wordCount = 3 + argCount;
+    STACK_ARRAY(IlcSpvWord, words, 16, wordCount);
 
-    // Check if the constant is already present
-    for (int i = 0; i < buffer->wordCount;) {
-        SpvOp constantOp = buffer->words[i] & SpvOpCodeMask;
-        unsigned constantWordCount = buffer->words[i] >> SpvWordCountShift;
-        unsigned constantArgCount = constantWordCount - 3;
-        IlcSpvId constantResultTypeId = buffer->words[i + 1];
-
-        // Got a potential match
-        if (op == constantOp &&
-            resultTypeId == constantResultTypeId &&
-            argCount == constantArgCount) {
-            bool match = true;
-            IlcSpvId constantId = buffer->words[i + 2];
-
-            // Check that the args also match
-            for (unsigned j = 0; j < constantArgCount; j++) {
-                if (args[j] != buffer->words[i + 3 + j]) {
-                    match = false;
-                    break;
-                }
-            }
+    words[0] = op | (wordCount << SpvWordCountShift);
+    words[1] = resultTypeId;
+    words[2] = 0;
+    memcpy(&words[3], args, argCount * sizeof(IlcSpvWord));
 
-            if (match) {
-                return constantId;
-            }
-        }
+    // Check if the constant is already present
+    IlcSpvId id = findInstr(module, ID_CONSTANTS, words);
 
-        i += constantWordCount;
-    }
+    if (id == 0) {
+        id = ilcSpvAllocId(module);
+        words[2] = id;
 
-    IlcSpvId id = ilcSpvAllocId(module);
-    putInstr(buffer, op, 3 + argCount);
-    putWord(buffer, resultTypeId);
-    putWord(buffer, id);
-    for (int i = 0; i < argCount; i++) {
-        putWord(buffer, args[i]);
+        const IlcSpvBuffer instrBuffer = { wordCount, wordCount * sizeof(IlcSpvWord), words };
+        putBuffer(&module->buffer[ID_CONSTANTS], &instrBuffer);
     }
 
+    STACK_ARRAY_FINISH(words);
     return id;
 }
 
@@ -212,6 +325,7 @@ void ilcSpvInit(
     module->glsl450ImportId = ilcSpvAllocId(module);
     for (int i = 0; i < ID_MAX; i++) {
         module->buffer[i] = (IlcSpvBuffer) { 0, 0, NULL };
+        module->index[i] = (IlcSpvIndex) { 0, 0, 0, NULL };
     }
 
     ilcSpvPutCapability(module, SpvCapabilityShader);
@@ -229,6 +343,10 @@ void ilcSpvFinish(
         putBuffer(&module->buffer[ID_MAIN], &module->buffer[i]);
         free(module->buffer[i].words);
     }
+
+    for (int i = 0; i < ID_MAX; i++) {
+        free(module->index[i].slots);
+    }
 }
 
 unsigned ilcSpvGetWordIndex(
@@ -33,10 +33,23 @@ typedef struct {
     IlcSpvWord* words;
 } IlcSpvBuffer;
 
+typedef struct {
+    uint32_t hash;
+    unsigned wordIndex; // Instruction word index + 1, 0 if the slot is empty
+} IlcSpvIndexSlot;
+
+typedef struct {
+    unsigned indexedWordCount;
+    unsigned entryCount;
+    unsigned slotCount;
+    IlcSpvIndexSlot* slots;
+} IlcSpvIndex;
+
 typedef struct {
     IlcSpvId currentId;
     IlcSpvId glsl450ImportId;
     IlcSpvBuffer buffer[ID_MAX];
+    IlcSpvIndex index[ID_MAX]; // Only used for type and constant deduplication
 } IlcSpvModule;
 
 void ilcSpvInit(
@@ -1,17 +1,65 @@
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
+#include <limits.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "amdilc.h"
 #include "logger.h"
 
+static bool parseThreadCount(
+    const char* str,
+    unsigned* threadCount)
+{
+    char* end = NULL;
+
+    if (*str < '0' || *str > '9') {
+        return false;
+    }
+
+    unsigned long value = strtoul(str, &end, 10);
+    if (*end != '\0' || value > UINT_MAX) {
+        return false;
+    }
+
+    *threadCount = value;
+    return true;
+}
+
+static void printUsage(
+    const char* name)
+{
+    LOGE("GRVK's amdilc -> SPIR-V offline compiler\n");
+    LOGE("usage: GRVK_DUMP_SHADERS=1 %s [-j threads] [IL binary] ...\n", name);
+}
+
 int main(int argc, char* argv[])
 {
+    unsigned threadCount = 1;
+    int firstFile = 1;
+
     logInit("", "");
 
-    if (argc < 2) {
-        LOGE("GRVK's amdilc -> SPIR-V offline compiler\n");
-        LOGE("usage: GRVK_DUMP_SHADERS=1 %s [IL binary] ...\n", argv[0]);
+    if (firstFile < argc && strncmp(argv[firstFile], "-j", 2) == 0) {
+        // Accept both -jN and -j N, a missing count means one thread per CPU
+        const char* countArg = argv[firstFile] + 2;
+        firstFile++;
+
+        if (*countArg == '\0') {
+            threadCount = 0;
+            if (firstFile < argc && parseThreadCount(argv[firstFile], &threadCount)) {
+                firstFile++;
+            }
+        } else if (!parseThreadCount(countArg, &threadCount)) {
+            LOGE("invalid thread count '%s'\n", countArg);
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (argc - firstFile < 1) {
+        printUsage(argv[0]);
         return 1;
     }
 
@@ -19,12 +67,19 @@ int main(int argc, char* argv[])
         LOGW("GRVK_DUMP_SHADERS isn't set. Logs only.\n");
     }
 
-    for (unsigned i = 1; i < argc; i++) {
-        LOGW("compiling %s... (%d/%d)\n", argv[i], i, argc - 1);
+    unsigned count = argc - firstFile;
+    const void** codes = malloc(count * sizeof(void*));
+    unsigned* sizes = malloc(count * sizeof(unsigned));
+    IlcShader* shaders = malloc(count * sizeof(IlcShader));
+
+    for (unsigned i = 0; i < count; i++) {
+        const char* path = argv[firstFile + i];
+
+        LOGV("reading %s... (%u/%u)\n", path, i + 1, count);
 
-        FILE* file = fopen(argv[i], "rb");
+        FILE* file = fopen(path, "rb");
         if (file == NULL) {
-            LOGE("failed to open %s\n", argv[i]);
+            LOGE("failed to open %s\n", path);
             return 1;
         }
 
@@ -36,10 +91,24 @@ int main(int argc, char* argv[])
         fread(data, 1, size, file);
         fclose(file);
 
-        ilcCompileShader(data, size, NULL);
+        codes[i] = data;
+        sizes[i] = size;
+    }
+
+    LOGW("compiling %u shaders...\n", count);
+    ilcCompileShaderBatch(shaders, count, codes, sizes, NULL, threadCount);
 
-        free(data);
+    for (unsigned i = 0; i < count; i++) {
+        free((void*)codes[i]);
+        free(shaders[i].code);
+        free(shaders[i].bindings);
+        free(shaders[i].inputs);
+        free(shaders[i].outputLocations);
+        free(shaders[i].name);
     }
 
+    free(codes);
+    free(sizes);
+    free(shaders);
     return 0;
 }
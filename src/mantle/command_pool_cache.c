@@ -0,0 +1,192 @@
+#include "mantle_internal.h"
+
+// Vulkan pools can't be shared by command buffers that may be recorded concurrently,
+// and Mantle command buffers can be recorded from any thread. Each command buffer keeps
+// its own pool, the pools are recycled instead of being recreated.
+
+VkResult grCommandPoolCacheAcquire(
+    GrQueue* grQueue,
+    VkCommandPool* pCommandPool,
+    VkCommandBuffer* pCommandBuffer)
+{
+    const GrDevice* grDevice = GET_OBJ_DEVICE(grQueue);
+    VkCommandPool vkCommandPool = VK_NULL_HANDLE;
+    VkResult vkRes;
+
+    AcquireSRWLockExclusive(&grQueue->commandPoolCacheLock);
+    if (grQueue->commandPoolCacheCount > 0) {
+        grQueue->commandPoolCacheCount--;
+        const CachedCommandPool* cachedPool =
+            &grQueue->commandPoolCache[grQueue->commandPoolCacheCount];
+
+        *pCommandPool = cachedPool->pool;
+        *pCommandBuffer = cachedPool->commandBuffer;
+        ReleaseSRWLockExclusive(&grQueue->commandPoolCacheLock);
+        return VK_SUCCESS;
+    }
+    ReleaseSRWLockExclusive(&grQueue->commandPoolCacheLock);
+
+    const VkCommandPoolCreateInfo poolCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .pNext = NULL,
+        .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+        .queueFamilyIndex = grQueue->queueFamilyIndex,
+    };
+
+    vkRes = VKD.vkCreateCommandPool(grDevice->device, &poolCreateInfo, NULL, &vkCommandPool);
+    if (vkRes != VK_SUCCESS) {
+        LOGE("vkCreateCommandPool failed (%d)\n", vkRes);
+        return vkRes;
+    }
+
+    const VkCommandBufferAllocateInfo allocateInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .pNext = NULL,
+        .commandPool = vkCommandPool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1,
+    };
+
+    vkRes = VKD.vkAllocateCommandBuffers(grDevice->device, &allocateInfo, pCommandBuffer);
+    if (vkRes != VK_SUCCESS) {
+        LOGE("vkAllocateCommandBuffers failed (%d)\n", vkRes);
+        VKD.vkDestroyCommandPool(grDevice->device, vkCommandPool, NULL);
+        return vkRes;
+    }
+
+    *pCommandPool = vkCommandPool;
+    return VK_SUCCESS;
+}
+
+void grCommandPoolCacheRelease(
+    GrQueue* grQueue,
+    VkCommandPool commandPool,
+    VkCommandBuffer commandBuffer)
+{
+    const GrDevice* grDevice = GET_OBJ_DEVICE(grQueue);
+
+    // Keep the pool memory around, the next command buffer will likely need as much
+    VkResult vkRes = VKD.vkResetCommandPool(grDevice->device, commandPool, 0);
+    if (vkRes != VK_SUCCESS) {
+        LOGW("vkResetCommandPool failed (%d)\n", vkRes);
+        VKD.vkDestroyCommandPool(grDevice->device, commandPool, NULL);
+        return;
+    }
+
+    AcquireSRWLockExclusive(&grQueue->commandPoolCacheLock);
+    if (grQueue->commandPoolCacheCount < COUNT_OF(grQueue->commandPoolCache)) {
+        grQueue->commandPoolCache[grQueue->commandPoolCacheCount] = (CachedCommandPool) {
+            .pool = commandPool,
+            .commandBuffer = commandBuffer,
+        };
+        grQueue->commandPoolCacheCount++;
+        commandPool = VK_NULL_HANDLE;
+    }
+    ReleaseSRWLockExclusive(&grQueue->commandPoolCacheLock);
+
+    // Cache is full
+    VKD.vkDestroyCommandPool(grDevice->device, commandPool, NULL);
+}
+
+void grCommandPoolCacheDestroy(
+    GrQueue* grQueue)
+{
+    const GrDevice* grDevice = GET_OBJ_DEVICE(grQueue);
+
+    if (quirkHas(QUIRK_KEEP_VK_DEVICE)) {
+        // Command buffers destroyed after the device still return their pools
+        return;
+    }
+
+    for (unsigned i = 0; i < grQueue->commandPoolCacheCount; i++) {
+        VKD.vkDestroyCommandPool(grDevice->device, grQueue->commandPoolCache[i].pool, NULL);
+    }
+
+    grQueue->commandPoolCacheCount = 0;
+}
+
+VkResult grTimestampQueryAcquire(
+    GrDevice* grDevice,
+    TimestampQuery* timestampQuery)
+{
+    VkResult vkRes = VK_SUCCESS;
+
+    AcquireSRWLockExclusive(&grDevice->timestampQueryLock);
+
+    if (grDevice->freeTimestampQueryCount == 0) {
+        VkQueryPool vkQueryPool = VK_NULL_HANDLE;
+
+        const VkQueryPoolCreateInfo queryPoolCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+            .pNext = NULL,
+            .flags = 0,
+            .queryType = VK_QUERY_TYPE_TIMESTAMP,
+            .queryCount = TIMESTAMP_QUERIES_PER_POOL,
+            .pipelineStatistics = 0,
+        };
+
+        vkRes = VKD.vkCreateQueryPool(grDevice->device, &queryPoolCreateInfo, NULL, &vkQueryPool);
+        if (vkRes != VK_SUCCESS) {
+            LOGE("vkCreateQueryPool failed (%d)\n", vkRes);
+            goto bail;
+        }
+
+        unsigned poolCount = grDevice->timestampQueryPoolCount + 1;
+
+        // The free list can hold every query of every pool
+        grDevice->timestampQueryPools =
+            realloc(grDevice->timestampQueryPools, poolCount * sizeof(VkQueryPool));
+        grDevice->freeTimestampQueries =
+            realloc(grDevice->freeTimestampQueries,
+                    poolCount * TIMESTAMP_QUERIES_PER_POOL * sizeof(TimestampQuery));
+
+        grDevice->timestampQueryPools[grDevice->timestampQueryPoolCount] = vkQueryPool;
+        grDevice->timestampQueryPoolCount = poolCount;
+
+        // Push in reverse so that queries get handed out in order
+        for (unsigned i = 0; i < TIMESTAMP_QUERIES_PER_POOL; i++) {
+            grDevice->freeTimestampQueries[i] = (TimestampQuery) {
+                .pool = vkQueryPool,
+                .index = TIMESTAMP_QUERIES_PER_POOL - 1 - i,
+            };
+        }
+        grDevice->freeTimestampQueryCount = TIMESTAMP_QUERIES_PER_POOL;
+    }
+
+    grDevice->freeTimestampQueryCount--;
+    *timestampQuery = grDevice->freeTimestampQueries[grDevice->freeTimestampQueryCount];
+
+bail:
+    ReleaseSRWLockExclusive(&grDevice->timestampQueryLock);
+    return vkRes;
+}
+
+void grTimestampQueryRelease(
+    GrDevice* grDevice,
+    const TimestampQuery* timestampQuery)
+{
+    if (timestampQuery->pool == VK_NULL_HANDLE) {
+        return;
+    }
+
+    AcquireSRWLockExclusive(&grDevice->timestampQueryLock);
+    grDevice->freeTimestampQueries[grDevice->freeTimestampQueryCount] = *timestampQuery;
+    grDevice->freeTimestampQueryCount++;
+    ReleaseSRWLockExclusive(&grDevice->timestampQueryLock);
+}
+
+void grTimestampQueryDestroy(
+    GrDevice* grDevice)
+{
+    if (quirkHas(QUIRK_KEEP_VK_DEVICE)) {
+        // Command buffers destroyed after the device still release their queries
+        return;
+    }
+
+    for (unsigned i = 0; i < grDevice->timestampQueryPoolCount; i++) {
+        VKD.vkDestroyQueryPool(grDevice->device, grDevice->timestampQueryPools[i], NULL);
+    }
+
+    free(grDevice->timestampQueryPools);
+    free(grDevice->freeTimestampQueries);
+}
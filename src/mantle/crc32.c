@@ -68,6 +68,19 @@
   #endif
 #endif
 
+// carry-less multiplication is only available on x86, the CPU is probed at runtime
+#if defined(CRC32_USE_PCLMUL)
+  #if defined(_MSC_VER) && !defined(__clang__)
+    #include <intrin.h>
+    #define CRC32_TARGET_PCLMUL
+  #else
+    #include <cpuid.h>
+    #define CRC32_TARGET_PCLMUL __attribute__((target("sse2,pclmul")))
+  #endif
+  #include <emmintrin.h>
+  #include <wmmintrin.h>
+#endif
+
 // abort if byte order is undefined
 #if !defined(__BYTE_ORDER)
 #error undefined byte order, compile with -D__BYTE_ORDER=1234 (if little endian) or -D__BYTE_ORDER=4321 (big endian)
@@ -525,9 +538,147 @@ uint32_t crc32_16bytes_prefetch(const void* data, size_t length, uint32_t previo
 #endif
 
 
+#ifdef CRC32_USE_PCLMUL
+/// check once whether the CPU supports carry-less multiplication
+int crc32_pclmul_supported()
+{
+  // -1 = not probed yet, concurrent probes store the same value
+  static volatile int supported = -1;
+
+  if (supported < 0)
+  {
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 1);
+    supported = (info[2] >> 1) & 1; // ECX bit 1 = PCLMULQDQ
+#else
+    unsigned int eax, ebx, ecx, edx;
+    supported = __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_PCLMUL) != 0;
+#endif
+  }
+
+  return supported;
+}
+
+
+/// compute CRC32 (PCLMULQDQ folding, see Intel's "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction")
+CRC32_TARGET_PCLMUL
+uint32_t crc32_pclmul(const void* data, size_t length, uint32_t previousCrc32)
+{
+  // folding needs at least four 128-bit lanes
+  if (length < 64)
+    return crc32_16bytes(data, length, previousCrc32);
+
+  // bit-reflected fold constants x^(4*128+64) mod P, x^(4*128) mod P, x^(128+64) mod P, ...
+  static const uint64_t k1k2[2] = { 0x0154442bd4, 0x01c6e41596 };
+  static const uint64_t k3k4[2] = { 0x01751997d0, 0x00ccaa009e };
+  static const uint64_t k5k0[2] = { 0x0163cd6124, 0x0000000000 };
+  // bit-reflected P(x) and Barrett constant
+  static const uint64_t poly[2] = { 0x01db710641, 0x01f7011641 };
+
+  const uint8_t* current = (const uint8_t*) data;
+  // the folding loop only consumes whole 16-byte blocks
+  size_t remaining = length & 15;
+  length -= remaining;
+
+  __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+
+  x1 = _mm_loadu_si128((const __m128i*) (current + 0x00));
+  x2 = _mm_loadu_si128((const __m128i*) (current + 0x10));
+  x3 = _mm_loadu_si128((const __m128i*) (current + 0x20));
+  x4 = _mm_loadu_si128((const __m128i*) (current + 0x30));
+  x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int) ~previousCrc32));
+  x0 = _mm_loadu_si128((const __m128i*) k1k2);
+
+  current += 64;
+  length  -= 64;
+
+  // fold four lanes in parallel, 64 bytes at once
+  while (length >= 64)
+  {
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+    x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+    x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+    x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i*) (current + 0x00)));
+    x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i*) (current + 0x10)));
+    x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i*) (current + 0x20)));
+    x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i*) (current + 0x30)));
+
+    current += 64;
+    length  -= 64;
+  }
+
+  // fold the four lanes into one
+  x0 = _mm_loadu_si128((const __m128i*) k3k4);
+
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+  // fold remaining 16-byte blocks
+  while (length >= 16)
+  {
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128((const __m128i*) current)), x5);
+
+    current += 16;
+    length  -= 16;
+  }
+
+  // fold 128 bits to 64 bits
+  x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+  x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+  x1 = _mm_srli_si128(x1, 8);
+  x1 = _mm_xor_si128(x1, x2);
+
+  x0 = _mm_loadu_si128((const __m128i*) k5k0);
+
+  x2 = _mm_srli_si128(x1, 4);
+  x1 = _mm_and_si128(x1, x3);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  // Barrett reduction to 32 bits
+  x0 = _mm_loadu_si128((const __m128i*) poly);
+
+  x2 = _mm_and_si128(x1, x3);
+  x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+  x2 = _mm_and_si128(x2, x3);
+  x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  uint32_t crc = ~(uint32_t) _mm_cvtsi128_si32(_mm_srli_si128(x1, 4));
+
+  // remaining 0 to 15 bytes
+  return remaining != 0 ? crc32_16bytes(current, remaining, crc) : crc;
+}
+#endif
+
+
 /// compute CRC32 using the fastest algorithm for large datasets on modern CPUs
 uint32_t crc32_fast(const void* data, size_t length, uint32_t previousCrc32)
 {
+#ifdef CRC32_USE_PCLMUL
+  if (length >= 64 && crc32_pclmul_supported())
+    return crc32_pclmul (data, length, previousCrc32);
+#endif
+
 #ifdef CRC32_USE_LOOKUP_TABLE_SLICING_BY_16
   return crc32_16bytes (data, length, previousCrc32);
 #elif defined(CRC32_USE_LOOKUP_TABLE_SLICING_BY_8)
@@ -24,6 +24,10 @@
 #define CRC32_USE_LOOKUP_TABLE_SLICING_BY_4
 #define CRC32_USE_LOOKUP_TABLE_SLICING_BY_8
 #define CRC32_USE_LOOKUP_TABLE_SLICING_BY_16
+// PCLMULQDQ folding falls back to slicing-by-16 for short inputs and tails
+#if defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64)
+  #define CRC32_USE_PCLMUL
+#endif
 // - crc32_bitwise  doesn't need it at all
 // - crc32_halfbyte has its own small lookup table
 // - crc32_1byte_tableless and crc32_1byte_tableless2 don't need it at all
@@ -79,3 +83,10 @@ uint32_t crc32_16bytes (const void* data, size_t length, uint32_t previousCrc32)
 /// compute CRC32 (Slicing-by-16 algorithm, prefetch upcoming data blocks)
 uint32_t crc32_16bytes_prefetch(const void* data, size_t length, uint32_t previousCrc32, size_t prefetchAhead /* 256 */);
 #endif
+
+#ifdef CRC32_USE_PCLMUL
+/// returns non-zero if the CPU supports PCLMULQDQ (required by crc32_pclmul)
+int      crc32_pclmul_supported();
+/// compute CRC32 (PCLMULQDQ folding, 64 bytes at once)
+uint32_t crc32_pclmul  (const void* data, size_t length, uint32_t previousCrc32);
+#endif
@@ -1,6 +1,7 @@
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
 #include "logger.h"
+#include "scratch_arena.h"
 #include "version.h"
 
 BOOLEAN WINAPI DllMain(
@@ -11,6 +12,11 @@ BOOLEAN WINAPI DllMain(
      if (nReason == DLL_PROCESS_ATTACH) {
         logInit("GRVK_LOG_PATH", "grvk.log");
         logPrintRaw("=== GRVK %s ===\n", GRVK_VERSION);
+        scratchInit();
+     } else if (nReason == DLL_THREAD_DETACH) {
+        scratchThreadDetach();
+     } else if (nReason == DLL_PROCESS_DETACH) {
+        scratchDestroy();
      }
 
      return TRUE;
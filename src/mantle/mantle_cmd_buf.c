@@ -2,6 +2,19 @@
 #include "amdilc.h"
 
 #define SETS_PER_POOL   (2048)
+#define BARRIERS_PER_BATCH (64)
+
+#define WRITE_ACCESS_MASK \
+    (VK_ACCESS_2_SHADER_WRITE_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT | \
+     VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | \
+     VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_HOST_WRITE_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT)
+
+// The atomic counter buffer is shared by both bind points of a queue
+#define ATOMIC_COUNTER_SHADER_STAGES \
+    (VK_PIPELINE_STAGE_2_PRE_RASTERIZATION_SHADERS_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT | \
+     VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT)
+#define ATOMIC_COUNTER_TRANSFER_STAGES \
+    (VK_PIPELINE_STAGE_2_CLEAR_BIT | VK_PIPELINE_STAGE_2_COPY_BIT)
 
 typedef enum _DirtyFlags {
     FLAG_DIRTY_DESCRIPTOR_SET       = 1u << 0,
@@ -16,6 +29,9 @@ static void grCmdBufferBeginRenderPass(
 {
     const GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
 
+    // Transitions can't be recorded within a render pass
+    grCmdBufferFlushBarriers(grCmdBuffer);
+
     if (grCmdBuffer->isRendering) {
         return;
     }
@@ -53,41 +69,285 @@ void grCmdBufferEndRenderPass(
     grCmdBuffer->isRendering = false;
 }
 
+void grCmdBufferFlushBarriers(
+    GrCmdBuffer* grCmdBuffer)
+{
+    const GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
+
+    if (grCmdBuffer->bufferBarrierCount == 0 && grCmdBuffer->imageBarrierCount == 0) {
+        return;
+    }
+
+    grCmdBufferEndRenderPass(grCmdBuffer);
+
+    const VkDependencyInfo dependencyInfo = {
+        .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+        .pNext = NULL,
+        .dependencyFlags = 0,
+        .memoryBarrierCount = 0,
+        .pMemoryBarriers = NULL,
+        .bufferMemoryBarrierCount = grCmdBuffer->bufferBarrierCount,
+        .pBufferMemoryBarriers = grCmdBuffer->bufferBarriers,
+        .imageMemoryBarrierCount = grCmdBuffer->imageBarrierCount,
+        .pImageMemoryBarriers = grCmdBuffer->imageBarriers,
+    };
+
+    VKD.vkCmdPipelineBarrier2(grCmdBuffer->commandBuffer, &dependencyInfo);
+
+    grCmdBuffer->bufferBarrierCount = 0;
+    grCmdBuffer->imageBarrierCount = 0;
+}
+
+static VkDeviceSize getBufferRangeEnd(
+    VkDeviceSize offset,
+    VkDeviceSize size)
+{
+    return size == VK_WHOLE_SIZE ? VK_WHOLE_SIZE : offset + size;
+}
+
+static bool isSubresourceRangeOverlapping(
+    const VkImageSubresourceRange* a,
+    const VkImageSubresourceRange* b)
+{
+    uint32_t aLevelEnd = a->levelCount == VK_REMAINING_MIP_LEVELS ?
+                         UINT32_MAX : a->baseMipLevel + a->levelCount;
+    uint32_t bLevelEnd = b->levelCount == VK_REMAINING_MIP_LEVELS ?
+                         UINT32_MAX : b->baseMipLevel + b->levelCount;
+    uint32_t aLayerEnd = a->layerCount == VK_REMAINING_ARRAY_LAYERS ?
+                         UINT32_MAX : a->baseArrayLayer + a->layerCount;
+    uint32_t bLayerEnd = b->layerCount == VK_REMAINING_ARRAY_LAYERS ?
+                         UINT32_MAX : b->baseArrayLayer + b->layerCount;
+
+    return (a->aspectMask & b->aspectMask) != 0 &&
+           a->baseMipLevel < bLevelEnd && b->baseMipLevel < aLevelEnd &&
+           a->baseArrayLayer < bLayerEnd && b->baseArrayLayer < aLayerEnd;
+}
+
+static void grCmdBufferAddBufferBarrier(
+    GrCmdBuffer* grCmdBuffer,
+    const VkBufferMemoryBarrier2* barrier)
+{
+    if (barrier->srcStageMask == barrier->dstStageMask &&
+        barrier->srcAccessMask == barrier->dstAccessMask &&
+        (barrier->srcAccessMask & WRITE_ACCESS_MASK) == 0) {
+        // Read-only state left unchanged, nothing to wait for. Transitions between different
+        // read-only states are kept, they extend the dependency chain of an earlier write.
+        return;
+    }
+
+    // No command was recorded since the pending barriers were added, so overlapping transitions
+    // can be folded into a single barrier covering both ranges and access masks
+    VkDeviceSize end = getBufferRangeEnd(barrier->offset, barrier->size);
+
+    for (unsigned i = 0; i < grCmdBuffer->bufferBarrierCount; i++) {
+        VkBufferMemoryBarrier2* pendingBarrier = &grCmdBuffer->bufferBarriers[i];
+        VkDeviceSize pendingEnd = getBufferRangeEnd(pendingBarrier->offset, pendingBarrier->size);
+
+        if (pendingBarrier->buffer == barrier->buffer &&
+            barrier->offset <= pendingEnd && pendingBarrier->offset <= end) {
+            end = MAX(end, pendingEnd);
+            pendingBarrier->srcStageMask |= barrier->srcStageMask;
+            pendingBarrier->dstStageMask |= barrier->dstStageMask;
+            pendingBarrier->srcAccessMask |= barrier->srcAccessMask;
+            pendingBarrier->dstAccessMask |= barrier->dstAccessMask;
+            pendingBarrier->offset = MIN(pendingBarrier->offset, barrier->offset);
+            pendingBarrier->size = end == VK_WHOLE_SIZE ? VK_WHOLE_SIZE : end - pendingBarrier->offset;
+            return;
+        }
+    }
+
+    if (grCmdBuffer->bufferBarrierCount == grCmdBuffer->bufferBarrierSize) {
+        grCmdBuffer->bufferBarrierSize = MAX(2 * grCmdBuffer->bufferBarrierSize, BARRIERS_PER_BATCH);
+        grCmdBuffer->bufferBarriers = realloc(grCmdBuffer->bufferBarriers,
+                                              grCmdBuffer->bufferBarrierSize *
+                                              sizeof(VkBufferMemoryBarrier2));
+    }
+
+    grCmdBuffer->bufferBarriers[grCmdBuffer->bufferBarrierCount] = *barrier;
+    grCmdBuffer->bufferBarrierCount++;
+}
+
+static void grCmdBufferAddImageBarrier(
+    GrCmdBuffer* grCmdBuffer,
+    const VkImageMemoryBarrier2* barrier)
+{
+    if (barrier->oldLayout == barrier->newLayout &&
+        barrier->srcStageMask == barrier->dstStageMask &&
+        barrier->srcAccessMask == barrier->dstAccessMask &&
+        (barrier->srcAccessMask & WRITE_ACCESS_MASK) == 0) {
+        // Read-only state left unchanged, nothing to wait for
+        return;
+    }
+
+    for (unsigned i = 0; i < grCmdBuffer->imageBarrierCount; i++) {
+        VkImageMemoryBarrier2* pendingBarrier = &grCmdBuffer->imageBarriers[i];
+
+        if (pendingBarrier->image != barrier->image ||
+            !isSubresourceRangeOverlapping(&pendingBarrier->subresourceRange,
+                                           &barrier->subresourceRange)) {
+            continue;
+        }
+
+        if (pendingBarrier->newLayout == barrier->oldLayout &&
+            memcmp(&pendingBarrier->subresourceRange, &barrier->subresourceRange,
+                   sizeof(VkImageSubresourceRange)) == 0) {
+            // Chain both transitions, the intermediate layout is never used
+            pendingBarrier->srcStageMask |= barrier->srcStageMask;
+            pendingBarrier->dstStageMask |= barrier->dstStageMask;
+            pendingBarrier->srcAccessMask |= barrier->srcAccessMask;
+            pendingBarrier->dstAccessMask |= barrier->dstAccessMask;
+            pendingBarrier->newLayout = barrier->newLayout;
+            return;
+        }
+
+        // Barriers within a single call are unordered, layout transitions have to be split
+        grCmdBufferFlushBarriers(grCmdBuffer);
+        break;
+    }
+
+    if (grCmdBuffer->imageBarrierCount == grCmdBuffer->imageBarrierSize) {
+        grCmdBuffer->imageBarrierSize = MAX(2 * grCmdBuffer->imageBarrierSize, BARRIERS_PER_BATCH);
+        grCmdBuffer->imageBarriers = realloc(grCmdBuffer->imageBarriers,
+                                             grCmdBuffer->imageBarrierSize *
+                                             sizeof(VkImageMemoryBarrier2));
+    }
+
+    grCmdBuffer->imageBarriers[grCmdBuffer->imageBarrierCount] = *barrier;
+    grCmdBuffer->imageBarrierCount++;
+}
+
+static void setPushConstant(
+    BindPoint* bindPoint,
+    unsigned offset,
+    uint32_t value)
+{
+    unsigned index = offset / sizeof(uint32_t);
+
+    if (bindPoint->pushConstantsValid && bindPoint->pushConstants[index] == value) {
+        return;
+    }
+
+    bindPoint->pushConstants[index] = value;
+    bindPoint->pushConstantDirtyBegin = MIN(bindPoint->pushConstantDirtyBegin, index);
+    bindPoint->pushConstantDirtyEnd = MAX(bindPoint->pushConstantDirtyEnd, index + 1);
+}
+
+static void grCmdBufferFlushPushConstants(
+    GrCmdBuffer* grCmdBuffer,
+    VkPipelineBindPoint vkBindPoint)
+{
+    const GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
+    BindPoint* bindPoint = &grCmdBuffer->bindPoints[vkBindPoint];
+
+    if (!bindPoint->pushConstantsValid) {
+        // Push constants are undefined in a new command buffer, send the whole block once
+        bindPoint->pushConstantDirtyBegin = 0;
+        bindPoint->pushConstantDirtyEnd = COUNT_OF(bindPoint->pushConstants);
+        bindPoint->pushConstantsValid = true;
+    }
+
+    if (bindPoint->pushConstantDirtyBegin >= bindPoint->pushConstantDirtyEnd) {
+        return;
+    }
+
+    // All pipeline layouts of a bind point share the same push constant range
+    VKD.vkCmdPushConstants(grCmdBuffer->commandBuffer, bindPoint->grPipeline->pipelineLayout,
+                           vkBindPoint == VK_PIPELINE_BIND_POINT_GRAPHICS ? VK_SHADER_STAGE_ALL_GRAPHICS : VK_SHADER_STAGE_COMPUTE_BIT,
+                           bindPoint->pushConstantDirtyBegin * sizeof(uint32_t),
+                           (bindPoint->pushConstantDirtyEnd - bindPoint->pushConstantDirtyBegin) * sizeof(uint32_t),
+                           &bindPoint->pushConstants[bindPoint->pushConstantDirtyBegin]);
+
+    bindPoint->pushConstantDirtyBegin = COUNT_OF(bindPoint->pushConstants);
+    bindPoint->pushConstantDirtyEnd = 0;
+}
+
+static const GrDescriptorSet* resolveDescriptorPath(
+    GrCmdBuffer* grCmdBuffer,
+    const GrDescriptorSet* grDescriptorSet,
+    unsigned slotOffset,
+    const PipelineDescriptorSlot* descriptorSlot,
+    unsigned* pSlotOffset)
+{
+    if (descriptorSlot->pathDepth == 0) {
+        *pSlotOffset = slotOffset;
+        return grDescriptorSet;
+    }
+
+    // Pipelines and sets bound in a command buffer stay alive until it's reset,
+    // so their addresses are stable keys
+    uintptr_t hash = ((uintptr_t)grDescriptorSet >> 4) ^ ((uintptr_t)descriptorSlot >> 4) ^
+                     (slotOffset * 2654435761u);
+    DescriptorPathCacheEntry* entry =
+        &grCmdBuffer->descriptorPathCache[hash & (DESCRIPTOR_PATH_CACHE_SIZE - 1)];
+
+    if (entry->rootSet == grDescriptorSet && entry->rootSlotOffset == slotOffset &&
+        entry->descriptorSlot == descriptorSlot) {
+        bool isValid = true;
+
+        // Stop at the first outdated set, the sets past it may have been detached
+        for (unsigned i = 0; i < descriptorSlot->pathDepth; i++) {
+            if (entry->pathSets[i]->generation != entry->pathGenerations[i]) {
+                isValid = false;
+                break;
+            }
+        }
+
+        if (isValid) {
+            *pSlotOffset = entry->slotOffset;
+            return entry->set;
+        }
+    }
+
+    const GrDescriptorSet* currentSet = grDescriptorSet;
+    const DescriptorSetSlot* slot = &currentSet->slots[slotOffset];
+    unsigned descriptorSlotOffset = slotOffset;
+
+    entry->rootSet = grDescriptorSet;
+    entry->rootSlotOffset = slotOffset;
+    entry->descriptorSlot = descriptorSlot;
+
+    for (unsigned i = 0; i < descriptorSlot->pathDepth; i++) {
+        entry->pathSets[i] = currentSet;
+        entry->pathGenerations[i] = currentSet->generation;
+
+        slot = &slot[descriptorSlot->path[i]];
+        descriptorSlotOffset = slot->nested.slotOffset;
+        currentSet = slot->nested.nextSet;
+        slot = &currentSet->slots[descriptorSlotOffset];
+    }
+
+    entry->set = currentSet;
+    entry->slotOffset = descriptorSlotOffset;
+
+    *pSlotOffset = descriptorSlotOffset;
+    return currentSet;
+}
+
 static void setupDescriptorSets(
     const GrDevice* grDevice,
-    const GrCmdBuffer* grCmdBuffer,
-    const BindPoint* bindPoint,
+    GrCmdBuffer* grCmdBuffer,
+    BindPoint* bindPoint,
     const GrDescriptorSet* grDescriptorSet,
     unsigned slotOffset,
     unsigned pipelineDescriptorSetCount,
     const PipelineDescriptorSlot* pipelineDescriptorSlots,
-    VkPipelineLayout pipelineLayout,
     VkDescriptorSet* pDescriptorSets,
     unsigned* pOffsets)
 {
     for (unsigned i = 0; i < pipelineDescriptorSetCount; i++) {
         const PipelineDescriptorSlot* descriptorSlot = &pipelineDescriptorSlots[i];
-        const DescriptorSetSlot* slot;
-        unsigned descriptorSlotOffset = slotOffset;
-        const GrDescriptorSet* currentSet = grDescriptorSet;
-
-        slot = &currentSet->slots[descriptorSlotOffset];
-
-        for (unsigned j = 0; j < descriptorSlot->pathDepth; j++) {
-            slot = &slot[descriptorSlot->path[j]];
-            descriptorSlotOffset = slot->nested.slotOffset;
-            currentSet = slot->nested.nextSet;
-            slot = &currentSet->slots[descriptorSlotOffset];
-        }
+        unsigned descriptorSlotOffset;
+        const GrDescriptorSet* currentSet = resolveDescriptorPath(grCmdBuffer, grDescriptorSet,
+                                                                  slotOffset, descriptorSlot,
+                                                                  &descriptorSlotOffset);
+        const DescriptorSetSlot* slot = &currentSet->slots[descriptorSlotOffset];
 
         pDescriptorSets[i] = currentSet->descriptorSet;
         pOffsets[i] = descriptorSlotOffset * (grDevice->descriptorUseSingleDescriptor ? 1 : DESCRIPTORS_PER_SLOT);
         // Pass buffer strides down to the shader
         for (unsigned j = 0; j < descriptorSlot->strideCount; j++) {
-            VKD.vkCmdPushConstants(grCmdBuffer->commandBuffer, pipelineLayout,
-                                   VK_SHADER_STAGE_ALL_GRAPHICS,
-                                   descriptorSlot->strideOffsets[j], sizeof(uint32_t),
-                                   &slot[descriptorSlot->strideSlotIndexes[j]].buffer.stride);
+            setPushConstant(bindPoint, descriptorSlot->strideOffsets[j],
+                            slot[descriptorSlot->strideSlotIndexes[j]].buffer.stride);
         }
     }
 }
@@ -108,22 +368,19 @@ static void grCmdBufferBindVkDescriptorSets(
                                bindPoint->grDescriptorSets[i], bindPoint->slotOffsets[i],
                                grPipeline->descriptorSetCounts[i],
                                grPipeline->descriptorSlots[i],
-                               grPipeline->pipelineLayout,
                                &bindPoint->descriptorSets[bindPoint->boundDescriptorSetCount],
                                &bindPoint->descriptorArrayOffsets[bindPoint->boundDescriptorSetCount]);
         bindPoint->boundDescriptorSetCount += grPipeline->descriptorSetCounts[i];
     }
 
-    uint32_t descriptorOffsets[] = { 0, 0 };
-    VKD.vkCmdPushConstants(grCmdBuffer->commandBuffer, grPipeline->pipelineLayout,
-                           vkBindPoint == VK_PIPELINE_BIND_POINT_GRAPHICS ? VK_SHADER_STAGE_ALL_GRAPHICS : VK_SHADER_STAGE_COMPUTE_BIT,
-                           DESCRIPTOR_CONST_OFFSETS_OFFSET, sizeof(descriptorOffsets),
-                           descriptorOffsets);
+    setPushConstant(bindPoint, DESCRIPTOR_CONST_OFFSETS_OFFSET, 0);
+    setPushConstant(bindPoint, DESCRIPTOR_CONST_OFFSETS_OFFSET + sizeof(uint32_t), 0);
+    for (unsigned i = 0; i < bindPoint->boundDescriptorSetCount; i++) {
+        setPushConstant(bindPoint, DESCRIPTOR_CONST_OFFSETS_OFFSET + sizeof(uint32_t) * (2 + i),
+                        bindPoint->descriptorArrayOffsets[i]);
+    }
+
     if (bindPoint->boundDescriptorSetCount > 0) {
-        VKD.vkCmdPushConstants(grCmdBuffer->commandBuffer, grPipeline->pipelineLayout,
-                               vkBindPoint == VK_PIPELINE_BIND_POINT_GRAPHICS ? VK_SHADER_STAGE_ALL_GRAPHICS : VK_SHADER_STAGE_COMPUTE_BIT,
-                               sizeof(uint32_t) * 2 + DESCRIPTOR_CONST_OFFSETS_OFFSET, sizeof(uint32_t) * bindPoint->boundDescriptorSetCount,
-                               bindPoint->descriptorArrayOffsets);
         VKD.vkCmdBindDescriptorSets(grCmdBuffer->commandBuffer, vkBindPoint, grPipeline->pipelineLayout,
                                     DESCRIPTOR_SET_ID, bindPoint->boundDescriptorSetCount, bindPoint->descriptorSets,
                                     0, NULL);
@@ -132,30 +389,22 @@ static void grCmdBufferBindVkDescriptorSets(
 
 static void setupDescriptorBuffers(
     const GrDevice* grDevice,
-    const GrCmdBuffer* grCmdBuffer,
-    const BindPoint* bindPoint,
+    GrCmdBuffer* grCmdBuffer,
+    BindPoint* bindPoint,
     const GrDescriptorSet* grDescriptorSet,
     unsigned slotOffset,
     unsigned pipelineDescriptorSetCount,
     const PipelineDescriptorSlot* pipelineDescriptorSlots,
-    VkPipelineLayout pipelineLayout,
     VkDeviceAddress* pBufferAddresses,
     VkDeviceSize* pOffsets)
 {
     for (unsigned i = 0; i < pipelineDescriptorSetCount; i++) {
         const PipelineDescriptorSlot* descriptorSlot = &pipelineDescriptorSlots[i];
-        const DescriptorSetSlot* slot;
-        unsigned descriptorSlotOffset = slotOffset;
-        const GrDescriptorSet* currentSet = grDescriptorSet;
-
-        slot = &currentSet->slots[descriptorSlotOffset];
-
-        for (unsigned j = 0; j < descriptorSlot->pathDepth; j++) {
-            slot = &slot[descriptorSlot->path[j]];
-            descriptorSlotOffset = slot->nested.slotOffset;
-            currentSet = slot->nested.nextSet;
-            slot = &currentSet->slots[descriptorSlotOffset];
-        }
+        unsigned descriptorSlotOffset;
+        const GrDescriptorSet* currentSet = resolveDescriptorPath(grCmdBuffer, grDescriptorSet,
+                                                                  slotOffset, descriptorSlot,
+                                                                  &descriptorSlotOffset);
+        const DescriptorSetSlot* slot = &currentSet->slots[descriptorSlotOffset];
 
         pBufferAddresses[i] = currentSet->descriptorBufferAddress;
         if (grDevice->descriptorUseSingleDescriptor) {
@@ -166,10 +415,8 @@ static void setupDescriptorBuffers(
         }
         // Pass buffer strides down to the shader
         for (unsigned j = 0; j < descriptorSlot->strideCount; j++) {
-            VKD.vkCmdPushConstants(grCmdBuffer->commandBuffer, pipelineLayout,
-                                   VK_SHADER_STAGE_ALL_GRAPHICS,
-                                   descriptorSlot->strideOffsets[j], sizeof(uint32_t),
-                                   &slot[descriptorSlot->strideSlotIndexes[j]].buffer.stride);
+            setPushConstant(bindPoint, descriptorSlot->strideOffsets[j],
+                            slot[descriptorSlot->strideSlotIndexes[j]].buffer.stride);
         }
     }
 }
@@ -190,7 +437,6 @@ static void grCmdBufferBindDescriptorBuffers(
                                bindPoint->grDescriptorSets[i], bindPoint->slotOffsets[i],
                                grPipeline->descriptorSetCounts[i],
                                grPipeline->descriptorSlots[i],
-                               grPipeline->pipelineLayout,
                                &bindPoint->descriptorBufferAddresses[bindPoint->boundDescriptorSetCount],
                                &bindPoint->descriptorOffsets[bindPoint->boundDescriptorSetCount]);
         bindPoint->boundDescriptorSetCount += grPipeline->descriptorSetCounts[i];
@@ -221,14 +467,7 @@ static void grCmdBufferBindDescriptorBuffers(
         }
     }
 
-    if (!bindPoint->descriptorSetOffsetsPushed) {
-        bindPoint->descriptorSetOffsetsPushed = true;
-        uint32_t descriptorOffsets[DESCRIPTOR_OFFSET_COUNT] = { 0 };
-        VKD.vkCmdPushConstants(grCmdBuffer->commandBuffer, grPipeline->pipelineLayout,
-                               vkBindPoint == VK_PIPELINE_BIND_POINT_GRAPHICS ? VK_SHADER_STAGE_ALL_GRAPHICS : VK_SHADER_STAGE_COMPUTE_BIT,
-                               DESCRIPTOR_CONST_OFFSETS_OFFSET, sizeof(descriptorOffsets),
-                               descriptorOffsets);
-    }
+    // Descriptor offsets are left zeroed, the initial push constant upload covers them
 
     if (dirtyBufferState) {
         VkDescriptorBufferBindingInfoEXT bufferBindingInfos[COUNT_OF(grCmdBuffer->bufferAddresses)];
@@ -302,7 +541,6 @@ static void grCmdBufferSetupDynamicBufferStride(
     GrCmdBuffer* grCmdBuffer,
     VkPipelineBindPoint vkBindPoint)
 {
-    const GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
     BindPoint* bindPoint = &grCmdBuffer->bindPoints[vkBindPoint];
     GrPipeline* grPipeline = bindPoint->grPipeline;
 
@@ -312,10 +550,8 @@ static void grCmdBufferSetupDynamicBufferStride(
     const PipelineDescriptorSlot* dynamicDescriptorSlot = &grPipeline->dynamicDescriptorSlot;
 
     for (unsigned j = 0; j < dynamicDescriptorSlot->strideCount; j++) {
-        VKD.vkCmdPushConstants(grCmdBuffer->commandBuffer, grPipeline->pipelineLayout,
-                               VK_SHADER_STAGE_ALL_GRAPHICS,
-                               dynamicDescriptorSlot->strideOffsets[j], sizeof(uint32_t),
-                               &bindPoint->dynamicMemoryView.buffer.stride);
+        setPushConstant(bindPoint, dynamicDescriptorSlot->strideOffsets[j],
+                        bindPoint->dynamicMemoryView.buffer.stride);
     }
 }
 
@@ -409,6 +645,43 @@ static void grCmdBufferDescriptorBufferPushDescriptorSet(
         descriptorCount, bufferWrites);
 }
 
+static void grCmdBufferBindShaders(
+    GrCmdBuffer* grCmdBuffer,
+    GrPipeline* grPipeline)
+{
+    const GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
+    const PipelineCreateInfo* createInfo = grPipeline->createInfo;
+    VkCommandBuffer commandBuffer = grCmdBuffer->commandBuffer;
+
+    // Same order the shaders are stored in, unused stages get unbound
+    static const VkShaderStageFlagBits stages[MAX_STAGE_COUNT] = {
+        VK_SHADER_STAGE_VERTEX_BIT,
+        VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT,
+        VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT,
+        VK_SHADER_STAGE_GEOMETRY_BIT,
+        VK_SHADER_STAGE_FRAGMENT_BIT,
+    };
+
+    VKD.vkCmdBindShadersEXT(commandBuffer, COUNT_OF(stages), stages,
+                            grPipelineGetVkShaders(grPipeline));
+
+    // Set the state that is baked into pipelines otherwise, must match initGraphicsPipelineState
+    VKD.vkCmdSetVertexInputEXT(commandBuffer, 0, NULL, 0, NULL);
+    VKD.vkCmdSetPrimitiveTopologyEXT(commandBuffer, createInfo->topology);
+    VKD.vkCmdSetPrimitiveRestartEnableEXT(commandBuffer, VK_FALSE);
+    VKD.vkCmdSetPatchControlPointsEXT(commandBuffer, createInfo->patchControlPoints);
+    VKD.vkCmdSetTessellationDomainOriginEXT(commandBuffer, VK_TESSELLATION_DOMAIN_ORIGIN_UPPER_LEFT);
+    VKD.vkCmdSetRasterizerDiscardEnableEXT(commandBuffer, VK_FALSE);
+    VKD.vkCmdSetDepthClampEnableEXT(commandBuffer, VK_TRUE);
+    VKD.vkCmdSetDepthBiasEnableEXT(commandBuffer, VK_TRUE);
+    VKD.vkCmdSetLineWidth(commandBuffer, 1.f);
+    VKD.vkCmdSetAlphaToCoverageEnableEXT(commandBuffer, createInfo->alphaToCoverageEnable);
+    VKD.vkCmdSetLogicOpEnableEXT(commandBuffer, createInfo->logicOpEnable);
+    VKD.vkCmdSetLogicOpEXT(commandBuffer, createInfo->logicOp);
+    VKD.vkCmdSetColorWriteMaskEXT(commandBuffer, 0, GR_MAX_COLOR_TARGETS,
+                                  createInfo->colorWriteMasks);
+}
+
 static void grCmdBufferUpdateResources(
     GrCmdBuffer* grCmdBuffer,
     VkPipelineBindPoint vkBindPoint)
@@ -443,24 +716,53 @@ static void grCmdBufferUpdateResources(
         grCmdBufferSetupDynamicBufferStride(grCmdBuffer, vkBindPoint);
     }
 
+    grCmdBufferFlushPushConstants(grCmdBuffer, vkBindPoint);
+
     if (dirtyFlags & FLAG_DIRTY_RENDER_PASS) {
         grCmdBufferEndRenderPass(grCmdBuffer);
     }
 
     if (dirtyFlags & FLAG_DIRTY_PIPELINE) {
-        if (grPipeline->pipeline == VK_NULL_HANDLE) {
-            // Assume that the depth-stencil attachment formats never change per pipeline
-            grPipeline->pipeline = grPipelineGetVkPipeline(grPipeline,
-                                                           grCmdBuffer->depthFormat,
-                                                           grCmdBuffer->stencilFormat);
-        }
+        if (grDevice->shaderObjectSupported) {
+            grCmdBufferBindShaders(grCmdBuffer, grPipeline);
+        } else {
+            VkPipeline vkPipeline = grPipelineGetVkPipeline(grPipeline,
+                                                             grCmdBuffer->depthFormat,
+                                                             grCmdBuffer->stencilFormat);
 
-        VKD.vkCmdBindPipeline(grCmdBuffer->commandBuffer, vkBindPoint, grPipeline->pipeline);
+            VKD.vkCmdBindPipeline(grCmdBuffer->commandBuffer, vkBindPoint, vkPipeline);
+        }
     }
 
     bindPoint->dirtyFlags = 0;
 }
 
+static bool isDescriptorStateCompatible(
+    const GrPipeline* grPipeline,
+    const GrPipeline* prevPipeline)
+{
+    // Descriptors and push constants stay bound across pipelines with the same layout, but the
+    // Mantle descriptor set slots have to map to the same Vulkan sets as well
+    if (prevPipeline == NULL ||
+        grPipeline->pipelineLayout != prevPipeline->pipelineLayout ||
+        grPipeline->dynamicMappingUsed != prevPipeline->dynamicMappingUsed ||
+        memcmp(&grPipeline->dynamicDescriptorSlot, &prevPipeline->dynamicDescriptorSlot,
+               sizeof(PipelineDescriptorSlot)) != 0) {
+        return false;
+    }
+
+    for (unsigned i = 0; i < GR_MAX_DESCRIPTOR_SETS; i++) {
+        if (grPipeline->descriptorSetCounts[i] != prevPipeline->descriptorSetCounts[i] ||
+            (grPipeline->descriptorSetCounts[i] > 0 &&
+             memcmp(grPipeline->descriptorSlots[i], prevPipeline->descriptorSlots[i],
+                    grPipeline->descriptorSetCounts[i] * sizeof(PipelineDescriptorSlot)) != 0)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 // Command Buffer Building Functions
 
 GR_VOID GR_STDCALL grCmdBindPipeline(
@@ -479,15 +781,22 @@ GR_VOID GR_STDCALL grCmdBindPipeline(
         return;
     }
 
+    bool descriptorStateCompatible = isDescriptorStateCompatible(grPipeline, bindPoint->grPipeline);
+
     bindPoint->grPipeline = grPipeline;
 
     if (vkBindPoint == VK_PIPELINE_BIND_POINT_GRAPHICS) {
-        bindPoint->dirtyFlags |= FLAG_DIRTY_DESCRIPTOR_SET | FLAG_DIRTY_DYNAMIC_STRIDE | FLAG_DIRTY_PIPELINE;
+        bindPoint->dirtyFlags |= FLAG_DIRTY_PIPELINE;
+        if (!descriptorStateCompatible) {
+            bindPoint->dirtyFlags |= FLAG_DIRTY_DESCRIPTOR_SET | FLAG_DIRTY_DYNAMIC_STRIDE;
+        }
     } else {
         // Pipeline creation isn't deferred for compute, bind now
         VKD.vkCmdBindPipeline(grCmdBuffer->commandBuffer, vkBindPoint, grPipeline->pipeline);
 
-        bindPoint->dirtyFlags |= FLAG_DIRTY_DESCRIPTOR_SET;
+        if (!descriptorStateCompatible) {
+            bindPoint->dirtyFlags |= FLAG_DIRTY_DESCRIPTOR_SET;
+        }
     }
 }
 
@@ -500,103 +809,176 @@ GR_VOID GR_STDCALL grCmdBindStateObject(
     GrCmdBuffer* grCmdBuffer = (GrCmdBuffer*)cmdBuffer;
     GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
 
-    // TODO compare objects instead of just pointers
+    // Bound objects must outlive the command buffer, so the previous object holds the state
+    // last recorded and only the values that differ have to be set again
 
     switch ((GR_STATE_BIND_POINT)stateBindPoint) {
     case GR_STATE_BIND_VIEWPORT: {
         GrViewportStateObject* viewportState = (GrViewportStateObject*)state;
-        if (viewportState == grCmdBuffer->grViewportState) {
+        const GrViewportStateObject* prevState = grCmdBuffer->grViewportState;
+        if (viewportState == prevState) {
             break;
         }
 
-        VKD.vkCmdSetViewportWithCountEXT(grCmdBuffer->commandBuffer,
-                                         viewportState->viewportCount, viewportState->viewports);
-        VKD.vkCmdSetScissorWithCountEXT(grCmdBuffer->commandBuffer, viewportState->scissorCount,
-                                        viewportState->scissors);
+        if (prevState == NULL || viewportState->viewportCount != prevState->viewportCount ||
+            memcmp(viewportState->viewports, prevState->viewports,
+                   viewportState->viewportCount * sizeof(VkViewport)) != 0) {
+            VKD.vkCmdSetViewportWithCountEXT(grCmdBuffer->commandBuffer,
+                                             viewportState->viewportCount,
+                                             viewportState->viewports);
+        }
+        if (prevState == NULL || viewportState->scissorCount != prevState->scissorCount ||
+            memcmp(viewportState->scissors, prevState->scissors,
+                   viewportState->scissorCount * sizeof(VkRect2D)) != 0) {
+            VKD.vkCmdSetScissorWithCountEXT(grCmdBuffer->commandBuffer,
+                                            viewportState->scissorCount,
+                                            viewportState->scissors);
+        }
 
         grCmdBuffer->grViewportState = viewportState;
     }   break;
     case GR_STATE_BIND_RASTER: {
         GrRasterStateObject* rasterState = (GrRasterStateObject*)state;
-        if (rasterState == grCmdBuffer->grRasterState) {
+        const GrRasterStateObject* prevState = grCmdBuffer->grRasterState;
+        if (rasterState == prevState) {
             break;
         }
 
-        VKD.vkCmdSetPolygonModeEXT(grCmdBuffer->commandBuffer, rasterState->polygonMode);
-        VKD.vkCmdSetCullModeEXT(grCmdBuffer->commandBuffer, rasterState->cullMode);
-        VKD.vkCmdSetFrontFaceEXT(grCmdBuffer->commandBuffer, rasterState->frontFace);
-        VKD.vkCmdSetDepthBias(grCmdBuffer->commandBuffer, rasterState->depthBiasConstantFactor,
-                              rasterState->depthBiasClamp, rasterState->depthBiasSlopeFactor);
+        if (prevState == NULL || rasterState->polygonMode != prevState->polygonMode) {
+            VKD.vkCmdSetPolygonModeEXT(grCmdBuffer->commandBuffer, rasterState->polygonMode);
+        }
+        if (prevState == NULL || rasterState->cullMode != prevState->cullMode) {
+            VKD.vkCmdSetCullModeEXT(grCmdBuffer->commandBuffer, rasterState->cullMode);
+        }
+        if (prevState == NULL || rasterState->frontFace != prevState->frontFace) {
+            VKD.vkCmdSetFrontFaceEXT(grCmdBuffer->commandBuffer, rasterState->frontFace);
+        }
+        if (prevState == NULL ||
+            rasterState->depthBiasConstantFactor != prevState->depthBiasConstantFactor ||
+            rasterState->depthBiasClamp != prevState->depthBiasClamp ||
+            rasterState->depthBiasSlopeFactor != prevState->depthBiasSlopeFactor) {
+            VKD.vkCmdSetDepthBias(grCmdBuffer->commandBuffer, rasterState->depthBiasConstantFactor,
+                                  rasterState->depthBiasClamp, rasterState->depthBiasSlopeFactor);
+        }
 
         grCmdBuffer->grRasterState = rasterState;
     }   break;
     case GR_STATE_BIND_DEPTH_STENCIL: {
         GrDepthStencilStateObject* depthStencilState = (GrDepthStencilStateObject*)state;
-        if (depthStencilState == grCmdBuffer->grDepthStencilState) {
+        const GrDepthStencilStateObject* prevState = grCmdBuffer->grDepthStencilState;
+        if (depthStencilState == prevState) {
             break;
         }
 
-        VKD.vkCmdSetDepthTestEnableEXT(grCmdBuffer->commandBuffer,
-                                       depthStencilState->depthTestEnable);
-        VKD.vkCmdSetDepthWriteEnableEXT(grCmdBuffer->commandBuffer,
-                                        depthStencilState->depthWriteEnable);
-        VKD.vkCmdSetDepthCompareOpEXT(grCmdBuffer->commandBuffer,
-                                      depthStencilState->depthCompareOp);
-        VKD.vkCmdSetDepthBoundsTestEnableEXT(grCmdBuffer->commandBuffer,
-                                             depthStencilState->depthBoundsTestEnable);
-        VKD.vkCmdSetStencilTestEnableEXT(grCmdBuffer->commandBuffer,
-                                         depthStencilState->stencilTestEnable);
-        VKD.vkCmdSetStencilOpEXT(grCmdBuffer->commandBuffer, VK_STENCIL_FACE_FRONT_BIT,
-                                 depthStencilState->front.failOp,
-                                 depthStencilState->front.passOp,
-                                 depthStencilState->front.depthFailOp,
-                                 depthStencilState->front.compareOp);
-        VKD.vkCmdSetStencilCompareMask(grCmdBuffer->commandBuffer, VK_STENCIL_FACE_FRONT_BIT,
-                                       depthStencilState->front.compareMask);
-        VKD.vkCmdSetStencilWriteMask(grCmdBuffer->commandBuffer, VK_STENCIL_FACE_FRONT_BIT,
-                                     depthStencilState->front.writeMask);
-        VKD.vkCmdSetStencilReference(grCmdBuffer->commandBuffer, VK_STENCIL_FACE_FRONT_BIT,
-                                     depthStencilState->front.reference);
-        VKD.vkCmdSetStencilOpEXT(grCmdBuffer->commandBuffer, VK_STENCIL_FACE_BACK_BIT,
-                                 depthStencilState->back.failOp,
-                                 depthStencilState->back.passOp,
-                                 depthStencilState->back.depthFailOp,
-                                 depthStencilState->back.compareOp);
-        VKD.vkCmdSetStencilCompareMask(grCmdBuffer->commandBuffer, VK_STENCIL_FACE_BACK_BIT,
-                                       depthStencilState->back.compareMask);
-        VKD.vkCmdSetStencilWriteMask(grCmdBuffer->commandBuffer, VK_STENCIL_FACE_BACK_BIT,
-                                     depthStencilState->back.writeMask);
-        VKD.vkCmdSetStencilReference(grCmdBuffer->commandBuffer, VK_STENCIL_FACE_BACK_BIT,
-                                     depthStencilState->back.reference);
-        VKD.vkCmdSetDepthBounds(grCmdBuffer->commandBuffer, depthStencilState->minDepthBounds,
-                                                            depthStencilState->maxDepthBounds);
+        if (prevState == NULL || depthStencilState->depthTestEnable != prevState->depthTestEnable) {
+            VKD.vkCmdSetDepthTestEnableEXT(grCmdBuffer->commandBuffer,
+                                           depthStencilState->depthTestEnable);
+        }
+        if (prevState == NULL ||
+            depthStencilState->depthWriteEnable != prevState->depthWriteEnable) {
+            VKD.vkCmdSetDepthWriteEnableEXT(grCmdBuffer->commandBuffer,
+                                            depthStencilState->depthWriteEnable);
+        }
+        if (prevState == NULL || depthStencilState->depthCompareOp != prevState->depthCompareOp) {
+            VKD.vkCmdSetDepthCompareOpEXT(grCmdBuffer->commandBuffer,
+                                          depthStencilState->depthCompareOp);
+        }
+        if (prevState == NULL ||
+            depthStencilState->depthBoundsTestEnable != prevState->depthBoundsTestEnable) {
+            VKD.vkCmdSetDepthBoundsTestEnableEXT(grCmdBuffer->commandBuffer,
+                                                 depthStencilState->depthBoundsTestEnable);
+        }
+        if (prevState == NULL ||
+            depthStencilState->stencilTestEnable != prevState->stencilTestEnable) {
+            VKD.vkCmdSetStencilTestEnableEXT(grCmdBuffer->commandBuffer,
+                                             depthStencilState->stencilTestEnable);
+        }
+
+        for (unsigned i = 0; i < 2; i++) {
+            VkStencilFaceFlags faceMask = i == 0 ? VK_STENCIL_FACE_FRONT_BIT :
+                                                   VK_STENCIL_FACE_BACK_BIT;
+            const VkStencilOpState* stencilOp = i == 0 ? &depthStencilState->front :
+                                                         &depthStencilState->back;
+            const VkStencilOpState* prevStencilOp = prevState == NULL ? NULL :
+                                                    i == 0 ? &prevState->front : &prevState->back;
+
+            if (prevStencilOp == NULL ||
+                stencilOp->failOp != prevStencilOp->failOp ||
+                stencilOp->passOp != prevStencilOp->passOp ||
+                stencilOp->depthFailOp != prevStencilOp->depthFailOp ||
+                stencilOp->compareOp != prevStencilOp->compareOp) {
+                VKD.vkCmdSetStencilOpEXT(grCmdBuffer->commandBuffer, faceMask,
+                                         stencilOp->failOp, stencilOp->passOp,
+                                         stencilOp->depthFailOp, stencilOp->compareOp);
+            }
+            if (prevStencilOp == NULL || stencilOp->compareMask != prevStencilOp->compareMask) {
+                VKD.vkCmdSetStencilCompareMask(grCmdBuffer->commandBuffer, faceMask,
+                                               stencilOp->compareMask);
+            }
+            if (prevStencilOp == NULL || stencilOp->writeMask != prevStencilOp->writeMask) {
+                VKD.vkCmdSetStencilWriteMask(grCmdBuffer->commandBuffer, faceMask,
+                                             stencilOp->writeMask);
+            }
+            if (prevStencilOp == NULL || stencilOp->reference != prevStencilOp->reference) {
+                VKD.vkCmdSetStencilReference(grCmdBuffer->commandBuffer, faceMask,
+                                             stencilOp->reference);
+            }
+        }
+
+        if (prevState == NULL ||
+            depthStencilState->minDepthBounds != prevState->minDepthBounds ||
+            depthStencilState->maxDepthBounds != prevState->maxDepthBounds) {
+            VKD.vkCmdSetDepthBounds(grCmdBuffer->commandBuffer, depthStencilState->minDepthBounds,
+                                                                depthStencilState->maxDepthBounds);
+        }
 
         grCmdBuffer->grDepthStencilState = depthStencilState;
     }   break;
     case GR_STATE_BIND_COLOR_BLEND: {
         GrColorBlendStateObject* colorBlendState = (GrColorBlendStateObject*)state;
-        if (colorBlendState == grCmdBuffer->grColorBlendState) {
+        const GrColorBlendStateObject* prevState = grCmdBuffer->grColorBlendState;
+        if (colorBlendState == prevState) {
             break;
         }
 
-        VKD.vkCmdSetColorBlendEnableEXT(grCmdBuffer->commandBuffer, 0, GR_MAX_COLOR_TARGETS,
-                                        colorBlendState->colorBlendEnables);
-        VKD.vkCmdSetColorBlendEquationEXT(grCmdBuffer->commandBuffer, 0, GR_MAX_COLOR_TARGETS,
-                                          colorBlendState->colorBlendEquations);
-        VKD.vkCmdSetBlendConstants(grCmdBuffer->commandBuffer, colorBlendState->blendConstants);
+        if (prevState == NULL ||
+            memcmp(colorBlendState->colorBlendEnables, prevState->colorBlendEnables,
+                   sizeof(colorBlendState->colorBlendEnables)) != 0) {
+            VKD.vkCmdSetColorBlendEnableEXT(grCmdBuffer->commandBuffer, 0, GR_MAX_COLOR_TARGETS,
+                                            colorBlendState->colorBlendEnables);
+        }
+        if (prevState == NULL ||
+            memcmp(colorBlendState->colorBlendEquations, prevState->colorBlendEquations,
+                   sizeof(colorBlendState->colorBlendEquations)) != 0) {
+            VKD.vkCmdSetColorBlendEquationEXT(grCmdBuffer->commandBuffer, 0, GR_MAX_COLOR_TARGETS,
+                                              colorBlendState->colorBlendEquations);
+        }
+        if (prevState == NULL ||
+            memcmp(colorBlendState->blendConstants, prevState->blendConstants,
+                   sizeof(colorBlendState->blendConstants)) != 0) {
+            VKD.vkCmdSetBlendConstants(grCmdBuffer->commandBuffer,
+                                       colorBlendState->blendConstants);
+        }
 
         grCmdBuffer->grColorBlendState = colorBlendState;
     }   break;
     case GR_STATE_BIND_MSAA: {
         GrMsaaStateObject* msaaState = (GrMsaaStateObject*)state;
-        if (msaaState == grCmdBuffer->grMsaaState) {
+        const GrMsaaStateObject* prevState = grCmdBuffer->grMsaaState;
+        if (msaaState == prevState) {
             break;
         }
 
-        VKD.vkCmdSetRasterizationSamplesEXT(grCmdBuffer->commandBuffer,
-                                            msaaState->sampleCountFlags);
-        VKD.vkCmdSetSampleMaskEXT(grCmdBuffer->commandBuffer,
-                                  msaaState->sampleCountFlags, &msaaState->sampleMask);
+        if (prevState == NULL || msaaState->sampleCountFlags != prevState->sampleCountFlags) {
+            VKD.vkCmdSetRasterizationSamplesEXT(grCmdBuffer->commandBuffer,
+                                                msaaState->sampleCountFlags);
+        }
+        // The sample mask size depends on the sample count
+        if (prevState == NULL || msaaState->sampleCountFlags != prevState->sampleCountFlags ||
+            msaaState->sampleMask != prevState->sampleMask) {
+            VKD.vkCmdSetSampleMaskEXT(grCmdBuffer->commandBuffer,
+                                      msaaState->sampleCountFlags, &msaaState->sampleMask);
+        }
 
         grCmdBuffer->grMsaaState = msaaState;
     }   break;
@@ -680,23 +1062,19 @@ GR_VOID GR_STDCALL grCmdPrepareMemoryRegions(
 {
     LOGT("%p %u %p\n", cmdBuffer, transitionCount, pStateTransitions);
     GrCmdBuffer* grCmdBuffer = (GrCmdBuffer*)cmdBuffer;
-    const GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
-
-    grCmdBufferEndRenderPass(grCmdBuffer);
-
-    STACK_ARRAY(VkBufferMemoryBarrier, barriers, 128, transitionCount);
-    VkPipelineStageFlags srcStageMask = 0;
-    VkPipelineStageFlags dstStageMask = 0;
 
+    // Barriers are recorded by the next command that depends on them
     for (unsigned i = 0; i < transitionCount; i++) {
         const GR_MEMORY_STATE_TRANSITION* stateTransition = &pStateTransitions[i];
         GrGpuMemory* grGpuMemory = (GrGpuMemory*)stateTransition->mem;
 
-        barriers[i] = (VkBufferMemoryBarrier) {
-            .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        const VkBufferMemoryBarrier2 barrier = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
             .pNext = NULL,
-            .srcAccessMask = getVkAccessFlagsMemory(stateTransition->oldState),
-            .dstAccessMask = getVkAccessFlagsMemory(stateTransition->newState),
+            .srcStageMask = getVkPipelineStageFlags2Memory(stateTransition->oldState),
+            .srcAccessMask = getVkAccessFlags2Memory(stateTransition->oldState),
+            .dstStageMask = getVkPipelineStageFlags2Memory(stateTransition->newState),
+            .dstAccessMask = getVkAccessFlags2Memory(stateTransition->newState),
             .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
             .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
             .buffer = grGpuMemory->buffer,
@@ -704,14 +1082,8 @@ GR_VOID GR_STDCALL grCmdPrepareMemoryRegions(
             .size = stateTransition->regionSize > 0 ? stateTransition->regionSize : VK_WHOLE_SIZE,
         };
 
-        srcStageMask |= getVkPipelineStageFlagsMemory(stateTransition->oldState);
-        dstStageMask |= getVkPipelineStageFlagsMemory(stateTransition->newState);
+        grCmdBufferAddBufferBarrier(grCmdBuffer, &barrier);
     }
-
-    VKD.vkCmdPipelineBarrier(grCmdBuffer->commandBuffer, srcStageMask, dstStageMask,
-                             0, 0, NULL, transitionCount, barriers, 0, NULL);
-
-    STACK_ARRAY_FINISH(barriers);
 }
 
 GR_VOID GR_STDCALL grCmdBindTargets(
@@ -825,10 +1197,13 @@ GR_VOID GR_STDCALL grCmdBindTargets(
     }
 
     // Some games bind depth-stencil targets that were not declared in the pipeline (BF4) and that
-    // we can't ignore, so we have to defer pipeline creation. Assume that the target format never
-    // changes for a given pipeline, meaning we don't have to track pipeline dirtiness here.
-    grCmdBuffer->depthFormat = depthFormat;
-    grCmdBuffer->stencilFormat = stencilFormat;
+    // we can't ignore, so the pipeline variant has to be picked again when the formats change
+    if (depthFormat != grCmdBuffer->depthFormat || stencilFormat != grCmdBuffer->stencilFormat) {
+        grCmdBuffer->depthFormat = depthFormat;
+        grCmdBuffer->stencilFormat = stencilFormat;
+
+        bindPoint->dirtyFlags |= FLAG_DIRTY_PIPELINE;
+    }
 }
 
 GR_VOID GR_STDCALL grCmdPrepareImages(
@@ -838,40 +1213,34 @@ GR_VOID GR_STDCALL grCmdPrepareImages(
 {
     LOGT("%p %u %p\n", cmdBuffer, transitionCount, pStateTransitions);
     GrCmdBuffer* grCmdBuffer = (GrCmdBuffer*)cmdBuffer;
-    const GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
-
-    grCmdBufferEndRenderPass(grCmdBuffer);
-
-    STACK_ARRAY(VkImageMemoryBarrier, barriers, 128, transitionCount);
-    VkPipelineStageFlags srcStageMask = 0;
-    VkPipelineStageFlags dstStageMask = 0;
 
+    // Barriers are recorded by the next command that depends on them
     for (unsigned i = 0; i < transitionCount; i++) {
         const GR_IMAGE_STATE_TRANSITION* stateTransition = &pStateTransitions[i];
         GrImage* grImage = (GrImage*)stateTransition->image;
 
-        barriers[i] = (VkImageMemoryBarrier) {
-            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        const VkImageSubresourceRange subresourceRange =
+            getVkImageSubresourceRange(stateTransition->subresourceRange,
+                                       grImage->multiplyCubeLayers);
+        VkImageAspectFlags aspectMask = subresourceRange.aspectMask;
+
+        const VkImageMemoryBarrier2 barrier = {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
             .pNext = NULL,
-            .srcAccessMask = getVkAccessFlagsImage(stateTransition->oldState),
-            .dstAccessMask = getVkAccessFlagsImage(stateTransition->newState),
+            .srcStageMask = getVkPipelineStageFlags2Image(stateTransition->oldState, aspectMask),
+            .srcAccessMask = getVkAccessFlags2Image(stateTransition->oldState, aspectMask),
+            .dstStageMask = getVkPipelineStageFlags2Image(stateTransition->newState, aspectMask),
+            .dstAccessMask = getVkAccessFlags2Image(stateTransition->newState, aspectMask),
             .oldLayout = getVkImageLayout(stateTransition->oldState),
             .newLayout = getVkImageLayout(stateTransition->newState),
             .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
             .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
             .image = grImage->image,
-            .subresourceRange = getVkImageSubresourceRange(stateTransition->subresourceRange,
-                                                           grImage->multiplyCubeLayers),
+            .subresourceRange = subresourceRange,
         };
 
-        srcStageMask |= getVkPipelineStageFlagsImage(stateTransition->oldState);
-        dstStageMask |= getVkPipelineStageFlagsImage(stateTransition->newState);
+        grCmdBufferAddImageBarrier(grCmdBuffer, &barrier);
     }
-
-    VKD.vkCmdPipelineBarrier(grCmdBuffer->commandBuffer, srcStageMask, dstStageMask,
-                             0, 0, NULL, 0, NULL, transitionCount, barriers);
-
-    STACK_ARRAY_FINISH(barriers);
 }
 
 GR_VOID GR_STDCALL grCmdDraw(
@@ -956,6 +1325,7 @@ GR_VOID GR_STDCALL grCmdDispatch(
 
     grCmdBufferUpdateResources(grCmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE);
     grCmdBufferEndRenderPass(grCmdBuffer);
+    grCmdBufferFlushBarriers(grCmdBuffer);
 
     VKD.vkCmdDispatch(grCmdBuffer->commandBuffer, x, y, z);
 }
@@ -972,6 +1342,7 @@ GR_VOID GR_STDCALL grCmdDispatchIndirect(
 
     grCmdBufferUpdateResources(grCmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE);
     grCmdBufferEndRenderPass(grCmdBuffer);
+    grCmdBufferFlushBarriers(grCmdBuffer);
 
     VKD.vkCmdDispatchIndirect(grCmdBuffer->commandBuffer, grGpuMemory->buffer, offset);
 }
@@ -990,6 +1361,7 @@ GR_VOID GR_STDCALL grCmdCopyMemory(
     GrGpuMemory* grDstGpuMemory = (GrGpuMemory*)destMem;
 
     grCmdBufferEndRenderPass(grCmdBuffer);
+    grCmdBufferFlushBarriers(grCmdBuffer);
 
     STACK_ARRAY(VkBufferCopy, vkRegions, 128, regionCount);
 
@@ -1032,6 +1404,7 @@ GR_VOID GR_STDCALL grCmdCopyImage(
     }
 
     grCmdBufferEndRenderPass(grCmdBuffer);
+    grCmdBufferFlushBarriers(grCmdBuffer);
 
     STACK_ARRAY(VkImageCopy, vkRegions, 128, regionCount);
 
@@ -1086,6 +1459,7 @@ GR_VOID GR_STDCALL grCmdCopyMemoryToImage(
     }
 
     grCmdBufferEndRenderPass(grCmdBuffer);
+    grCmdBufferFlushBarriers(grCmdBuffer);
 
     STACK_ARRAY(VkBufferImageCopy, vkRegions, 128, regionCount);
 
@@ -1139,6 +1513,7 @@ GR_VOID GR_STDCALL grCmdCopyImageToMemory(
     }
 
     grCmdBufferEndRenderPass(grCmdBuffer);
+    grCmdBufferFlushBarriers(grCmdBuffer);
 
     STACK_ARRAY(VkBufferImageCopy, vkRegions, 128, regionCount);
 
@@ -1185,6 +1560,7 @@ GR_VOID GR_STDCALL grCmdUpdateMemory(
     GrGpuMemory* grDstGpuMemory = (GrGpuMemory*)destMem;
 
     grCmdBufferEndRenderPass(grCmdBuffer);
+    grCmdBufferFlushBarriers(grCmdBuffer);
 
     VKD.vkCmdUpdateBuffer(grCmdBuffer->commandBuffer, grDstGpuMemory->buffer, destOffset,
                           dataSize, pData);
@@ -1203,6 +1579,7 @@ GR_VOID GR_STDCALL grCmdFillMemory(
     GrGpuMemory* grDstGpuMemory = (GrGpuMemory*)destMem;
 
     grCmdBufferEndRenderPass(grCmdBuffer);
+    grCmdBufferFlushBarriers(grCmdBuffer);
 
     VKD.vkCmdFillBuffer(grCmdBuffer->commandBuffer, grDstGpuMemory->buffer, destOffset,
                         fillSize, data);
@@ -1224,6 +1601,7 @@ GR_VOID GR_STDCALL grCmdResolveImage(
     unsigned dstTileSize = getVkFormatTileSize(grDstImage->format);
 
     grCmdBufferEndRenderPass(grCmdBuffer);
+    grCmdBufferFlushBarriers(grCmdBuffer);
 
     STACK_ARRAY(VkImageResolve, vkResolves, 128, regionCount);
 
@@ -1267,6 +1645,7 @@ GR_VOID GR_STDCALL grCmdClearColorImage(
     GrImage* grImage = (GrImage*)image;
 
     grCmdBufferEndRenderPass(grCmdBuffer);
+    grCmdBufferFlushBarriers(grCmdBuffer);
 
     const VkClearColorValue vkColor = {
         .float32 = { color[0], color[1], color[2], color[3] },
@@ -1299,6 +1678,7 @@ GR_VOID GR_STDCALL grCmdClearColorImageRaw(
     GrImage* grImage = (GrImage*)image;
 
     grCmdBufferEndRenderPass(grCmdBuffer);
+    grCmdBufferFlushBarriers(grCmdBuffer);
 
     GR_IMAGE_STATE imageState = quirkHas(QUIRK_IMAGE_DATA_TRANSFER_STATE_FOR_RAW_CLEAR) ?
                                 GR_IMAGE_STATE_DATA_TRANSFER : GR_IMAGE_STATE_CLEAR;
@@ -1332,6 +1712,7 @@ GR_VOID GR_STDCALL grCmdClearDepthStencil(
     GrImage* grImage = (GrImage*)image;
 
     grCmdBufferEndRenderPass(grCmdBuffer);
+    grCmdBufferFlushBarriers(grCmdBuffer);
 
     const VkClearDepthStencilValue depthStencilValue = {
         .depth = depth,
@@ -1361,6 +1742,7 @@ GR_VOID GR_STDCALL grCmdSetEvent(
     GrEvent* grEvent = (GrEvent*)event;
 
     grCmdBufferEndRenderPass(grCmdBuffer);
+    grCmdBufferFlushBarriers(grCmdBuffer);
 
     VKD.vkCmdSetEvent(grCmdBuffer->commandBuffer, grEvent->event,
                       VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
@@ -1376,6 +1758,7 @@ GR_VOID GR_STDCALL grCmdResetEvent(
     GrEvent* grEvent = (GrEvent*)event;
 
     grCmdBufferEndRenderPass(grCmdBuffer);
+    grCmdBufferFlushBarriers(grCmdBuffer);
 
     VKD.vkCmdResetEvent(grCmdBuffer->commandBuffer, grEvent->event,
                         VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
@@ -1421,6 +1804,7 @@ GR_VOID GR_STDCALL grCmdResetQueryPool(
     const GrQueryPool* grQueryPool = (GrQueryPool*)queryPool;
 
     grCmdBufferEndRenderPass(grCmdBuffer);
+    grCmdBufferFlushBarriers(grCmdBuffer);
 
     VKD.vkCmdResetQueryPool(grCmdBuffer->commandBuffer, grQueryPool->queryPool,
                             startQuery, queryCount);
@@ -1448,17 +1832,61 @@ GR_VOID GR_STDCALL grCmdWriteTimestamp(
     }
 
     grCmdBufferEndRenderPass(grCmdBuffer);
+    grCmdBufferFlushBarriers(grCmdBuffer);
 
-    VKD.vkCmdResetQueryPool(grCmdBuffer->commandBuffer, grCmdBuffer->timestampQueryPool, 0, 1);
+    const TimestampQuery* timestampQuery = &grCmdBuffer->timestampQuery;
+
+    VKD.vkCmdResetQueryPool(grCmdBuffer->commandBuffer, timestampQuery->pool,
+                            timestampQuery->index, 1);
 
     VKD.vkCmdWriteTimestamp(grCmdBuffer->commandBuffer, stageFlags,
-                            grCmdBuffer->timestampQueryPool, 0);
+                            timestampQuery->pool, timestampQuery->index);
 
-    VKD.vkCmdCopyQueryPoolResults(grCmdBuffer->commandBuffer, grCmdBuffer->timestampQueryPool,
-                                  0, 1, grGpuMemory->buffer, destOffset, sizeof(uint64_t),
+    VKD.vkCmdCopyQueryPoolResults(grCmdBuffer->commandBuffer, timestampQuery->pool,
+                                  timestampQuery->index, 1, grGpuMemory->buffer, destOffset, sizeof(uint64_t),
                                   VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
 }
 
+static void grCmdBufferAtomicCounterBarrier(
+    GrCmdBuffer* grCmdBuffer,
+    VkPipelineStageFlags2 srcStageMask,
+    VkAccessFlags2 srcAccessMask,
+    VkPipelineStageFlags2 dstStageMask,
+    VkAccessFlags2 dstAccessMask,
+    VkDeviceSize offset,
+    VkDeviceSize size)
+{
+    const GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
+
+    const VkBufferMemoryBarrier2 barrier = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+        .pNext = NULL,
+        .srcStageMask = srcStageMask,
+        .srcAccessMask = srcAccessMask,
+        .dstStageMask = dstStageMask,
+        .dstAccessMask = dstAccessMask,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .buffer = grCmdBuffer->atomicCounterBuffer,
+        .offset = offset,
+        .size = size,
+    };
+
+    const VkDependencyInfo dependencyInfo = {
+        .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+        .pNext = NULL,
+        .dependencyFlags = 0,
+        .memoryBarrierCount = 0,
+        .pMemoryBarriers = NULL,
+        .bufferMemoryBarrierCount = 1,
+        .pBufferMemoryBarriers = &barrier,
+        .imageMemoryBarrierCount = 0,
+        .pImageMemoryBarriers = NULL,
+    };
+
+    VKD.vkCmdPipelineBarrier2(grCmdBuffer->commandBuffer, &dependencyInfo);
+}
+
 GR_VOID GR_STDCALL grCmdInitAtomicCounters(
     GR_CMD_BUFFER cmdBuffer,
     GR_ENUM pipelineBindPoint,
@@ -1471,54 +1899,32 @@ GR_VOID GR_STDCALL grCmdInitAtomicCounters(
     const GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
 
     grCmdBufferEndRenderPass(grCmdBuffer);
+    grCmdBufferFlushBarriers(grCmdBuffer);
 
     VkDeviceSize offset = startCounter * sizeof(uint32_t);
     VkDeviceSize size = counterCount * sizeof(uint32_t);
 
-    const VkBufferMemoryBarrier preUpdateBarrier = {
-        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
-        .pNext = NULL,
-        .srcAccessMask = 0,
-        .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
-        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-        .buffer = grCmdBuffer->atomicCounterBuffer,
-        .offset = offset,
-        .size = size,
-    };
-
-    VKD.vkCmdPipelineBarrier(grCmdBuffer->commandBuffer,
-                             VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-                             VK_PIPELINE_STAGE_TRANSFER_BIT,
-                             0, 0, NULL, 1, &preUpdateBarrier, 0, NULL);
+    // Wait for prior shader atomics and counter copies before overwriting the counters
+    grCmdBufferAtomicCounterBarrier(grCmdBuffer,
+                                    ATOMIC_COUNTER_SHADER_STAGES | ATOMIC_COUNTER_TRANSFER_STAGES,
+                                    VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT |
+                                    VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                                    VK_PIPELINE_STAGE_2_CLEAR_BIT,
+                                    VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                                    offset, size);
 
     VKD.vkCmdUpdateBuffer(grCmdBuffer->commandBuffer, grCmdBuffer->atomicCounterBuffer,
                           offset, size, pData);
 
-    const VkBufferMemoryBarrier postUpdateBarrier = {
-        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
-        .pNext = NULL,
-        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
-        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT |
-                         VK_ACCESS_SHADER_WRITE_BIT |
-                         VK_ACCESS_TRANSFER_READ_BIT |
-                         VK_ACCESS_TRANSFER_WRITE_BIT,
-        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-        .buffer = grCmdBuffer->atomicCounterBuffer,
-        .offset = offset,
-        .size = size,
-    };
-
-    VKD.vkCmdPipelineBarrier(grCmdBuffer->commandBuffer,
-                             VK_PIPELINE_STAGE_TRANSFER_BIT,
-                             VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
-                             VK_PIPELINE_STAGE_TESSELLATION_CONTROL_SHADER_BIT |
-                             VK_PIPELINE_STAGE_TESSELLATION_EVALUATION_SHADER_BIT |
-                             VK_PIPELINE_STAGE_GEOMETRY_SHADER_BIT |
-                             VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
-                             VK_PIPELINE_STAGE_TRANSFER_BIT,
-                             0, 0, NULL, 1, &postUpdateBarrier, 0, NULL);
+    grCmdBufferAtomicCounterBarrier(grCmdBuffer,
+                                    VK_PIPELINE_STAGE_2_CLEAR_BIT,
+                                    VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                                    ATOMIC_COUNTER_SHADER_STAGES | ATOMIC_COUNTER_TRANSFER_STAGES,
+                                    VK_ACCESS_2_SHADER_STORAGE_READ_BIT |
+                                    VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT |
+                                    VK_ACCESS_2_TRANSFER_READ_BIT |
+                                    VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                                    offset, size);
 }
 
 GR_VOID GR_STDCALL grCmdSaveAtomicCounters(
@@ -1536,6 +1942,7 @@ GR_VOID GR_STDCALL grCmdSaveAtomicCounters(
     GrGpuMemory* grDstGpuMemory = (GrGpuMemory*)destMem;
 
     grCmdBufferEndRenderPass(grCmdBuffer);
+    grCmdBufferFlushBarriers(grCmdBuffer);
 
     const VkBufferCopy bufferCopy = {
         .srcOffset = startCounter * sizeof(uint32_t),
@@ -1543,56 +1950,23 @@ GR_VOID GR_STDCALL grCmdSaveAtomicCounters(
         .size = counterCount * sizeof(uint32_t),
     };
 
-    const VkBufferMemoryBarrier preCopyBarrier = {
-        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
-        .pNext = NULL,
-        .srcAccessMask = VK_ACCESS_SHADER_READ_BIT |
-                         VK_ACCESS_SHADER_WRITE_BIT |
-                         VK_ACCESS_TRANSFER_READ_BIT |
-                         VK_ACCESS_TRANSFER_WRITE_BIT,
-        .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
-        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-        .buffer = grCmdBuffer->atomicCounterBuffer,
-        .offset = bufferCopy.srcOffset,
-        .size = bufferCopy.size,
-    };
-
-    VKD.vkCmdPipelineBarrier(grCmdBuffer->commandBuffer,
-                             VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
-                             VK_PIPELINE_STAGE_TESSELLATION_CONTROL_SHADER_BIT |
-                             VK_PIPELINE_STAGE_TESSELLATION_EVALUATION_SHADER_BIT |
-                             VK_PIPELINE_STAGE_GEOMETRY_SHADER_BIT |
-                             VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
-                             VK_PIPELINE_STAGE_TRANSFER_BIT,
-                             VK_PIPELINE_STAGE_TRANSFER_BIT,
-                             0, 0, NULL, 1, &preCopyBarrier, 0, NULL);
+    // Make shader atomics and counter initialization visible to the copy
+    grCmdBufferAtomicCounterBarrier(grCmdBuffer,
+                                    ATOMIC_COUNTER_SHADER_STAGES | ATOMIC_COUNTER_TRANSFER_STAGES,
+                                    VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT |
+                                    VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                                    VK_PIPELINE_STAGE_2_COPY_BIT,
+                                    VK_ACCESS_2_TRANSFER_READ_BIT,
+                                    bufferCopy.srcOffset, bufferCopy.size);
 
     VKD.vkCmdCopyBuffer(grCmdBuffer->commandBuffer, grCmdBuffer->atomicCounterBuffer,
                         grDstGpuMemory->buffer, 1, &bufferCopy);
 
-    const VkBufferMemoryBarrier postCopyBarrier = {
-        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
-        .pNext = NULL,
-        .srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
-        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT |
-                         VK_ACCESS_SHADER_WRITE_BIT |
-                         VK_ACCESS_TRANSFER_READ_BIT |
-                         VK_ACCESS_TRANSFER_WRITE_BIT,
-        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-        .buffer = grCmdBuffer->atomicCounterBuffer,
-        .offset = bufferCopy.srcOffset,
-        .size = bufferCopy.size,
-    };
-
-    VKD.vkCmdPipelineBarrier(grCmdBuffer->commandBuffer,
-                             VK_PIPELINE_STAGE_TRANSFER_BIT,
-                             VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
-                             VK_PIPELINE_STAGE_TESSELLATION_CONTROL_SHADER_BIT |
-                             VK_PIPELINE_STAGE_TESSELLATION_EVALUATION_SHADER_BIT |
-                             VK_PIPELINE_STAGE_GEOMETRY_SHADER_BIT |
-                             VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
-                             VK_PIPELINE_STAGE_TRANSFER_BIT,
-                             0, 0, NULL, 1, &postCopyBarrier, 0, NULL);
+    // Keep later counter writes from racing the copy (write-after-read, no access needed)
+    grCmdBufferAtomicCounterBarrier(grCmdBuffer,
+                                    VK_PIPELINE_STAGE_2_COPY_BIT,
+                                    VK_ACCESS_2_NONE,
+                                    ATOMIC_COUNTER_SHADER_STAGES | ATOMIC_COUNTER_TRANSFER_STAGES,
+                                    VK_ACCESS_2_NONE,
+                                    bufferCopy.srcOffset, bufferCopy.size);
 }
@@ -21,7 +21,7 @@ GR_RESULT GR_STDCALL grCreateCommandBuffer(
     VkResult vkRes;
     VkCommandPool vkCommandPool = VK_NULL_HANDLE;
     VkCommandBuffer vkCommandBuffer = VK_NULL_HANDLE;
-    VkQueryPool vkQueryPool = VK_NULL_HANDLE;
+    TimestampQuery timestampQuery = { VK_NULL_HANDLE, 0 };
 
     if (grDevice == NULL) {
         return GR_ERROR_INVALID_HANDLE;
@@ -38,45 +38,17 @@ GR_RESULT GR_STDCALL grCreateCommandBuffer(
 
     grGetDeviceQueue(device, pCreateInfo->queueType, 0, (GR_QUEUE*)&grQueue);
 
-    const VkCommandPoolCreateInfo poolCreateInfo = {
-        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
-        .pNext = NULL,
-        .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
-        .queueFamilyIndex = grQueue->queueFamilyIndex,
-    };
-
-    vkRes = VKD.vkCreateCommandPool(grDevice->device, &poolCreateInfo, NULL, &vkCommandPool);
+    vkRes = grCommandPoolCacheAcquire(grQueue, &vkCommandPool, &vkCommandBuffer);
     if (vkRes != VK_SUCCESS) {
-        LOGE("vkCreateCommandPool failed (%d)\n", vkRes);
         return getGrResult(vkRes);
     }
 
-    const VkCommandBufferAllocateInfo allocateInfo = {
-        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-        .pNext = NULL,
-        .commandPool = vkCommandPool,
-        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-        .commandBufferCount = 1,
-    };
-
-    vkRes = VKD.vkAllocateCommandBuffers(grDevice->device, &allocateInfo, &vkCommandBuffer);
+    vkRes = grTimestampQueryAcquire(grDevice, &timestampQuery);
     if (vkRes != VK_SUCCESS) {
-        LOGE("vkAllocateCommandBuffers failed (%d)\n", vkRes);
+        grCommandPoolCacheRelease(grQueue, vkCommandPool, vkCommandBuffer);
         return getGrResult(vkRes);
     }
 
-    // Create a query pool for timestamps
-    const VkQueryPoolCreateInfo queryPoolCreateInfo = {
-        .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
-        .pNext = NULL,
-        .flags = 0,
-        .queryType = VK_QUERY_TYPE_TIMESTAMP,
-        .queryCount = 1,
-        .pipelineStatistics = 0,
-    };
-
-    VKD.vkCreateQueryPool(grDevice->device, &queryPoolCreateInfo, NULL, &vkQueryPool);
-
     VkBuffer atomicCounterBuffer = VK_NULL_HANDLE;
     VkDescriptorSet atomicCounterSet = VK_NULL_HANDLE;
     VkDeviceSize atomicCounterBufferSize = 0ull;
@@ -93,9 +65,10 @@ GR_RESULT GR_STDCALL grCreateCommandBuffer(
     GrCmdBuffer* grCmdBuffer = malloc(sizeof(GrCmdBuffer));
     *grCmdBuffer = (GrCmdBuffer) {
         .grObj = { GR_OBJ_TYPE_COMMAND_BUFFER, grDevice },
+        .grQueue = grQueue,
         .commandPool = vkCommandPool,
         .commandBuffer = vkCommandBuffer,
-        .timestampQueryPool = vkQueryPool,
+        .timestampQuery = timestampQuery,
         .atomicCounterBuffer = atomicCounterBuffer,
         .atomicCounterBufferSize = atomicCounterBufferSize,
         .atomicCounterSet = atomicCounterSet,
@@ -168,6 +141,7 @@ GR_RESULT GR_STDCALL grEndCommandBuffer(
     GrDevice* grDevice = GET_OBJ_DEVICE(grCmdBuffer);
 
     grCmdBufferEndRenderPass(grCmdBuffer);
+    grCmdBufferFlushBarriers(grCmdBuffer);
 
     VkResult res = VKD.vkEndCommandBuffer(grCmdBuffer->commandBuffer);
     if (res != VK_SUCCESS) {
@@ -9,6 +9,20 @@ inline static void releaseSlot(
     }
 }
 
+static void invalidateNestedSlots(
+    GrDescriptorSet* grDescriptorSet,
+    unsigned startSlot,
+    unsigned slotCount)
+{
+    // Resolved descriptor paths going through an overwritten nested slot must be walked again
+    for (unsigned i = 0; i < slotCount; i++) {
+        if (grDescriptorSet->slots[startSlot + i].type == SLOT_TYPE_NESTED) {
+            grDescriptorSet->generation++;
+            break;
+        }
+    }
+}
+
 #define SLOT_INDEX(startSlot, index, type) (((startSlot) + (index)) : (((startSlot) + (index)) * DESCRIPTORS_PER_SLOT + getDescriptorOffset(type)))
 // Descriptor Set Functions
 
@@ -197,6 +211,7 @@ GR_RESULT GR_STDCALL grCreateDescriptorSet(
         .slotCount = pCreateInfo->slots,
         .slots = calloc(pCreateInfo->slots, sizeof(DescriptorSetSlot)),
         .descriptorLock = SRWLOCK_INIT,
+        .generation = 0,
         .descriptorPool = descriptorPool,
         .descriptorSet = descriptorSet,
         .descriptorBufferPtr = descriptorBufferPtr,
@@ -252,6 +267,8 @@ GR_VOID GR_STDCALL grAttachSamplerDescriptors(
         AcquireSRWLockExclusive(&grDescriptorSet->descriptorLock);
     }
 
+    invalidateNestedSlots(grDescriptorSet, startSlot, slotCount);
+
     if (grDevice->descriptorBufferSupported && grDevice->descriptorBufferAllowPreparedSampler) {
         for (unsigned i = 0; i < slotCount; i++) {
             const GrSampler* grSampler = (GrSampler*)pSamplers[i];
@@ -336,6 +353,8 @@ GR_VOID GR_STDCALL grAttachImageViewDescriptors(
         AcquireSRWLockExclusive(&grDescriptorSet->descriptorLock);
     }
 
+    invalidateNestedSlots(grDescriptorSet, startSlot, slotCount);
+
     if (grDevice->descriptorBufferSupported && grDevice->descriptorUseSingleDescriptor && grDevice->descriptorBufferAllowPreparedImageView) {
         for (unsigned i = 0; i < slotCount; i++) {
             const GR_IMAGE_VIEW_ATTACH_INFO* info = &pImageViews[i];
@@ -497,6 +516,8 @@ GR_VOID GR_STDCALL grAttachMemoryViewDescriptors(
         AcquireSRWLockExclusive(&grDescriptorSet->descriptorLock);
     }
 
+    invalidateNestedSlots(grDescriptorSet, startSlot, slotCount);
+
     if (grDevice->descriptorBufferSupported && grDevice->descriptorUseSingleDescriptor) {
         for (unsigned i = 0; i < slotCount; i++) {
             DescriptorSetSlot* slot = &grDescriptorSet->slots[startSlot + i];
@@ -733,6 +754,8 @@ GR_VOID GR_STDCALL grAttachNestedDescriptors(
         AcquireSRWLockExclusive(&grDescriptorSet->descriptorLock);
     }
 
+    grDescriptorSet->generation++;
+
     for (unsigned i = 0; i < slotCount; i++) {
         DescriptorSetSlot* slot = &grDescriptorSet->slots[startSlot + i];
         const GR_DESCRIPTOR_SET_ATTACH_INFO* info = &pNestedDescriptorSets[i];
@@ -765,6 +788,8 @@ GR_VOID GR_STDCALL grClearDescriptorSetSlots(
         AcquireSRWLockExclusive(&grDescriptorSet->descriptorLock);
     }
 
+    grDescriptorSet->generation++;
+
     if (grDevice->descriptorBufferSupported) {
         memset(grDescriptorSet->descriptorBufferPtr + (startSlot * (grDevice->descriptorUseSingleDescriptor ? 1 : DESCRIPTORS_PER_SLOT) * grDevice->maxMutableDescriptorSize), 0, grDevice->maxMutableDescriptorSize * slotCount * (grDevice->descriptorUseSingleDescriptor ? 1 : DESCRIPTORS_PER_SLOT));
         memset(&grDescriptorSet->slots[startSlot], 0, sizeof(DescriptorSetSlot) * slotCount);
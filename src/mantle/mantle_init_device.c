@@ -410,12 +410,15 @@ GR_RESULT GR_STDCALL grInitAndEnumerateGpus(
             .grBaseObj = { GR_OBJ_TYPE_PHYSICAL_GPU },
             .physicalDevice = physicalDevices[i],
             .descriptorBufferProps = { 0 }, // Initialized below
+            .graphicsPipelineLibraryProps = { 0 }, // Initialized below
             .physicalDeviceProps = { 0 }, // Initialized below
         };
 
         grPhysicalGpu->physicalDeviceProps.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
         grPhysicalGpu->physicalDeviceProps.pNext = &grPhysicalGpu->descriptorBufferProps;
         grPhysicalGpu->descriptorBufferProps.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_PROPERTIES_EXT;
+        grPhysicalGpu->descriptorBufferProps.pNext = &grPhysicalGpu->graphicsPipelineLibraryProps;
+        grPhysicalGpu->graphicsPipelineLibraryProps.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_PROPERTIES_EXT;
 
         vki.vkGetPhysicalDeviceProperties2(physicalDevices[i], &grPhysicalGpu->physicalDeviceProps);
 
@@ -764,9 +767,19 @@ GR_RESULT GR_STDCALL grCreateDevice(
         goto bail;
     }
 
+    VkPhysicalDeviceShaderObjectFeaturesEXT queriedShaderObjectFeatures = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_OBJECT_FEATURES_EXT,
+        .pNext = NULL,
+    };
+
+    VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT queriedGraphicsPipelineLibraryFeatures = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT,
+        .pNext = &queriedShaderObjectFeatures,
+    };
+
     VkPhysicalDeviceDescriptorBufferFeaturesEXT queriedDescriptorBufferFeatures = {
         .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_FEATURES_EXT,
-        .pNext = NULL,
+        .pNext = &queriedGraphicsPipelineLibraryFeatures,
     };
 
     VkPhysicalDeviceFeatures2 queriedDeviceFeatures = {
@@ -776,9 +789,19 @@ GR_RESULT GR_STDCALL grCreateDevice(
 
     vki.vkGetPhysicalDeviceFeatures2(grPhysicalGpu->physicalDevice, &queriedDeviceFeatures);
 
+    VkPhysicalDeviceShaderObjectFeaturesEXT shaderObject = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_OBJECT_FEATURES_EXT,
+        .pNext = NULL,
+        .shaderObject = VK_TRUE,
+    };
+    VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT graphicsPipelineLibrary = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT,
+        .pNext = NULL,
+        .graphicsPipelineLibrary = VK_TRUE,
+    };
     VkPhysicalDeviceCustomBorderColorFeaturesEXT customBorderColor = {
         .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_CUSTOM_BORDER_COLOR_FEATURES_EXT,
-        .pNext = NULL,
+        .pNext = NULL, // Optionally chained below
         .customBorderColors = VK_TRUE,
         .customBorderColorWithoutFormat = VK_TRUE,
     };
@@ -884,12 +907,19 @@ GR_RESULT GR_STDCALL grCreateDevice(
         NULL,
         NULL,
         NULL,
+        NULL,
+        NULL,
+        NULL,
     };
 
-    unsigned deviceExtensionCount = COUNT_OF(deviceExtensions) - 3;
+    unsigned deviceExtensionCount = COUNT_OF(deviceExtensions) - 6;
     bool descriptorBufferSupported = false;
     bool mixedMsaaSupported = false;
+    bool coverageModulationUsed = false;
     bool fragmentMaskSupported = false;
+    bool pipelineLibrarySupported = false;
+    bool graphicsPipelineLibrarySupported = false;
+    bool shaderObjectSupported = false;
 
     for (unsigned i = 0; i < supportedExtensionCount; i++) {
         if (!descriptorBufferSupported && strcmp(extensionProperties[i].extensionName, VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME) == 0) {
@@ -897,6 +927,7 @@ GR_RESULT GR_STDCALL grCreateDevice(
             deviceExtensions[deviceExtensionCount++] = VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME;
         } else if (!mixedMsaaSupported && strcmp(extensionProperties[i].extensionName, VK_NV_FRAMEBUFFER_MIXED_SAMPLES_EXTENSION_NAME) == 0) {
             mixedMsaaSupported = true;
+            coverageModulationUsed = true;
             deviceExtensions[deviceExtensionCount++] = VK_NV_FRAMEBUFFER_MIXED_SAMPLES_EXTENSION_NAME;
         } else if (!mixedMsaaSupported && strcmp(extensionProperties[i].extensionName, VK_AMD_MIXED_ATTACHMENT_SAMPLES_EXTENSION_NAME) == 0) {
             mixedMsaaSupported = true;
@@ -904,11 +935,37 @@ GR_RESULT GR_STDCALL grCreateDevice(
         } else if (!fragmentMaskSupported && strcmp(extensionProperties[i].extensionName, VK_AMD_SHADER_FRAGMENT_MASK_EXTENSION_NAME) == 0) {
             fragmentMaskSupported = true;
             deviceExtensions[deviceExtensionCount++] = VK_AMD_SHADER_FRAGMENT_MASK_EXTENSION_NAME;
+        } else if (!pipelineLibrarySupported && strcmp(extensionProperties[i].extensionName, VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME) == 0) {
+            pipelineLibrarySupported = true;
+        } else if (!graphicsPipelineLibrarySupported && strcmp(extensionProperties[i].extensionName, VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME) == 0) {
+            graphicsPipelineLibrarySupported = true;
+        } else if (!shaderObjectSupported && strcmp(extensionProperties[i].extensionName, VK_EXT_SHADER_OBJECT_EXTENSION_NAME) == 0) {
+            shaderObjectSupported = true;
         }
     }
 
     STACK_ARRAY_FINISH(extensionProperties);
 
+    // Shader objects leave no baked state, so coverage modulation for mixed samples would have to
+    // be set dynamically as well; stick to pipelines in that case
+    shaderObjectSupported = shaderObjectSupported && queriedShaderObjectFeatures.shaderObject &&
+        !coverageModulationUsed;
+    if (shaderObjectSupported) {
+        deviceExtensions[deviceExtensionCount++] = VK_EXT_SHADER_OBJECT_EXTENSION_NAME;
+        customBorderColor.pNext = &shaderObject;
+    }
+
+    // Only worth it if linking is fast enough to be done at draw time
+    graphicsPipelineLibrarySupported = !shaderObjectSupported &&
+        pipelineLibrarySupported && graphicsPipelineLibrarySupported &&
+        queriedGraphicsPipelineLibraryFeatures.graphicsPipelineLibrary &&
+        grPhysicalGpu->graphicsPipelineLibraryProps.graphicsPipelineLibraryFastLinking;
+    if (graphicsPipelineLibrarySupported) {
+        deviceExtensions[deviceExtensionCount++] = VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME;
+        deviceExtensions[deviceExtensionCount++] = VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME;
+        customBorderColor.pNext = &graphicsPipelineLibrary;
+    }
+
     const VkDeviceCreateInfo createInfo = {
         .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
         .pNext = &deviceFeatures,
@@ -989,6 +1046,8 @@ GR_RESULT GR_STDCALL grCreateDevice(
         .grBorderColorPalette = NULL,
         .mixedMsaaSupported = mixedMsaaSupported,
         .fragmentMaskSupported = fragmentMaskSupported,
+        .graphicsPipelineLibrarySupported = graphicsPipelineLibrarySupported,
+        .shaderObjectSupported = shaderObjectSupported,
         .descriptorBufferSupported = descriptorBufferSupported,
         .descriptorBufferAllowPreparedImageView = descriptorBufferSupported && grPhysicalGpu->descriptorBufferProps.storageImageDescriptorSize <= MEMBER_SIZEOF(GrImageView, storageDescriptor) && grPhysicalGpu->descriptorBufferProps.sampledImageDescriptorSize <= MEMBER_SIZEOF(GrImageView, sampledDescriptor) && queriedDescriptorBufferFeatures.descriptorBufferImageLayoutIgnored,
         .descriptorBufferAllowPreparedSampler = descriptorBufferSupported && grPhysicalGpu->descriptorBufferProps.samplerDescriptorSize <= MEMBER_SIZEOF(GrSampler, descriptor),
@@ -998,6 +1057,41 @@ GR_RESULT GR_STDCALL grCreateDevice(
         .maxMutableUniformDescriptorSize = 0, // Initialized below
         .maxMutableStorageDescriptorSize = 0, // Initialized below
         .maxMutableDescriptorSize = 0, // Initialized below
+        .compilerPool = threadPoolCreate(0),
+        .pipelineCompileWaitCount = 0,
+        .pipelineCompileMissCount = 0,
+        .pipelineCache = VK_NULL_HANDLE, // Initialized below
+        .pipelineCacheHeader = { 0 }, // Initialized below
+        .pipelineCacheLock = SRWLOCK_INIT,
+        .pipelineCacheFileName = NULL, // Initialized below
+        .pipelineCacheSavedHash = 0, // Initialized below
+        .pipelineCacheSaveTime = 0, // Initialized below
+        .pipelineCacheSaveJob = { 0 },
+        .pipelineLibraryLock = SRWLOCK_INIT,
+        .pipelineLibraryCount = 0,
+        .pipelineLibraries = NULL,
+        .pipelineLayoutLock = SRWLOCK_INIT,
+        .pipelineLayoutCount = 0,
+        .pipelineLayouts = NULL,
+        .shaderModuleLock = SRWLOCK_INIT,
+        .shaderModuleCount = 0,
+        .shaderModuleHitCount = 0,
+        .shaderModuleBuckets = { NULL },
+        .lastShaderId = 0,
+        .pipelineManifestLock = SRWLOCK_INIT,
+        .pipelineManifestFileName = NULL, // Initialized below
+        .pipelineManifestDirty = false,
+        .pipelineManifestEntryCount = 0, // Initialized below
+        .pipelineManifestEntries = NULL, // Initialized below
+        .pipelineStatsLock = SRWLOCK_INIT,
+        .pipelineStatsFileName = NULL, // Initialized below
+        .pipelineStatsCount = 0,
+        .pipelineStats = NULL,
+        .timestampQueryLock = SRWLOCK_INIT,
+        .timestampQueryPoolCount = 0,
+        .timestampQueryPools = NULL,
+        .freeTimestampQueryCount = 0,
+        .freeTimestampQueries = NULL,
     };
 
     if (grDevice->descriptorBufferSupported) {
@@ -1014,6 +1108,7 @@ GR_RESULT GR_STDCALL grCreateDevice(
     }
 
     memcpy(grDevice->memoryHeapMap, memoryHeapMap, memoryHeapCount * sizeof(uint32_t));
+    grPipelineCacheInit(grDevice, &props->properties);
     if (grDevice->descriptorBufferSupported) {
         grDevice->descriptorPushSetLayout = getBufferPushDescriptorSetLayout(grDevice);
     } else {
@@ -1061,6 +1156,9 @@ GR_RESULT GR_STDCALL grCreateDevice(
         grDevice->grDmaQueue = grQueueCreate(grDevice, dmaQueueFamilyIndex, dmaQueueIndex);
     }
 
+    grPipelineStatsInit(grDevice);
+    grPipelineManifestInit(grDevice);
+
     *pDevice = (GR_DEVICE)grDevice;
 
 bail:
@@ -1083,6 +1181,29 @@ GR_RESULT GR_STDCALL grDestroyDevice(
         return GR_ERROR_INVALID_OBJECT_TYPE;
     }
 
+    // Don't let prewarming hold up the teardown
+    grPipelineManifestDestroy(grDevice);
+
+    // Finish in-flight shader and pipeline compilations
+    threadPoolDestroy(grDevice->compilerPool);
+
+    LOGI("draws waited on pipeline compilation %ld times, built %ld depth-stencil variants\n",
+         grDevice->pipelineCompileWaitCount, grDevice->pipelineCompileMissCount);
+    grPipelineStatsDestroy(grDevice);
+    grPipelineCacheDestroy(grDevice);
+    grTimestampQueryDestroy(grDevice);
+
+    for (unsigned i = 0; i < grDevice->pipelineLibraryCount; i++) {
+        VKD.vkDestroyPipeline(grDevice->device, grDevice->pipelineLibraries[i]->library, NULL);
+        free(grDevice->pipelineLibraries[i]);
+    }
+    free(grDevice->pipelineLibraries);
+    for (unsigned i = 0; i < grDevice->pipelineLayoutCount; i++) {
+        VKD.vkDestroyPipelineLayout(grDevice->device, grDevice->pipelineLayouts[i].layout, NULL);
+    }
+    free(grDevice->pipelineLayouts);
+    grShaderModuleCacheDestroy(grDevice);
+
     if (grDevice->descriptorBufferSupported) {
         VKD.vkDestroyDescriptorSetLayout(grDevice->device, grDevice->descriptorPushSetLayout, NULL);
     } else {
@@ -1095,6 +1216,7 @@ GR_RESULT GR_STDCALL grDestroyDevice(
     if (grDevice->grUniversalQueue) {
         free(grDevice->grUniversalQueue->globalMemRefs);
         VKD.vkDestroyCommandPool(grDevice->device, grDevice->grUniversalQueue->commandPool, NULL);
+        grCommandPoolCacheDestroy(grDevice->grUniversalQueue);
 
         VKD.vkDestroyBuffer(grDevice->device, grDevice->universalAtomicCounterBuffer, NULL);
         VKD.vkFreeMemory(grDevice->device, grDevice->universalAtomicCounterMemory, NULL);
@@ -1103,6 +1225,7 @@ GR_RESULT GR_STDCALL grDestroyDevice(
     if (grDevice->grComputeQueue) {
         free(grDevice->grComputeQueue->globalMemRefs);
         VKD.vkDestroyCommandPool(grDevice->device, grDevice->grComputeQueue->commandPool, NULL);
+        grCommandPoolCacheDestroy(grDevice->grComputeQueue);
 
         VKD.vkDestroyBuffer(grDevice->device, grDevice->computeAtomicCounterBuffer, NULL);
         VKD.vkFreeMemory(grDevice->device, grDevice->computeAtomicCounterMemory, NULL);
@@ -1111,12 +1234,13 @@ GR_RESULT GR_STDCALL grDestroyDevice(
     if (grDevice->grDmaQueue) {
         free(grDevice->grDmaQueue->globalMemRefs);
         VKD.vkDestroyCommandPool(grDevice->device, grDevice->grDmaQueue->commandPool, NULL);
+        grCommandPoolCacheDestroy(grDevice->grDmaQueue);
     }
 
     if (!quirkHas(QUIRK_KEEP_VK_DEVICE)) {
         VKD.vkDestroyDevice(grDevice->device, NULL);
+        free(grDevice);
     }
-    free(grDevice);
 
     return GR_SUCCESS;
 }
@@ -3,6 +3,7 @@
 
 #include <assert.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "mantle/mantle.h"
@@ -91,16 +92,18 @@ VkImageType getVkImageType(
 VkImageUsageFlags getVkImageUsageFlags(
     GR_IMAGE_USAGE_FLAGS imageUsageFlags);
 
-VkAccessFlags getVkAccessFlagsImage(
-    GR_IMAGE_STATE imageState);
+VkAccessFlags2 getVkAccessFlags2Image(
+    GR_IMAGE_STATE imageState,
+    VkImageAspectFlags aspectMask);
 
-VkPipelineStageFlags getVkPipelineStageFlagsImage(
-    GR_IMAGE_STATE imageState);
+VkPipelineStageFlags2 getVkPipelineStageFlags2Image(
+    GR_IMAGE_STATE imageState,
+    VkImageAspectFlags aspectMask);
 
-VkAccessFlags getVkAccessFlagsMemory(
+VkAccessFlags2 getVkAccessFlags2Memory(
     GR_MEMORY_STATE memoryState);
 
-VkPipelineStageFlags getVkPipelineStageFlagsMemory(
+VkPipelineStageFlags2 getVkPipelineStageFlags2Memory(
     GR_MEMORY_STATE memoryState);
 
 VkImageAspectFlags getVkImageAspectFlags(
@@ -189,6 +192,118 @@ void grQueueRemoveInitialImage(
 void grWsiDestroyImage(
     GrImage* grImage);
 
+void* grPipelineSerialize(
+    const GrPipeline* grPipeline,
+    uint32_t* size);
+
+// Builds a serialized pipeline into the device cache, returns false if the data is unusable
+bool grPipelinePrewarm(
+    GrDevice* grDevice,
+    const void* data,
+    uint32_t size,
+    unsigned formatCount,
+    const PipelineFormats* formats);
+
+const char* grPipelineCacheGetDirectory();
+
+typedef bool (*PipelineCacheWriteFunc)(FILE* file, void* param);
+
+// Writes through a per-process temporary file that replaces the target on success
+bool grPipelineCacheWriteFile(
+    const char* fileName,
+    PipelineCacheWriteFunc writeFunc,
+    void* param);
+
+void grPipelineCacheInit(
+    GrDevice* grDevice,
+    const VkPhysicalDeviceProperties* props);
+
+void grPipelineCacheUpdate(
+    GrDevice* grDevice);
+
+// Merges driver cache data from a stored pipeline, returns false if it's not usable
+bool grPipelineCacheMerge(
+    GrDevice* grDevice,
+    const void* data,
+    size_t size);
+
+void grPipelineCacheDestroy(
+    GrDevice* grDevice);
+
+VkResult grCommandPoolCacheAcquire(
+    GrQueue* grQueue,
+    VkCommandPool* pCommandPool,
+    VkCommandBuffer* pCommandBuffer);
+
+// The command buffer must not be pending execution
+void grCommandPoolCacheRelease(
+    GrQueue* grQueue,
+    VkCommandPool commandPool,
+    VkCommandBuffer commandBuffer);
+
+void grCommandPoolCacheDestroy(
+    GrQueue* grQueue);
+
+VkResult grTimestampQueryAcquire(
+    GrDevice* grDevice,
+    TimestampQuery* timestampQuery);
+
+void grTimestampQueryRelease(
+    GrDevice* grDevice,
+    const TimestampQuery* timestampQuery);
+
+void grTimestampQueryDestroy(
+    GrDevice* grDevice);
+
+void grPipelineManifestInit(
+    GrDevice* grDevice);
+
+void grPipelineManifestRecord(
+    GrDevice* grDevice,
+    GrPipeline* grPipeline);
+
+void grPipelineManifestRecordVariant(
+    GrDevice* grDevice,
+    const GrPipeline* grPipeline,
+    VkFormat depthFormat,
+    VkFormat stencilFormat);
+
+void grPipelineManifestDestroy(
+    GrDevice* grDevice);
+
+void grPipelineStatsInit(
+    GrDevice* grDevice);
+
+LONGLONG grPipelineStatsGetTime();
+
+// Returns the stats owned by the device, or NULL if the report is disabled
+PipelineStats* grPipelineStatsAdd(
+    GrDevice* grDevice,
+    const PipelineStats* stats,
+    unsigned shaderCount,
+    const GrShader* const* grShaders);
+
+void grPipelineStatsAddFeedback(
+    PipelineStats* stats,
+    const VkPipelineCreationFeedback* feedback);
+
+void grPipelineStatsDestroy(
+    GrDevice* grDevice);
+
+VkResult grShaderModuleCacheAcquire(
+    GrDevice* grDevice,
+    const void* code,
+    unsigned codeSize,
+    void** sharedCode,
+    VkShaderModule* module);
+
+void grShaderModuleCacheRelease(
+    GrDevice* grDevice,
+    void* sharedCode);
+
+void grShaderModuleCacheDestroy(
+    GrDevice* grDevice);
+
 static inline unsigned nextPowerOfTwo(unsigned value) {
     value--;
     value |= value >> 1;
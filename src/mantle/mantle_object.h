@@ -7,15 +7,22 @@
 #include "vulkan_loader.h"
 #include "mantle/mantle.h"
 #include "amdilc.h"
+#include "thread_pool.h"
 
 #define MAX_STAGE_COUNT     5 // VS, HS, DS, GS, PS
 #define MAX_PATH_DEPTH      8 // Levels of nested descriptor sets
 #define MAX_STRIDES         8 // Number of buffer strides per update template slot
+#define SHADER_MODULE_BUCKET_COUNT 1024 // Must be a power of two
+#define DESCRIPTOR_PATH_CACHE_SIZE 64 // Must be a power of two
+#define DESCRIPTOR_MAPPING_BUCKET_COUNT 16 // Must be a power of two
+#define MAX_DESCRIPTOR_MAPPING_COUNT 256 // Per shader, further mappings are resolved every time
 
 #define UNIVERSAL_ATOMIC_COUNTERS_COUNT (512)
 #define COMPUTE_ATOMIC_COUNTERS_COUNT   (1024)
 
 #define IMAGE_PREP_CMD_BUFFER_COUNT     (16)
+#define COMMAND_POOL_CACHE_SIZE         (64)
+#define TIMESTAMP_QUERIES_PER_POOL      (64)
 
 #define GET_OBJ_TYPE(obj) \
     (((GrBaseObject*)(obj))->grObjType)
@@ -72,6 +79,18 @@ typedef struct _GrRasterStateObject GrRasterStateObject;
 typedef struct _GrShader GrShader;
 typedef struct _GrViewportStateObject GrViewportStateObject;
 
+// Query slot handed out by the device-wide timestamp allocator
+typedef struct _TimestampQuery {
+    VkQueryPool pool;
+    uint32_t index;
+} TimestampQuery;
+
+// Command pool owning a single command buffer, recycled on command buffer destruction
+typedef struct _CachedCommandPool {
+    VkCommandPool pool;
+    VkCommandBuffer commandBuffer;
+} CachedCommandPool;
+
 typedef struct _DescriptorSetSlot
 {
     DescriptorSetSlotType type;
@@ -109,7 +128,11 @@ typedef struct _BindPoint
     unsigned boundDescriptorSetCount;
     unsigned slotOffsets[GR_MAX_DESCRIPTOR_SETS];
     DescriptorSetSlot dynamicMemoryView;
-    bool descriptorSetOffsetsPushed;
+    // Shadow of the push constant block, only the changed range gets pushed
+    uint32_t pushConstants[ILC_MAX_STRIDE_CONSTANTS + DESCRIPTOR_OFFSET_COUNT];
+    unsigned pushConstantDirtyBegin;
+    unsigned pushConstantDirtyEnd;
+    bool pushConstantsValid;
 } BindPoint;
 
 typedef struct _PipelineCreateInfo
@@ -154,14 +177,32 @@ typedef struct _GrBorderColorPalette {
     float* data;
 } GrBorderColorPalette;
 
+// Nested descriptor set walk resolved for a pipeline descriptor slot
+typedef struct _DescriptorPathCacheEntry {
+    const GrDescriptorSet* rootSet;
+    unsigned rootSlotOffset;
+    const PipelineDescriptorSlot* descriptorSlot;
+    // Sets read along the path and their generation at the time, root first
+    const GrDescriptorSet* pathSets[MAX_PATH_DEPTH];
+    unsigned pathGenerations[MAX_PATH_DEPTH];
+    const GrDescriptorSet* set;
+    unsigned slotOffset;
+} DescriptorPathCacheEntry;
+
 typedef struct _GrCmdBuffer {
     GrObject grObj;
+    GrQueue* grQueue;
     VkCommandPool commandPool;
     VkCommandBuffer commandBuffer;
-    VkQueryPool timestampQueryPool;
+    TimestampQuery timestampQuery;
     VkBuffer atomicCounterBuffer;
     VkDeviceSize atomicCounterBufferSize;
     VkDescriptorSet atomicCounterSet;
+    // Pending barrier storage, grows as needed and survives resets
+    unsigned bufferBarrierSize;
+    VkBufferMemoryBarrier2* bufferBarriers;
+    unsigned imageBarrierSize;
+    VkImageMemoryBarrier2* imageBarriers;
     // NOTE: grCmdBufferResetState resets everything past that point
     bool isBuilding;
     bool isRendering;
@@ -186,6 +227,10 @@ typedef struct _GrCmdBuffer {
     VkFormat depthFormat;
     VkFormat stencilFormat;
     VkExtent3D minExtent;
+    // State transitions deferred until a command depends on them
+    unsigned bufferBarrierCount;
+    unsigned imageBarrierCount;
+    DescriptorPathCacheEntry descriptorPathCache[DESCRIPTOR_PATH_CACHE_SIZE];
 } GrCmdBuffer;
 
 typedef struct _GrColorBlendStateObject {
@@ -230,6 +275,7 @@ typedef struct _GrDescriptorSet {
     unsigned slotCount;
     DescriptorSetSlot* slots;
     SRWLOCK descriptorLock;
+    unsigned generation; // Bumped when nested slots change
     VkDescriptorPool descriptorPool;
     VkDescriptorSet descriptorSet;
     void* descriptorBufferPtr;
@@ -240,6 +286,90 @@ typedef struct _GrDescriptorSet {
     VkDeviceAddress descriptorBufferAddress;
 } GrDescriptorSet;
 
+typedef struct _PipelineLibraryKey {
+    VkGraphicsPipelineLibraryFlagsEXT type;
+    VkPrimitiveTopology topology;
+    VkFormat colorFormats[GR_MAX_COLOR_TARGETS];
+    VkColorComponentFlags colorWriteMasks[GR_MAX_COLOR_TARGETS];
+    VkFormat depthFormat;
+    VkFormat stencilFormat;
+    VkBool32 alphaToCoverageEnable;
+    VkBool32 logicOpEnable;
+    VkLogicOp logicOp;
+} PipelineLibraryKey;
+
+// Entries are published before compiling, the library is valid once the init once completes
+typedef struct _PipelineLibrary {
+    PipelineLibraryKey key;
+    INIT_ONCE initOnce;
+    VkPipeline library;
+} PipelineLibrary;
+
+typedef struct _PipelineLayoutEntry {
+    unsigned descriptorSetCount;
+    VkPipelineBindPoint bindPoint;
+    VkPipelineLayout layout;
+} PipelineLayoutEntry;
+
+// Patched SPIR-V shared by all pipelines that end up with the same code
+typedef struct _ShaderModuleEntry {
+    struct _ShaderModuleEntry* next;
+    uint32_t hash;
+    unsigned refCount;
+    VkShaderModule module;
+    unsigned codeSize;
+    uint32_t code[];
+} ShaderModuleEntry;
+
+// Descriptor slots and binding patches resolved for a set of shaders and their mappings
+typedef struct _DescriptorMappingEntry {
+    struct _DescriptorMappingEntry* next;
+    uint32_t hash;
+    unsigned keySize;
+    uint32_t* key; // Shader IDs and flattened mapping trees
+    bool dynamicMappingUsed;
+    PipelineDescriptorSlot dynamicDescriptorSlot;
+    unsigned descriptorSetCounts[GR_MAX_DESCRIPTOR_SETS];
+    PipelineDescriptorSlot* descriptorSlots[GR_MAX_DESCRIPTOR_SETS];
+    uint32_t* specData[MAX_STAGE_COUNT];
+    IlcBindingPatchEntry* patchEntries[MAX_STAGE_COUNT];
+} DescriptorMappingEntry;
+
+typedef struct _PipelineFormats {
+    VkFormat depthFormat;
+    VkFormat stencilFormat;
+} PipelineFormats;
+
+typedef struct _PipelineManifestEntry {
+    struct _PipelineManifestEntry* next;
+    GrDevice* grDevice;
+    uint32_t hash;
+    uint32_t size;
+    void* data; // Stored pipeline blob, without driver cache data
+    unsigned formatCount;
+    PipelineFormats* formats; // Depth-stencil variants seen at draw time
+    unsigned pendingFormatCount;
+    PipelineFormats* pendingFormats; // Variants seen while the prewarm job was reading formats
+    bool stale;
+    ThreadPoolJob prewarmJob;
+} PipelineManifestEntry;
+
+// Times are in microseconds
+typedef struct _PipelineStats {
+    struct _PipelineStats* next;
+    char* shaderNames;
+    bool isGraphics;
+    bool isLoaded;
+    LONGLONG ilCompileTime;
+    LONGLONG hullRecompileTime;
+    LONGLONG patchTime;
+    LONGLONG shaderModuleTime;
+    /* updated by whichever thread builds the pipeline */
+    volatile LONGLONG driverCompileTime;
+    volatile LONG driverCompileCount;
+    volatile LONG driverCacheHitCount;
+} PipelineStats;
+
 typedef struct _GrDevice {
     GrBaseObject grBaseObj;
     VULKAN_DEVICE vkd;
@@ -274,6 +404,8 @@ typedef struct _GrDevice {
     GrBorderColorPalette* grBorderColorPalette;
     bool mixedMsaaSupported;
     bool fragmentMaskSupported;
+    bool graphicsPipelineLibrarySupported;
+    bool shaderObjectSupported;
     bool descriptorBufferSupported;
     bool descriptorBufferAllowPreparedImageView;
     bool descriptorBufferAllowPreparedSampler;
@@ -282,6 +414,47 @@ typedef struct _GrDevice {
     uint32_t maxMutableUniformDescriptorSize;
     uint32_t maxMutableStorageDescriptorSize;
     uint32_t maxMutableDescriptorSize;
+    ThreadPool* compilerPool;
+    volatile LONG pipelineCompileWaitCount;
+    volatile LONG pipelineCompileMissCount;
+    VkPipelineCache pipelineCache;
+    VkPipelineCacheHeaderVersionOne pipelineCacheHeader;
+    SRWLOCK pipelineCacheLock;
+    char* pipelineCacheFileName;
+    uint32_t pipelineCacheSavedHash;
+    ULONGLONG pipelineCacheSaveTime;
+    ThreadPoolJob pipelineCacheSaveJob;
+    /* vertex input and fragment output libraries shared by all pipelines */
+    SRWLOCK pipelineLibraryLock;
+    unsigned pipelineLibraryCount;
+    PipelineLibrary** pipelineLibraries;
+    /* pipeline layouts shared by all pipelines */
+    SRWLOCK pipelineLayoutLock;
+    unsigned pipelineLayoutCount;
+    PipelineLayoutEntry* pipelineLayouts;
+    /* patched shader modules shared by all pipelines */
+    SRWLOCK shaderModuleLock;
+    unsigned shaderModuleCount;
+    unsigned shaderModuleHitCount;
+    ShaderModuleEntry* shaderModuleBuckets[SHADER_MODULE_BUCKET_COUNT];
+    volatile LONG lastShaderId;
+    /* pipelines created by the title, prewarmed on the next launch */
+    SRWLOCK pipelineManifestLock;
+    char* pipelineManifestFileName;
+    bool pipelineManifestDirty;
+    unsigned pipelineManifestEntryCount;
+    PipelineManifestEntry* pipelineManifestEntries;
+    /* per-pipeline creation times, reported at device destruction */
+    SRWLOCK pipelineStatsLock;
+    char* pipelineStatsFileName;
+    unsigned pipelineStatsCount;
+    PipelineStats* pipelineStats;
+    /* timestamp queries shared by all command buffers */
+    SRWLOCK timestampQueryLock;
+    unsigned timestampQueryPoolCount;
+    VkQueryPool* timestampQueryPools;
+    unsigned freeTimestampQueryCount;
+    TimestampQuery* freeTimestampQueries;
 } GrDevice;
 
 typedef struct _GrEvent {
@@ -348,9 +521,20 @@ typedef struct _GrPhysicalGpu {
     GrBaseObject grBaseObj;
     VkPhysicalDevice physicalDevice;
     VkPhysicalDeviceDescriptorBufferPropertiesEXT descriptorBufferProps;
+    VkPhysicalDeviceGraphicsPipelineLibraryPropertiesEXT graphicsPipelineLibraryProps;
     VkPhysicalDeviceProperties2 physicalDeviceProps;
 } GrPhysicalGpu;
 
+typedef struct _PipelineVariant {
+    struct _GrPipeline* grPipeline;
+    VkFormat depthFormat;
+    VkFormat stencilFormat;
+    VkPipeline pipeline;
+    ThreadPoolJob optimizeJob;
+    volatile LONG optimizedPipelineReady;
+    VkPipeline optimizedPipeline;
+} PipelineVariant;
+
 typedef struct _GrPipeline {
     GrObject grObj;
     VkShaderModule shaderModules[MAX_STAGE_COUNT];
@@ -358,8 +542,32 @@ typedef struct _GrPipeline {
     unsigned shaderCodeSizes[MAX_STAGE_COUNT];
     VkPipelineCreateFlags createFlags;
     PipelineCreateInfo* createInfo;
+    /* graphics pipelines are built in the background, fields below are valid once it's done */
+    ThreadPoolJob compileJob;
     VkPipeline pipeline;
-    VkPipelineLayout pipelineLayout;
+    VkFormat pipelineDepthFormat;
+    VkFormat pipelineStencilFormat;
+    /* graphics pipeline library path */
+    VkPipeline preRasterizationLibrary;
+    VkPipeline fragmentShaderLibrary;
+    VkPipeline vertexInputLibrary; // Owned by the device
+    /* shader object path, in VS/HS/DS/GS/PS order */
+    VkShaderEXT shaders[MAX_STAGE_COUNT];
+    ThreadPoolJob optimizeJob;
+    volatile LONG optimizedPipelineReady;
+    VkPipeline optimizedPipeline;
+    /* extra pipelines built for undeclared depth-stencil formats */
+    SRWLOCK variantLock;
+    unsigned variantCount;
+    PipelineVariant** variants;
+    /* driver cache data captured by the first grStorePipeline call */
+    SRWLOCK storedCacheDataLock;
+    bool storedCacheDataBuilt;
+    void* storedCacheData;
+    size_t storedCacheDataSize;
+    VkPipelineLayout pipelineLayout; // Owned by the device
+    PipelineManifestEntry* manifestEntry; // Owned by the device
+    PipelineStats* stats; // Owned by the device
     unsigned stageCount;
     bool dynamicMappingUsed;
     PipelineDescriptorSlot dynamicDescriptorSlot;
@@ -395,6 +603,11 @@ typedef struct _GrSampler {
 
 typedef struct _GrShader {
     GrObject grObj;
+    /* IL translation, fields below are only valid once it's done */
+    ThreadPoolJob compileJob;
+    void* ilCode;
+    unsigned ilCodeSize;
+    IlcOptions ilcOptions;
     unsigned bindingCount;
     IlcBinding* bindings;
     unsigned inputCount;
@@ -404,6 +617,12 @@ typedef struct _GrShader {
     char* name;
     unsigned codeSize;
     void* code;
+    LONGLONG compileTime; // In microseconds
+    /* descriptor mappings of pipelines using this shader first, IDs never get reused */
+    uint32_t id;
+    SRWLOCK descriptorMappingLock;
+    unsigned descriptorMappingCount;
+    DescriptorMappingEntry* descriptorMappingBuckets[DESCRIPTOR_MAPPING_BUCKET_COUNT];
 } GrShader;
 
 typedef struct _GrQueryPool {
@@ -423,6 +642,10 @@ typedef struct _GrQueue {
     VkCommandPool commandPool;
     VkCommandBuffer commandBuffers[IMAGE_PREP_CMD_BUFFER_COUNT];
     unsigned commandBufferIndex;
+    // Command pools of destroyed command buffers, ready for reuse
+    SRWLOCK commandPoolCacheLock;
+    unsigned commandPoolCacheCount;
+    CachedCommandPool commandPoolCache[COMMAND_POOL_CACHE_SIZE];
 } GrQueue;
 
 typedef struct _GrViewportStateObject {
@@ -438,43 +661,25 @@ typedef struct _GrWsiWinDisplay {
     HMONITOR hMonitor;
 } GrWsiWinDisplay;
 
-typedef enum _GrStoredPipelineChunkType {
-    SPIRV = 1,
-    PIPELINE_INFO = 2,
-    DESCRIPTOR_SLOTS = 3,
-    GRAPHICS_PIPELINE_INFO = 4,
-    SPEC_INFO = 5,
-    SPEC_INFO_ENTRIES = 6,
-} GrStoredPipelineChunkType;
-
-typedef struct _GrBaseBlobChunk {
-    GrStoredPipelineChunkType type;
-    unsigned size;
-    uint8_t data[];
-} GrBaseBlobChunk;
-
-typedef struct _GrSpirvBlobChunk {
-    uint32_t stageIndex;
-    VkShaderStageFlags stageFlags;
-    uint32_t codeSize;
-    uint32_t code[];
-} GrSpirvBlobChunk;
+#define GR_STORED_PIPELINE_MAGIC 0x4B565247 // "GRVK"
+#define GR_STORED_PIPELINE_VERSION 1
+#define GR_STORED_PIPELINE_ALIGNMENT 16
 
-typedef struct _GrSpecInfoDataBlobChunk {
-    uint32_t stageIndex;
-    uint32_t dataSize;
-    uint8_t data[];
-} GrSpecInfoDataBlobChunk;
+// Byte range relative to the start of the blob, empty ranges have a zero offset
+typedef struct _GrStoredPipelineRange {
+    uint32_t offset;
+    uint32_t size;
+} GrStoredPipelineRange;
 
-typedef struct _GrSpecInfoMapEntryBlobChunk {
-    uint32_t stageIndex;
+typedef struct _GrStoredPipelineStage {
+    VkShaderStageFlags stageFlags;
     uint32_t mapEntryCount;
-    VkSpecializationMapEntry data[];
-} GrSpecInfoMapEntryBlobChunk;
-
+    GrStoredPipelineRange code;
+    GrStoredPipelineRange specData;
+    GrStoredPipelineRange mapEntries;
+} GrStoredPipelineStage;
 
-typedef struct _GrGraphicsPipelineInfoChunk
-{
+typedef struct _GrStoredGraphicsPipelineInfo {
     VkPrimitiveTopology topology;
     uint32_t patchControlPoints;
     bool depthClipEnable;
@@ -485,43 +690,55 @@ typedef struct _GrGraphicsPipelineInfoChunk
     VkColorComponentFlags colorWriteMasks[GR_MAX_COLOR_TARGETS];
     VkFormat depthFormat;
     VkFormat stencilFormat;
-} GrGraphicsPipelineInfoChunk;
+} GrStoredGraphicsPipelineInfo;
 
-typedef struct _GrPipelineInfoChunk
-{
+// Fixed-size header followed by aligned sections, the blob holds no pointers so it can be
+// used in place from a file mapping
+typedef struct _GrStoredPipelineBlob {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;
+    uint32_t checksum; // Covers everything past this field
+    uint32_t driverId;
     // create flags without descriptor buffer flag enabled
     VkPipelineCreateFlags createFlags;
-    unsigned stageCount;
+    uint32_t stageCount;
+    bool isGraphics;
     bool dynamicMappingUsed;
     PipelineDescriptorSlot dynamicDescriptorSlot;
-} GrPipelineInfoChunk;
-
-typedef struct _GrPipelineDescriptorChunk
-{
-    unsigned descriptorSetCounts[GR_MAX_DESCRIPTOR_SETS];
-    PipelineDescriptorSlot data[];
-} GrPipelineDescriptorChunk;
-
-/* TODO: add CRC or something to check data integrity */
-typedef struct _GrStoredPipelineBlob {
-    unsigned version;// TODO: handle build ids and checksums
-    unsigned deviceId;
-    unsigned driverId;
-    unsigned checksum;
-    uint8_t data[];
+    GrStoredGraphicsPipelineInfo graphicsInfo;
+    uint32_t descriptorSetCounts[GR_MAX_DESCRIPTOR_SETS];
+    GrStoredPipelineRange descriptorSlots;
+    GrStoredPipelineRange pipelineCacheData;
+    GrStoredPipelineStage stages[MAX_STAGE_COUNT];
 } GrStoredPipelineBlob;
 
 void grCmdBufferEndRenderPass(
     GrCmdBuffer* grCmdBuffer);
 
+void grCmdBufferFlushBarriers(
+    GrCmdBuffer* grCmdBuffer);
+
 void grCmdBufferResetState(
     GrCmdBuffer* grCmdBuffer);
 
+void grPipelineWaitCompilation(
+    GrPipeline* grPipeline);
+
+void grPipelineCancelOptimization(
+    GrPipeline* grPipeline);
+
 VkPipeline grPipelineGetVkPipeline(
-    const GrPipeline* grPipeline,
+    GrPipeline* grPipeline,
     VkFormat depthFormat,
     VkFormat stencilFormat);
 
+const VkShaderEXT* grPipelineGetVkShaders(
+    GrPipeline* grPipeline);
+
+void grShaderWaitCompilation(
+    GrShader* grShader);
+
 GrQueue* grQueueCreate(
     GrDevice* grDevice,
     uint32_t queueFamilyIndex,
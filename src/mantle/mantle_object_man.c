@@ -18,8 +18,11 @@ GR_RESULT GR_STDCALL grDestroyObject(
     case GR_OBJ_TYPE_COMMAND_BUFFER: {
         GrCmdBuffer* grCmdBuffer = (GrCmdBuffer*)grObject;
 
-        VKD.vkDestroyCommandPool(grDevice->device, grCmdBuffer->commandPool, NULL);
-        VKD.vkDestroyQueryPool(grDevice->device, grCmdBuffer->timestampQueryPool, NULL);
+        grCommandPoolCacheRelease(grCmdBuffer->grQueue, grCmdBuffer->commandPool,
+                                  grCmdBuffer->commandBuffer);
+        grTimestampQueryRelease(GET_OBJ_DEVICE(grCmdBuffer), &grCmdBuffer->timestampQuery);
+        free(grCmdBuffer->bufferBarriers);
+        free(grCmdBuffer->imageBarriers);
     }   break;
     case GR_OBJ_TYPE_COLOR_BLEND_STATE_OBJECT:
         // Nothing to do
@@ -78,20 +81,29 @@ GR_RESULT GR_STDCALL grDestroyObject(
     case GR_OBJ_TYPE_PIPELINE: {
         GrPipeline* grPipeline = (GrPipeline*)grObject;
 
+        grPipelineWaitCompilation(grPipeline);
+        grPipelineCancelOptimization(grPipeline);
         for (unsigned i = 0; i < MAX_STAGE_COUNT; i++) {
-            free(grPipeline->specData[i]);
-            free(grPipeline->mapEntries[i]);
-            free(grPipeline->shaderCode[i]);
-            VKD.vkDestroyShaderModule(grDevice->device, grPipeline->shaderModules[i], NULL);
+            grShaderModuleCacheRelease(GET_OBJ_DEVICE(grPipeline), grPipeline->shaderCode[i]);
         }
 
-        free(grPipeline->createInfo);
+        // Create info, spec data and descriptor slots are allocated along with the pipeline
         VKD.vkDestroyPipeline(grDevice->device, grPipeline->pipeline, NULL);
-        VKD.vkDestroyPipelineLayout(grDevice->device, grPipeline->pipelineLayout, NULL);
-
-        for (unsigned i = 0; i < GR_MAX_DESCRIPTOR_SETS; i++) {
-            free(grPipeline->descriptorSlots[i]);
+        VKD.vkDestroyPipeline(grDevice->device, grPipeline->optimizedPipeline, NULL);
+        VKD.vkDestroyPipeline(grDevice->device, grPipeline->preRasterizationLibrary, NULL);
+        VKD.vkDestroyPipeline(grDevice->device, grPipeline->fragmentShaderLibrary, NULL);
+        if (grDevice->shaderObjectSupported) {
+            for (unsigned i = 0; i < MAX_STAGE_COUNT; i++) {
+                VKD.vkDestroyShaderEXT(grDevice->device, grPipeline->shaders[i], NULL);
+            }
         }
+        for (unsigned i = 0; i < grPipeline->variantCount; i++) {
+            VKD.vkDestroyPipeline(grDevice->device, grPipeline->variants[i]->pipeline, NULL);
+            VKD.vkDestroyPipeline(grDevice->device, grPipeline->variants[i]->optimizedPipeline, NULL);
+            free(grPipeline->variants[i]);
+        }
+        free(grPipeline->variants);
+        free(grPipeline->storedCacheData);
     }   break;
     case GR_OBJ_TYPE_QUEUE_SEMAPHORE: {
         GrQueueSemaphore* grQueueSemaphore = (GrQueueSemaphore*)grObject;
@@ -109,11 +121,22 @@ GR_RESULT GR_STDCALL grDestroyObject(
     case GR_OBJ_TYPE_SHADER: {
         GrShader* grShader = (GrShader*)grObject;
 
+        grShaderWaitCompilation(grShader);
         free(grShader->bindings);
         free(grShader->inputs);
         free(grShader->outputLocations);
         free(grShader->name);
         free(grShader->code);
+
+        for (unsigned i = 0; i < DESCRIPTOR_MAPPING_BUCKET_COUNT; i++) {
+            DescriptorMappingEntry* entry = grShader->descriptorMappingBuckets[i];
+            while (entry != NULL) {
+                DescriptorMappingEntry* next = entry->next;
+
+                free(entry);
+                entry = next;
+            }
+        }
     }   break;
     case GR_OBJ_TYPE_QUERY_POOL: {
         GrQueryPool* grQueryPool = (GrQueryPool*)grObject;
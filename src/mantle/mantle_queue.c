@@ -23,14 +23,18 @@ static void prepareImagesForDataTransfer(
         .pInheritanceInfo = NULL,
     };
 
-    STACK_ARRAY(VkImageMemoryBarrier, barriers, 1024, imageCount);
+    STACK_ARRAY(VkImageMemoryBarrier2, barriers, 1024, imageCount);
 
     for (unsigned i = 0; i < imageCount; i++) {
-        barriers[i] = (VkImageMemoryBarrier) {
-            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        barriers[i] = (VkImageMemoryBarrier2) {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
             .pNext = NULL,
-            .srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT,
-            .dstAccessMask = getVkAccessFlagsImage(GR_IMAGE_STATE_DATA_TRANSFER),
+            .srcStageMask = VK_PIPELINE_STAGE_2_HOST_BIT,
+            .srcAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT,
+            .dstStageMask = getVkPipelineStageFlags2Image(GR_IMAGE_STATE_DATA_TRANSFER,
+                                                          VK_IMAGE_ASPECT_COLOR_BIT),
+            .dstAccessMask = getVkAccessFlags2Image(GR_IMAGE_STATE_DATA_TRANSFER,
+                                                    VK_IMAGE_ASPECT_COLOR_BIT),
             .oldLayout = VK_IMAGE_LAYOUT_PREINITIALIZED,
             .newLayout = getVkImageLayout(GR_IMAGE_STATE_DATA_TRANSFER),
             .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
@@ -46,11 +50,20 @@ static void prepareImagesForDataTransfer(
         };
     }
 
+    const VkDependencyInfo dependencyInfo = {
+        .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+        .pNext = NULL,
+        .dependencyFlags = 0,
+        .memoryBarrierCount = 0,
+        .pMemoryBarriers = NULL,
+        .bufferMemoryBarrierCount = 0,
+        .pBufferMemoryBarriers = NULL,
+        .imageMemoryBarrierCount = imageCount,
+        .pImageMemoryBarriers = barriers,
+    };
+
     VKD.vkBeginCommandBuffer(vkCommandBuffer, &beginInfo);
-    VKD.vkCmdPipelineBarrier(vkCommandBuffer,
-                             VK_PIPELINE_STAGE_HOST_BIT,
-                             getVkPipelineStageFlagsImage(GR_IMAGE_STATE_DATA_TRANSFER),
-                             0, 0, NULL, 0, NULL, imageCount, barriers);
+    VKD.vkCmdPipelineBarrier2(vkCommandBuffer, &dependencyInfo);
     VKD.vkEndCommandBuffer(vkCommandBuffer);
 
     STACK_ARRAY_FINISH(barriers);
@@ -166,6 +179,9 @@ GrQueue* grQueueCreate(
         .commandPool = vkCommandPool,
         .commandBuffers = { 0 }, // Initialized below
         .commandBufferIndex = 0,
+        .commandPoolCacheLock = SRWLOCK_INIT,
+        .commandPoolCacheCount = 0,
+        .commandPoolCache = { { 0 } },
     };
     memcpy(grQueue->commandBuffers, commandBuffers, sizeof(grQueue->commandBuffers));
 
@@ -1,6 +1,9 @@
 #include "mantle_internal.h"
 #include "amdilc.h"
 #include "crc32.h"
+#include "scratch_arena.h"
+
+#define PIPELINE_DATA_ALIGNMENT (16)
 
 typedef struct _Stage {
     const GR_PIPELINE_SHADER* shader;
@@ -112,8 +115,9 @@ static void getDescriptorSlotsFromMapping(
         }
 
         (*pDescriptorSlotCount)++;
-        *pDescriptorSlots = realloc(*pDescriptorSlots,
-                                       *pDescriptorSlotCount * sizeof(PipelineDescriptorSlot));
+        *pDescriptorSlots = scratchRealloc(*pDescriptorSlots,
+                                           (*pDescriptorSlotCount - 1) * sizeof(PipelineDescriptorSlot),
+                                           *pDescriptorSlotCount * sizeof(PipelineDescriptorSlot));
         (*pDescriptorSlots)[*pDescriptorSlotCount - 1] = (PipelineDescriptorSlot) {
             .pathDepth = pathDepth,
             .path = { 0 }, // Initialized below
@@ -194,8 +198,6 @@ static void mergeDescriptorSlots(
         memmove(mergedSlot + 1, nextSlot,
                 (*descriptorSlotCount - i - 1) * sizeof(PipelineDescriptorSlot));
         *descriptorSlotCount -= mergingDescriptorCount - 1;
-        *descriptorSlots = realloc(*descriptorSlots,
-                                   *descriptorSlotCount * sizeof(PipelineDescriptorSlot));
 
         // Update state
         i = mergedIdx;
@@ -323,35 +325,334 @@ static void getDescriptorSlotMappings(
     }
 }
 
-static VkPipelineLayout getVkPipelineLayout(
-    const GrDevice* grDevice,
-    unsigned descriptorSetCount,
-    VkPipelineBindPoint vkBindPoint)
+typedef struct _DescriptorMappingKey {
+    unsigned size;
+    unsigned capacity;
+    uint32_t* data;
+} DescriptorMappingKey;
+
+static void pushDescriptorMappingKey(
+    DescriptorMappingKey* key,
+    uint32_t value)
 {
-    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+    if (key->size == key->capacity) {
+        unsigned capacity = MAX(2 * key->capacity, 64);
+
+        key->data = scratchRealloc(key->data, key->capacity * sizeof(uint32_t),
+                                   capacity * sizeof(uint32_t));
+        key->capacity = capacity;
+    }
+
+    key->data[key->size] = value;
+    key->size++;
+}
+
+static void flattenDescriptorSetMapping(
+    DescriptorMappingKey* key,
+    const GR_DESCRIPTOR_SET_MAPPING* mapping,
+    unsigned pathDepth)
+{
+    pushDescriptorMappingKey(key, mapping->descriptorCount);
+
+    for (unsigned i = 0; i < mapping->descriptorCount; i++) {
+        const GR_DESCRIPTOR_SLOT_INFO* slotInfo = &mapping->pDescriptorInfo[i];
+
+        pushDescriptorMappingKey(key, slotInfo->slotObjectType);
+
+        if (slotInfo->slotObjectType == GR_SLOT_NEXT_DESCRIPTOR_SET) {
+            // Deeper trees are rejected by the slot walk
+            if (pathDepth < MAX_PATH_DEPTH) {
+                flattenDescriptorSetMapping(key, slotInfo->pNextLevelSet, pathDepth + 1);
+            }
+        } else if (slotInfo->slotObjectType != GR_SLOT_UNUSED) {
+            pushDescriptorMappingKey(key, slotInfo->shaderEntityIndex);
+        }
+    }
+}
+
+// The key is allocated from the scratch arena
+static DescriptorMappingKey getDescriptorMappingKey(
+    unsigned stageCount,
+    const Stage* stages)
+{
+    DescriptorMappingKey key = { 0, 0, NULL };
+
+    for (unsigned i = 0; i < stageCount; i++) {
+        const GR_PIPELINE_SHADER* shader = stages[i].shader;
+        const GrShader* grShader = (GrShader*)shader->shader;
+
+        pushDescriptorMappingKey(&key, grShader != NULL ? grShader->id : 0);
+        if (grShader == NULL) {
+            continue;
+        }
 
-    VkDescriptorSetLayout setLayouts[32] = {
-        grDevice->descriptorBufferSupported ? grDevice->defaultDescriptorSetLayout : grDevice->dynamicMemorySetLayout,
-        grDevice->descriptorBufferSupported ? grDevice->descriptorPushSetLayout : grDevice->atomicCounterSetLayout,
+        for (unsigned j = 0; j < GR_MAX_DESCRIPTOR_SETS; j++) {
+            flattenDescriptorSetMapping(&key, &shader->descriptorSetMapping[j], 0);
+        }
+        pushDescriptorMappingKey(&key, shader->dynamicMemoryViewMapping.slotObjectType);
+        pushDescriptorMappingKey(&key, shader->dynamicMemoryViewMapping.shaderEntityIndex);
+    }
+
+    return key;
+}
+
+static DescriptorMappingEntry** getDescriptorMappingBucket(
+    GrShader* grShader,
+    uint32_t hash)
+{
+    return &grShader->descriptorMappingBuckets[hash & (DESCRIPTOR_MAPPING_BUCKET_COUNT - 1)];
+}
+
+// Must be called with the descriptor mapping lock held
+static const DescriptorMappingEntry* findDescriptorMapping(
+    GrShader* grShader,
+    uint32_t hash,
+    const DescriptorMappingKey* key)
+{
+    for (const DescriptorMappingEntry* entry = *getDescriptorMappingBucket(grShader, hash);
+         entry != NULL; entry = entry->next) {
+        if (entry->hash == hash && entry->keySize == key->size &&
+            memcmp(entry->key, key->data, key->size * sizeof(uint32_t)) == 0) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+static DescriptorMappingEntry* createDescriptorMapping(
+    uint32_t hash,
+    const DescriptorMappingKey* key,
+    unsigned stageCount,
+    const Stage* stages,
+    bool dynamicMappingUsed,
+    const PipelineDescriptorSlot* dynamicDescriptorSlot,
+    const unsigned* descriptorSetCounts,
+    PipelineDescriptorSlot* const* descriptorSlots,
+    IlcBindingPatchEntry* const* patchEntries,
+    uint32_t* const* specData)
+{
+    size_t size = sizeof(DescriptorMappingEntry) + key->size * sizeof(uint32_t);
+
+    for (unsigned i = 0; i < GR_MAX_DESCRIPTOR_SETS; i++) {
+        size += descriptorSetCounts[i] * sizeof(PipelineDescriptorSlot);
+    }
+    for (unsigned i = 0; i < stageCount; i++) {
+        const GrShader* grShader = (GrShader*)stages[i].shader->shader;
+        unsigned bindingCount = grShader != NULL ? grShader->bindingCount : 0;
+
+        size += bindingCount * (sizeof(IlcBindingPatchEntry) + 2 * sizeof(uint32_t));
+    }
+
+    // Everything is 4-byte aligned, pack it after the entry
+    DescriptorMappingEntry* entry = malloc(size);
+    uint8_t* cursor = (uint8_t*)&entry[1];
+
+    *entry = (DescriptorMappingEntry) {
+        .next = NULL,
+        .hash = hash,
+        .keySize = key->size,
+        .key = (uint32_t*)cursor,
+        .dynamicMappingUsed = dynamicMappingUsed,
+        .dynamicDescriptorSlot = *dynamicDescriptorSlot,
+        .descriptorSetCounts = { 0 }, // Initialized below
+        .descriptorSlots = { NULL }, // Initialized below
+        .specData = { NULL }, // Initialized below
+        .patchEntries = { NULL }, // Initialized below
     };
 
-    assert((descriptorSetCount + 2) <= COUNT_OF(setLayouts));
+    memcpy(entry->key, key->data, key->size * sizeof(uint32_t));
+    cursor += key->size * sizeof(uint32_t);
+
+    for (unsigned i = 0; i < GR_MAX_DESCRIPTOR_SETS; i++) {
+        entry->descriptorSetCounts[i] = descriptorSetCounts[i];
+        if (descriptorSetCounts[i] > 0) {
+            entry->descriptorSlots[i] = (PipelineDescriptorSlot*)cursor;
+            memcpy(entry->descriptorSlots[i], descriptorSlots[i],
+                   descriptorSetCounts[i] * sizeof(PipelineDescriptorSlot));
+            cursor += descriptorSetCounts[i] * sizeof(PipelineDescriptorSlot);
+        }
+    }
+
+    for (unsigned i = 0; i < stageCount; i++) {
+        const GrShader* grShader = (GrShader*)stages[i].shader->shader;
+
+        if (grShader == NULL || grShader->bindingCount == 0) {
+            continue;
+        }
+
+        entry->patchEntries[i] = (IlcBindingPatchEntry*)cursor;
+        memcpy(entry->patchEntries[i], patchEntries[i],
+               grShader->bindingCount * sizeof(IlcBindingPatchEntry));
+        cursor += grShader->bindingCount * sizeof(IlcBindingPatchEntry);
+
+        entry->specData[i] = (uint32_t*)cursor;
+        memcpy(entry->specData[i], specData[i], 2 * grShader->bindingCount * sizeof(uint32_t));
+        cursor += 2 * grShader->bindingCount * sizeof(uint32_t);
+    }
+
+    return entry;
+}
+
+// Fills in the binding patches and the offset and set index spec constants of each stage. Titles
+// reuse the same shaders and mappings across many pipelines, the result is remembered by the
+// first shader so that the slot walk and sort only happen once.
+static bool resolveDescriptorMappings(
+    PipelineDescriptorSlot* dynamicDescriptorSlot,
+    unsigned* descriptorSetCounts,
+    PipelineDescriptorSlot** descriptorSlots,
+    const GrDevice* grDevice,
+    unsigned stageCount,
+    const Stage* stages,
+    IlcBindingPatchEntry** patchEntries,
+    uint32_t** specData)
+{
+    GrShader* cacheShader = NULL;
+    uint32_t* descriptorSetIndices[MAX_STAGE_COUNT] = { NULL };
+    bool dynamicMappingUsed = false;
+
+    for (unsigned i = 0; i < stageCount; i++) {
+        if (stages[i].shader->shader != GR_NULL_HANDLE) {
+            cacheShader = (GrShader*)stages[i].shader->shader;
+            break;
+        }
+    }
+
+    if (cacheShader == NULL) {
+        return false;
+    }
+
+    const DescriptorMappingKey key = getDescriptorMappingKey(stageCount, stages);
+    uint32_t hash = crc32_fast(key.data, key.size * sizeof(uint32_t), 0);
+
+    AcquireSRWLockShared(&cacheShader->descriptorMappingLock);
+    const DescriptorMappingEntry* entry = findDescriptorMapping(cacheShader, hash, &key);
+    ReleaseSRWLockShared(&cacheShader->descriptorMappingLock);
+
+    if (entry != NULL) {
+        for (unsigned i = 0; i < stageCount; i++) {
+            const GrShader* grShader = (GrShader*)stages[i].shader->shader;
+
+            if (grShader == NULL || grShader->bindingCount == 0) {
+                continue;
+            }
+
+            memcpy(patchEntries[i], entry->patchEntries[i],
+                   grShader->bindingCount * sizeof(IlcBindingPatchEntry));
+            memcpy(specData[i], entry->specData[i], 2 * grShader->bindingCount * sizeof(uint32_t));
+        }
+
+        // Slots are copied by the pipeline, they can point into the entry
+        memcpy(descriptorSetCounts, entry->descriptorSetCounts,
+               GR_MAX_DESCRIPTOR_SETS * sizeof(unsigned));
+        memcpy(descriptorSlots, entry->descriptorSlots,
+               GR_MAX_DESCRIPTOR_SETS * sizeof(PipelineDescriptorSlot*));
+        *dynamicDescriptorSlot = entry->dynamicDescriptorSlot;
+        return entry->dynamicMappingUsed;
+    }
+
+    for (unsigned i = 0; i < stageCount; i++) {
+        const GrShader* grShader = (GrShader*)stages[i].shader->shader;
+
+        if (grShader == NULL || grShader->bindingCount == 0) {
+            continue;
+        }
+
+        // Bindings left out of the mappings must not leak stale data into the entry
+        memset(patchEntries[i], 0, grShader->bindingCount * sizeof(IlcBindingPatchEntry));
+        memset(specData[i], 0, 2 * grShader->bindingCount * sizeof(uint32_t));
+        descriptorSetIndices[i] = &specData[i][grShader->bindingCount];
+
+        dynamicMappingUsed |= handleDynamicDescriptorSlots(
+            dynamicDescriptorSlot,
+            &stages[i].shader->dynamicMemoryViewMapping,
+            grDevice->descriptorBufferSupported,
+            grShader->bindingCount, grShader->bindings,
+            specData[i],
+            descriptorSetIndices[i],
+            patchEntries[i]);
+    }
+
+    unsigned descriptorSetCount = 0;
+    for (unsigned i = 0; i < GR_MAX_DESCRIPTOR_SETS; i++) {
+        getDescriptorSlotMappings(&descriptorSetCounts[i], &descriptorSlots[i],
+                                  grDevice, stageCount, stages, patchEntries, specData, descriptorSetIndices, i,
+                                  descriptorSetCount + (grDevice->descriptorBufferSupported ? DESCRIPTOR_BUFFERS_BASE_DESCRIPTOR_SET_ID : DESCRIPTOR_SET_ID));
+        descriptorSetCount += descriptorSetCounts[i];
+    }
+
+    AcquireSRWLockExclusive(&cacheShader->descriptorMappingLock);
+
+    // Another thread may have resolved the same mappings in the meantime. Entries are never
+    // evicted since results point into them, past the cap the mappings are just not remembered.
+    if (cacheShader->descriptorMappingCount < MAX_DESCRIPTOR_MAPPING_COUNT &&
+        findDescriptorMapping(cacheShader, hash, &key) == NULL) {
+        DescriptorMappingEntry** bucket = getDescriptorMappingBucket(cacheShader, hash);
+        DescriptorMappingEntry* newEntry =
+            createDescriptorMapping(hash, &key, stageCount, stages, dynamicMappingUsed,
+                                    dynamicDescriptorSlot, descriptorSetCounts, descriptorSlots,
+                                    patchEntries, specData);
+
+        newEntry->next = *bucket;
+        *bucket = newEntry;
+
+        cacheShader->descriptorMappingCount++;
+        if (cacheShader->descriptorMappingCount == MAX_DESCRIPTOR_MAPPING_COUNT) {
+            LOGV("descriptor mapping cache of shader %u is full\n", cacheShader->id);
+        }
+    }
+
+    ReleaseSRWLockExclusive(&cacheShader->descriptorMappingLock);
+
+    return dynamicMappingUsed;
+}
+
+// setLayouts must have room for descriptorSetCount + 2 entries
+static unsigned getDescriptorSetLayouts(
+    const GrDevice* grDevice,
+    unsigned descriptorSetCount,
+    VkDescriptorSetLayout* setLayouts)
+{
+    setLayouts[0] = grDevice->descriptorBufferSupported ? grDevice->defaultDescriptorSetLayout : grDevice->dynamicMemorySetLayout;
+    setLayouts[1] = grDevice->descriptorBufferSupported ? grDevice->descriptorPushSetLayout : grDevice->atomicCounterSetLayout;
+
     for (unsigned i = 0; i < descriptorSetCount; ++i) {
         setLayouts[i + 2] = grDevice->defaultDescriptorSetLayout;
     }
+
+    return descriptorSetCount + 2;
+}
+
+static VkPushConstantRange getPushConstantRange(
+    VkPipelineBindPoint vkBindPoint)
+{
+    return (VkPushConstantRange) {
+        .stageFlags = (vkBindPoint == VK_PIPELINE_BIND_POINT_GRAPHICS) ? VK_SHADER_STAGE_ALL_GRAPHICS : VK_SHADER_STAGE_COMPUTE_BIT,
+        .offset = 0,
+        .size = DESCRIPTOR_OFFSET_COUNT * sizeof(uint32_t) + ILC_MAX_STRIDE_CONSTANTS * sizeof(uint32_t),
+    };
+}
+
+static VkPipelineLayout createVkPipelineLayout(
+    const GrDevice* grDevice,
+    unsigned descriptorSetCount,
+    VkPipelineBindPoint vkBindPoint)
+{
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+    VkDescriptorSetLayout setLayouts[32];
+
+    assert((descriptorSetCount + 2) <= COUNT_OF(setLayouts));
+    unsigned setLayoutCount = getDescriptorSetLayouts(grDevice, descriptorSetCount, setLayouts);
+
     const VkPushConstantRange pushConstantRanges[] = {
-        {
-            .stageFlags = (vkBindPoint == VK_PIPELINE_BIND_POINT_GRAPHICS) ? VK_SHADER_STAGE_ALL_GRAPHICS : VK_SHADER_STAGE_COMPUTE_BIT,
-            .offset = 0,
-            .size = DESCRIPTOR_OFFSET_COUNT * sizeof(uint32_t) + ILC_MAX_STRIDE_CONSTANTS * sizeof(uint32_t),
-        }
+        getPushConstantRange(vkBindPoint),
     };
 
     const VkPipelineLayoutCreateInfo createInfo = {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
         .pNext = NULL,
         .flags = 0,
-        .setLayoutCount = descriptorSetCount + 2,
+        .setLayoutCount = setLayoutCount,
         .pSetLayouts = setLayouts,
         .pushConstantRangeCount = COUNT_OF(pushConstantRanges),
         .pPushConstantRanges = pushConstantRanges,
@@ -365,19 +666,196 @@ static VkPipelineLayout getVkPipelineLayout(
     return pipelineLayout;
 }
 
-// Exported Functions
+// Must be called with the pipeline layout lock held
+static VkPipelineLayout findVkPipelineLayout(
+    const GrDevice* grDevice,
+    unsigned descriptorSetCount,
+    VkPipelineBindPoint vkBindPoint)
+{
+    for (unsigned i = 0; i < grDevice->pipelineLayoutCount; i++) {
+        const PipelineLayoutEntry* entry = &grDevice->pipelineLayouts[i];
 
-VkPipeline grPipelineGetVkPipeline(
-    const GrPipeline* grPipeline,
+        if (entry->descriptorSetCount == descriptorSetCount && entry->bindPoint == vkBindPoint) {
+            return entry->layout;
+        }
+    }
+
+    return VK_NULL_HANDLE;
+}
+
+// Layouts only depend on the set count and the push constant range, they're owned by the device
+// and shared so that descriptors stay bound when switching between pipelines
+static VkPipelineLayout getVkPipelineLayout(
+    GrDevice* grDevice,
+    unsigned descriptorSetCount,
+    VkPipelineBindPoint vkBindPoint)
+{
+    VkPipelineLayout pipelineLayout;
+
+    AcquireSRWLockShared(&grDevice->pipelineLayoutLock);
+    pipelineLayout = findVkPipelineLayout(grDevice, descriptorSetCount, vkBindPoint);
+    ReleaseSRWLockShared(&grDevice->pipelineLayoutLock);
+
+    if (pipelineLayout != VK_NULL_HANDLE) {
+        return pipelineLayout;
+    }
+
+    AcquireSRWLockExclusive(&grDevice->pipelineLayoutLock);
+
+    pipelineLayout = findVkPipelineLayout(grDevice, descriptorSetCount, vkBindPoint);
+    if (pipelineLayout == VK_NULL_HANDLE) {
+        pipelineLayout = createVkPipelineLayout(grDevice, descriptorSetCount, vkBindPoint);
+
+        if (pipelineLayout != VK_NULL_HANDLE) {
+            grDevice->pipelineLayoutCount++;
+            grDevice->pipelineLayouts = realloc(grDevice->pipelineLayouts,
+                                                grDevice->pipelineLayoutCount *
+                                                sizeof(PipelineLayoutEntry));
+            grDevice->pipelineLayouts[grDevice->pipelineLayoutCount - 1] = (PipelineLayoutEntry) {
+                .descriptorSetCount = descriptorSetCount,
+                .bindPoint = vkBindPoint,
+                .layout = pipelineLayout,
+            };
+        }
+    }
+
+    ReleaseSRWLockExclusive(&grDevice->pipelineLayoutLock);
+
+    return pipelineLayout;
+}
+
+static size_t getPipelineDataSize(
+    const PipelineCreateInfo* createInfo,
+    const VkSpecializationInfo* specInfos,
+    const unsigned* descriptorSetCounts)
+{
+    size_t size = ALIGN(sizeof(GrPipeline), PIPELINE_DATA_ALIGNMENT);
+
+    if (createInfo != NULL) {
+        size += ALIGN(sizeof(PipelineCreateInfo), PIPELINE_DATA_ALIGNMENT);
+    }
+    for (unsigned i = 0; i < MAX_STAGE_COUNT; i++) {
+        size += ALIGN(specInfos[i].dataSize, PIPELINE_DATA_ALIGNMENT);
+        size += ALIGN(specInfos[i].mapEntryCount * sizeof(VkSpecializationMapEntry),
+                      PIPELINE_DATA_ALIGNMENT);
+    }
+    for (unsigned i = 0; i < GR_MAX_DESCRIPTOR_SETS; i++) {
+        size += ALIGN(descriptorSetCounts[i] * sizeof(PipelineDescriptorSlot),
+                      PIPELINE_DATA_ALIGNMENT);
+    }
+
+    return size;
+}
+
+static void* copyPipelineData(
+    uint8_t** cursor,
+    const void* data,
+    size_t size)
+{
+    if (size == 0) {
+        return NULL;
+    }
+
+    void* ptr = *cursor;
+    memcpy(ptr, data, size);
+    *cursor += ALIGN(size, PIPELINE_DATA_ALIGNMENT);
+    return ptr;
+}
+
+// Everything the pipeline keeps around is packed right after it, so it goes away with a single
+// free. The sources may be transient, descriptor set counts must be filled in already.
+static void initPipelineData(
+    GrPipeline* grPipeline,
+    const PipelineCreateInfo* createInfo,
+    const VkSpecializationInfo* specInfos,
+    PipelineDescriptorSlot* const* descriptorSlots)
+{
+    uint8_t* cursor = (uint8_t*)grPipeline + ALIGN(sizeof(GrPipeline), PIPELINE_DATA_ALIGNMENT);
+
+    if (createInfo != NULL) {
+        grPipeline->createInfo = copyPipelineData(&cursor, createInfo, sizeof(PipelineCreateInfo));
+    }
+
+    for (unsigned i = 0; i < MAX_STAGE_COUNT; i++) {
+        const VkSpecializationInfo* specInfo = &specInfos[i];
+
+        grPipeline->specData[i] = copyPipelineData(&cursor, specInfo->pData, specInfo->dataSize);
+        grPipeline->mapEntries[i] = copyPipelineData(&cursor, specInfo->pMapEntries,
+                                                     specInfo->mapEntryCount *
+                                                     sizeof(VkSpecializationMapEntry));
+        grPipeline->specInfos[i] = (VkSpecializationInfo) {
+            .mapEntryCount = specInfo->mapEntryCount,
+            .pMapEntries = grPipeline->mapEntries[i],
+            .dataSize = specInfo->dataSize,
+            .pData = grPipeline->specData[i],
+        };
+
+        if (grPipeline->createInfo != NULL) {
+            grPipeline->createInfo->stageCreateInfos[i].pSpecializationInfo = &grPipeline->specInfos[i];
+        }
+    }
+
+    for (unsigned i = 0; i < GR_MAX_DESCRIPTOR_SETS; i++) {
+        grPipeline->descriptorSlots[i] = copyPipelineData(&cursor, descriptorSlots[i],
+                                                          grPipeline->descriptorSetCounts[i] *
+                                                          sizeof(PipelineDescriptorSlot));
+    }
+}
+
+static const VkDynamicState mDynamicStates[] = {
+    VK_DYNAMIC_STATE_DEPTH_BIAS,
+    VK_DYNAMIC_STATE_BLEND_CONSTANTS,
+    VK_DYNAMIC_STATE_DEPTH_BOUNDS,
+    VK_DYNAMIC_STATE_STENCIL_COMPARE_MASK,
+    VK_DYNAMIC_STATE_STENCIL_WRITE_MASK,
+    VK_DYNAMIC_STATE_STENCIL_REFERENCE,
+    VK_DYNAMIC_STATE_CULL_MODE_EXT,
+    VK_DYNAMIC_STATE_FRONT_FACE_EXT,
+    VK_DYNAMIC_STATE_VIEWPORT_WITH_COUNT_EXT,
+    VK_DYNAMIC_STATE_SCISSOR_WITH_COUNT_EXT,
+    VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE_EXT,
+    VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE_EXT,
+    VK_DYNAMIC_STATE_DEPTH_COMPARE_OP_EXT,
+    VK_DYNAMIC_STATE_DEPTH_BOUNDS_TEST_ENABLE_EXT,
+    VK_DYNAMIC_STATE_STENCIL_TEST_ENABLE_EXT,
+    VK_DYNAMIC_STATE_STENCIL_OP_EXT,
+    VK_DYNAMIC_STATE_POLYGON_MODE_EXT,
+    VK_DYNAMIC_STATE_RASTERIZATION_SAMPLES_EXT,
+    VK_DYNAMIC_STATE_SAMPLE_MASK_EXT,
+    VK_DYNAMIC_STATE_COLOR_BLEND_ENABLE_EXT,
+    VK_DYNAMIC_STATE_COLOR_BLEND_EQUATION_EXT,
+};
+
+// Fixed-function state shared by monolithic pipelines and pipeline libraries
+typedef struct _GraphicsPipelineState {
+    VkPipelineVertexInputStateCreateInfo vertexInput;
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly;
+    VkPipelineTessellationStateCreateInfo tessellation;
+    VkPipelineViewportStateCreateInfo viewport;
+    VkPipelineRasterizationDepthClipStateCreateInfoEXT depthClip;
+    VkPipelineRasterizationStateCreateInfo rasterization;
+    VkPipelineMultisampleStateCreateInfo multisample;
+    VkPipelineDepthStencilStateCreateInfo depthStencil;
+    VkPipelineColorBlendAttachmentState attachments[GR_MAX_COLOR_TARGETS];
+    VkPipelineColorBlendStateCreateInfo colorBlend;
+    VkPipelineDynamicStateCreateInfo dynamic;
+    VkPipelineRenderingCreateInfo rendering;
+} GraphicsPipelineState;
+
+static void initGraphicsPipelineState(
+    GraphicsPipelineState* state,
+    VkPrimitiveTopology topology,
+    uint32_t patchControlPoints,
+    bool depthClipEnable,
+    bool alphaToCoverageEnable,
+    bool logicOpEnable,
+    VkLogicOp logicOp,
+    const VkFormat* colorFormats,
+    const VkColorComponentFlags* colorWriteMasks,
     VkFormat depthFormat,
     VkFormat stencilFormat)
 {
-    GrDevice* grDevice = GET_OBJ_DEVICE(grPipeline);
-    const PipelineCreateInfo* createInfo = grPipeline->createInfo;
-    VkPipeline vkPipeline = VK_NULL_HANDLE;
-    VkResult vkRes;
-
-    const VkPipelineVertexInputStateCreateInfo vertexInputStateCreateInfo = {
+    state->vertexInput = (VkPipelineVertexInputStateCreateInfo) {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
         .pNext = NULL,
         .flags = 0,
@@ -387,23 +865,23 @@ VkPipeline grPipelineGetVkPipeline(
         .pVertexAttributeDescriptions = NULL,
     };
 
-    const VkPipelineInputAssemblyStateCreateInfo inputAssemblyStateCreateInfo = {
+    state->inputAssembly = (VkPipelineInputAssemblyStateCreateInfo) {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
         .pNext = NULL,
         .flags = 0,
-        .topology = createInfo->topology,
+        .topology = topology,
         .primitiveRestartEnable = VK_FALSE,
     };
 
     // Ignored if no tessellation shaders are present
-    const VkPipelineTessellationStateCreateInfo tessellationStateCreateInfo =  {
+    state->tessellation = (VkPipelineTessellationStateCreateInfo) {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_TESSELLATION_STATE_CREATE_INFO,
         .pNext = NULL,
         .flags = 0,
-        .patchControlPoints = createInfo->patchControlPoints,
+        .patchControlPoints = patchControlPoints,
     };
 
-    const VkPipelineViewportStateCreateInfo viewportStateCreateInfo = {
+    state->viewport = (VkPipelineViewportStateCreateInfo) {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
         .pNext = NULL,
         .flags = 0,
@@ -413,16 +891,16 @@ VkPipeline grPipelineGetVkPipeline(
         .pScissors = NULL, // Dynamic state
     };
 
-    const VkPipelineRasterizationDepthClipStateCreateInfoEXT depthClipStateCreateInfo = {
+    state->depthClip = (VkPipelineRasterizationDepthClipStateCreateInfoEXT) {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_DEPTH_CLIP_STATE_CREATE_INFO_EXT,
         .pNext = NULL,
         .flags = 0,
-        .depthClipEnable = createInfo->depthClipEnable,
+        .depthClipEnable = depthClipEnable,
     };
 
-    const VkPipelineRasterizationStateCreateInfo rasterizationStateCreateInfo = {
+    state->rasterization = (VkPipelineRasterizationStateCreateInfo) {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
-        .pNext = &depthClipStateCreateInfo,
+        .pNext = &state->depthClip,
         .flags = 0,
         .depthClampEnable = VK_TRUE,
         .rasterizerDiscardEnable = VK_FALSE,
@@ -436,7 +914,7 @@ VkPipeline grPipelineGetVkPipeline(
         .lineWidth = 1.f,
     };
 
-    const VkPipelineMultisampleStateCreateInfo msaaStateCreateInfo = {
+    state->multisample = (VkPipelineMultisampleStateCreateInfo) {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
         .pNext = NULL,
         .flags = 0,
@@ -444,11 +922,11 @@ VkPipeline grPipelineGetVkPipeline(
         .sampleShadingEnable = VK_FALSE,
         .minSampleShading = 0.f,
         .pSampleMask = NULL, // Dynamic state
-        .alphaToCoverageEnable = createInfo->alphaToCoverageEnable,
+        .alphaToCoverageEnable = alphaToCoverageEnable,
         .alphaToOneEnable = VK_FALSE,
     };
 
-    const VkPipelineDepthStencilStateCreateInfo depthStencilStateCreateInfo = {
+    state->depthStencil = (VkPipelineDepthStencilStateCreateInfo) {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
         .pNext = NULL,
         .flags = 0,
@@ -463,10 +941,8 @@ VkPipeline grPipelineGetVkPipeline(
         .maxDepthBounds = 0.f, // Dynamic state
     };
 
-    VkPipelineColorBlendAttachmentState attachments[GR_MAX_COLOR_TARGETS];
-
     for (unsigned i = 0; i < GR_MAX_COLOR_TARGETS; i++) {
-        attachments[i] = (VkPipelineColorBlendAttachmentState) {
+        state->attachments[i] = (VkPipelineColorBlendAttachmentState) {
             .blendEnable = false, // Dynamic state
             .srcColorBlendFactor = 0, // Dynamic state
             .dstColorBlendFactor = 0, // Dynamic state
@@ -474,98 +950,1307 @@ VkPipeline grPipelineGetVkPipeline(
             .srcAlphaBlendFactor = 0, // Dynamic state
             .dstAlphaBlendFactor = 0, // Dynamic state
             .alphaBlendOp = 0, // Dynamic state
-            .colorWriteMask = createInfo->colorWriteMasks[i],
+            .colorWriteMask = colorWriteMasks[i],
         };
     }
 
-    const VkPipelineColorBlendStateCreateInfo colorBlendStateCreateInfo = {
+    state->colorBlend = (VkPipelineColorBlendStateCreateInfo) {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
         .pNext = NULL,
         .flags = 0,
-        .logicOpEnable = createInfo->logicOpEnable,
-        .logicOp = createInfo->logicOp,
+        .logicOpEnable = logicOpEnable,
+        .logicOp = logicOp,
         .attachmentCount = GR_MAX_COLOR_TARGETS,
-        .pAttachments = attachments,
+        .pAttachments = state->attachments,
         .blendConstants = { 0.f }, // Dynamic state
     };
 
-    const VkDynamicState dynamicStates[] = {
-        VK_DYNAMIC_STATE_DEPTH_BIAS,
-        VK_DYNAMIC_STATE_BLEND_CONSTANTS,
-        VK_DYNAMIC_STATE_DEPTH_BOUNDS,
-        VK_DYNAMIC_STATE_STENCIL_COMPARE_MASK,
-        VK_DYNAMIC_STATE_STENCIL_WRITE_MASK,
-        VK_DYNAMIC_STATE_STENCIL_REFERENCE,
-        VK_DYNAMIC_STATE_CULL_MODE_EXT,
-        VK_DYNAMIC_STATE_FRONT_FACE_EXT,
-        VK_DYNAMIC_STATE_VIEWPORT_WITH_COUNT_EXT,
-        VK_DYNAMIC_STATE_SCISSOR_WITH_COUNT_EXT,
-        VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE_EXT,
-        VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE_EXT,
-        VK_DYNAMIC_STATE_DEPTH_COMPARE_OP_EXT,
-        VK_DYNAMIC_STATE_DEPTH_BOUNDS_TEST_ENABLE_EXT,
-        VK_DYNAMIC_STATE_STENCIL_TEST_ENABLE_EXT,
-        VK_DYNAMIC_STATE_STENCIL_OP_EXT,
-        VK_DYNAMIC_STATE_POLYGON_MODE_EXT,
-        VK_DYNAMIC_STATE_RASTERIZATION_SAMPLES_EXT,
-        VK_DYNAMIC_STATE_SAMPLE_MASK_EXT,
-        VK_DYNAMIC_STATE_COLOR_BLEND_ENABLE_EXT,
-        VK_DYNAMIC_STATE_COLOR_BLEND_EQUATION_EXT,
-    };
+    state->dynamic = (VkPipelineDynamicStateCreateInfo) {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .dynamicStateCount = COUNT_OF(mDynamicStates),
+        .pDynamicStates = mDynamicStates,
+    };
+
+    state->rendering = (VkPipelineRenderingCreateInfo) {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
+        .pNext = NULL,
+        .viewMask = 0,
+        .colorAttachmentCount = GR_MAX_COLOR_TARGETS,
+        .pColorAttachmentFormats = colorFormats,
+        .depthAttachmentFormat = depthFormat,
+        .stencilAttachmentFormat = stencilFormat,
+    };
+}
+
+static VkPipeline createVkGraphicsPipeline(
+    const GrPipeline* grPipeline,
+    VkPipelineCache pipelineCache,
+    VkFormat depthFormat,
+    VkFormat stencilFormat,
+    PipelineStats* stats)
+{
+    GrDevice* grDevice = GET_OBJ_DEVICE(grPipeline);
+    const PipelineCreateInfo* createInfo = grPipeline->createInfo;
+    VkPipeline vkPipeline = VK_NULL_HANDLE;
+    GraphicsPipelineState state;
+    VkResult vkRes;
+
+    initGraphicsPipelineState(&state, createInfo->topology, createInfo->patchControlPoints,
+                              createInfo->depthClipEnable, createInfo->alphaToCoverageEnable,
+                              createInfo->logicOpEnable, createInfo->logicOp,
+                              createInfo->colorFormats, createInfo->colorWriteMasks,
+                              depthFormat, stencilFormat);
+
+    VkPipelineCreationFeedback feedback = { 0 };
+
+    const VkPipelineCreationFeedbackCreateInfo feedbackCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO,
+        .pNext = &state.rendering,
+        .pPipelineCreationFeedback = &feedback,
+        .pipelineStageCreationFeedbackCount = 0,
+        .pPipelineStageCreationFeedbacks = NULL,
+    };
+
+    const VkGraphicsPipelineCreateInfo pipelineCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+        .pNext = &feedbackCreateInfo,
+        .flags = grPipeline->createFlags,
+        .stageCount = grPipeline->stageCount,
+        .pStages = createInfo->stageCreateInfos,
+        .pVertexInputState = &state.vertexInput,
+        .pInputAssemblyState = &state.inputAssembly,
+        .pTessellationState = &state.tessellation,
+        .pViewportState = &state.viewport,
+        .pRasterizationState = &state.rasterization,
+        .pMultisampleState = &state.multisample,
+        .pDepthStencilState = &state.depthStencil,
+        .pColorBlendState = &state.colorBlend,
+        .pDynamicState = &state.dynamic,
+        .layout = grPipeline->pipelineLayout,
+        .renderPass = VK_NULL_HANDLE,
+        .subpass = 0,
+        .basePipelineHandle = VK_NULL_HANDLE,
+        .basePipelineIndex = 0,
+    };
+
+    AcquireSRWLockShared(&grDevice->pipelineCacheLock);
+    vkRes = VKD.vkCreateGraphicsPipelines(grDevice->device, pipelineCache, 1,
+                                          &pipelineCreateInfo, NULL, &vkPipeline);
+    ReleaseSRWLockShared(&grDevice->pipelineCacheLock);
+    if (vkRes != VK_SUCCESS) {
+        LOGE("vkCreateGraphicsPipelines failed (%d)\n", vkRes);
+    }
+
+    grPipelineStatsAddFeedback(stats, &feedback);
+    return vkPipeline;
+}
+
+static VkPipeline createVkPipelineLibrary(
+    GrDevice* grDevice,
+    VkGraphicsPipelineLibraryFlagsEXT type,
+    VkPipelineCreateFlags createFlags,
+    const GraphicsPipelineState* state,
+    unsigned stageCount,
+    const VkPipelineShaderStageCreateInfo* stages,
+    VkPipelineLayout layout,
+    PipelineStats* stats)
+{
+    VkPipeline library = VK_NULL_HANDLE;
+    VkResult vkRes;
+
+    VkPipelineCreationFeedback feedback = { 0 };
+
+    const VkPipelineCreationFeedbackCreateInfo feedbackCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO,
+        .pNext = &state->rendering,
+        .pPipelineCreationFeedback = &feedback,
+        .pipelineStageCreationFeedbackCount = 0,
+        .pPipelineStageCreationFeedbacks = NULL,
+    };
+
+    const VkGraphicsPipelineLibraryCreateInfoEXT libraryCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT,
+        .pNext = (void*)&feedbackCreateInfo,
+        .flags = type,
+    };
+
+    // The driver only looks at the state that belongs to the library type
+    const VkGraphicsPipelineCreateInfo pipelineCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+        .pNext = &libraryCreateInfo,
+        .flags = createFlags | VK_PIPELINE_CREATE_LIBRARY_BIT_KHR |
+                 VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT,
+        .stageCount = stageCount,
+        .pStages = stages,
+        .pVertexInputState = &state->vertexInput,
+        .pInputAssemblyState = &state->inputAssembly,
+        .pTessellationState = &state->tessellation,
+        .pViewportState = &state->viewport,
+        .pRasterizationState = &state->rasterization,
+        .pMultisampleState = &state->multisample,
+        .pDepthStencilState = &state->depthStencil,
+        .pColorBlendState = &state->colorBlend,
+        .pDynamicState = &state->dynamic,
+        .layout = layout,
+        .renderPass = VK_NULL_HANDLE,
+        .subpass = 0,
+        .basePipelineHandle = VK_NULL_HANDLE,
+        .basePipelineIndex = 0,
+    };
+
+    AcquireSRWLockShared(&grDevice->pipelineCacheLock);
+    vkRes = VKD.vkCreateGraphicsPipelines(grDevice->device, grDevice->pipelineCache, 1,
+                                          &pipelineCreateInfo, NULL, &library);
+    ReleaseSRWLockShared(&grDevice->pipelineCacheLock);
+    if (vkRes != VK_SUCCESS) {
+        LOGE("vkCreateGraphicsPipelines failed for library 0x%X (%d)\n", type, vkRes);
+    }
+
+    grPipelineStatsAddFeedback(stats, &feedback);
+    return library;
+}
+
+typedef struct _PipelineLibraryInitParam {
+    GrDevice* grDevice;
+    PipelineLibrary* entry;
+    PipelineStats* stats;
+} PipelineLibraryInitParam;
+
+static BOOL CALLBACK createSharedPipelineLibrary(
+    PINIT_ONCE initOnce,
+    PVOID param,
+    PVOID* context)
+{
+    const PipelineLibraryInitParam* initParam = param;
+    GrDevice* grDevice = initParam->grDevice;
+    PipelineLibrary* entry = initParam->entry;
+    const PipelineLibraryKey* key = &entry->key;
+    GraphicsPipelineState state;
+
+    initGraphicsPipelineState(&state, key->topology, 0, false, key->alphaToCoverageEnable,
+                              key->logicOpEnable, key->logicOp,
+                              key->colorFormats, key->colorWriteMasks,
+                              key->depthFormat, key->stencilFormat);
+
+    entry->library = createVkPipelineLibrary(grDevice, key->type,
+                                             grDevice->descriptorBufferSupported ?
+                                             VK_PIPELINE_CREATE_DESCRIPTOR_BUFFER_BIT_EXT : 0,
+                                             &state, 0, NULL, VK_NULL_HANDLE, initParam->stats);
+
+    // A failed compile is retried by the next pipeline that needs the library
+    return entry->library != VK_NULL_HANDLE;
+}
+
+// Must be called with the pipeline library lock held
+static PipelineLibrary* findSharedPipelineLibrary(
+    const GrDevice* grDevice,
+    const PipelineLibraryKey* key)
+{
+    for (unsigned i = 0; i < grDevice->pipelineLibraryCount; i++) {
+        if (memcmp(&grDevice->pipelineLibraries[i]->key, key, sizeof(*key)) == 0) {
+            return grDevice->pipelineLibraries[i];
+        }
+    }
+
+    return NULL;
+}
+
+// Shared libraries are compiled once, by the first pipeline that needs them. The lock only
+// covers the lookup, pipelines waiting for the same library block on its init once instead.
+static VkPipeline getSharedPipelineLibrary(
+    GrDevice* grDevice,
+    const PipelineLibraryKey* key,
+    PipelineStats* stats)
+{
+    AcquireSRWLockShared(&grDevice->pipelineLibraryLock);
+    PipelineLibrary* entry = findSharedPipelineLibrary(grDevice, key);
+    ReleaseSRWLockShared(&grDevice->pipelineLibraryLock);
+
+    if (entry == NULL) {
+        AcquireSRWLockExclusive(&grDevice->pipelineLibraryLock);
+
+        // Another thread may have added it in the meantime
+        entry = findSharedPipelineLibrary(grDevice, key);
+        if (entry == NULL) {
+            entry = malloc(sizeof(PipelineLibrary));
+            *entry = (PipelineLibrary) {
+                .key = *key,
+                .initOnce = INIT_ONCE_STATIC_INIT,
+                .library = VK_NULL_HANDLE,
+            };
+
+            grDevice->pipelineLibraryCount++;
+            grDevice->pipelineLibraries = realloc(grDevice->pipelineLibraries,
+                                                  grDevice->pipelineLibraryCount *
+                                                  sizeof(PipelineLibrary*));
+            grDevice->pipelineLibraries[grDevice->pipelineLibraryCount - 1] = entry;
+        }
+
+        ReleaseSRWLockExclusive(&grDevice->pipelineLibraryLock);
+    }
+
+    PipelineLibraryInitParam initParam = {
+        .grDevice = grDevice,
+        .entry = entry,
+        .stats = stats,
+    };
+
+    if (!InitOnceExecuteOnce(&entry->initOnce, createSharedPipelineLibrary, &initParam, NULL)) {
+        return VK_NULL_HANDLE;
+    }
+
+    return entry->library;
+}
+
+static VkPipeline getFragmentOutputLibrary(
+    GrDevice* grDevice,
+    const PipelineCreateInfo* createInfo,
+    VkFormat depthFormat,
+    VkFormat stencilFormat,
+    PipelineStats* stats)
+{
+    PipelineLibraryKey key;
+
+    // Zero out padding, the key is compared with memcmp
+    memset(&key, 0, sizeof(key));
+    key.type = VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT;
+    memcpy(key.colorFormats, createInfo->colorFormats, sizeof(key.colorFormats));
+    memcpy(key.colorWriteMasks, createInfo->colorWriteMasks, sizeof(key.colorWriteMasks));
+    key.depthFormat = depthFormat;
+    key.stencilFormat = stencilFormat;
+    key.alphaToCoverageEnable = createInfo->alphaToCoverageEnable;
+    key.logicOpEnable = createInfo->logicOpEnable;
+    key.logicOp = createInfo->logicOp;
+
+    return getSharedPipelineLibrary(grDevice, &key, stats);
+}
+
+static bool createPipelineLibraries(
+    GrPipeline* grPipeline)
+{
+    GrDevice* grDevice = GET_OBJ_DEVICE(grPipeline);
+    const PipelineCreateInfo* createInfo = grPipeline->createInfo;
+    VkPipelineShaderStageCreateInfo preRasterizationStages[MAX_STAGE_COUNT];
+    unsigned preRasterizationStageCount = 0;
+    const VkPipelineShaderStageCreateInfo* fragmentStage = NULL;
+    GraphicsPipelineState state;
+    PipelineLibraryKey key;
+
+    memset(&key, 0, sizeof(key));
+    key.type = VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT;
+    key.topology = createInfo->topology;
+
+    grPipeline->vertexInputLibrary = getSharedPipelineLibrary(grDevice, &key, grPipeline->stats);
+    if (grPipeline->vertexInputLibrary == VK_NULL_HANDLE) {
+        return false;
+    }
+
+    for (unsigned i = 0; i < grPipeline->stageCount; i++) {
+        if (createInfo->stageCreateInfos[i].stage == VK_SHADER_STAGE_FRAGMENT_BIT) {
+            fragmentStage = &createInfo->stageCreateInfos[i];
+        } else {
+            preRasterizationStages[preRasterizationStageCount] = createInfo->stageCreateInfos[i];
+            preRasterizationStageCount++;
+        }
+    }
+
+    initGraphicsPipelineState(&state, createInfo->topology, createInfo->patchControlPoints,
+                              createInfo->depthClipEnable, createInfo->alphaToCoverageEnable,
+                              createInfo->logicOpEnable, createInfo->logicOp,
+                              createInfo->colorFormats, createInfo->colorWriteMasks,
+                              createInfo->depthFormat, createInfo->stencilFormat);
+
+    grPipeline->preRasterizationLibrary =
+        createVkPipelineLibrary(grDevice, VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT,
+                                grPipeline->createFlags, &state,
+                                preRasterizationStageCount, preRasterizationStages,
+                                grPipeline->pipelineLayout, grPipeline->stats);
+    grPipeline->fragmentShaderLibrary =
+        createVkPipelineLibrary(grDevice, VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT,
+                                grPipeline->createFlags, &state,
+                                fragmentStage != NULL ? 1 : 0, fragmentStage,
+                                grPipeline->pipelineLayout, grPipeline->stats);
+
+    if (grPipeline->preRasterizationLibrary == VK_NULL_HANDLE ||
+        grPipeline->fragmentShaderLibrary == VK_NULL_HANDLE) {
+        // Fall back to monolithic pipelines
+        VKD.vkDestroyPipeline(grDevice->device, grPipeline->preRasterizationLibrary, NULL);
+        VKD.vkDestroyPipeline(grDevice->device, grPipeline->fragmentShaderLibrary, NULL);
+        grPipeline->preRasterizationLibrary = VK_NULL_HANDLE;
+        grPipeline->fragmentShaderLibrary = VK_NULL_HANDLE;
+        return false;
+    }
+
+    return true;
+}
+
+static VkPipeline linkVkGraphicsPipeline(
+    const GrPipeline* grPipeline,
+    VkPipeline fragmentOutputLibrary,
+    bool optimize)
+{
+    GrDevice* grDevice = GET_OBJ_DEVICE(grPipeline);
+    VkPipeline vkPipeline = VK_NULL_HANDLE;
+    VkResult vkRes;
+
+    if (fragmentOutputLibrary == VK_NULL_HANDLE) {
+        return VK_NULL_HANDLE;
+    }
+
+    const VkPipeline libraries[] = {
+        grPipeline->vertexInputLibrary,
+        grPipeline->preRasterizationLibrary,
+        grPipeline->fragmentShaderLibrary,
+        fragmentOutputLibrary,
+    };
+
+    VkPipelineCreationFeedback feedback = { 0 };
+
+    const VkPipelineCreationFeedbackCreateInfo feedbackCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO,
+        .pNext = NULL,
+        .pPipelineCreationFeedback = &feedback,
+        .pipelineStageCreationFeedbackCount = 0,
+        .pPipelineStageCreationFeedbacks = NULL,
+    };
+
+    const VkPipelineLibraryCreateInfoKHR libraryCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR,
+        .pNext = &feedbackCreateInfo,
+        .libraryCount = COUNT_OF(libraries),
+        .pLibraries = libraries,
+    };
+
+    const VkGraphicsPipelineCreateInfo pipelineCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+        .pNext = &libraryCreateInfo,
+        .flags = grPipeline->createFlags |
+                 (optimize ? VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT : 0),
+        .stageCount = 0,
+        .pStages = NULL,
+        .layout = grPipeline->pipelineLayout,
+        .renderPass = VK_NULL_HANDLE,
+        .subpass = 0,
+        .basePipelineHandle = VK_NULL_HANDLE,
+        .basePipelineIndex = 0,
+    };
+
+    AcquireSRWLockShared(&grDevice->pipelineCacheLock);
+    vkRes = VKD.vkCreateGraphicsPipelines(grDevice->device, grDevice->pipelineCache, 1,
+                                          &pipelineCreateInfo, NULL, &vkPipeline);
+    ReleaseSRWLockShared(&grDevice->pipelineCacheLock);
+    if (vkRes != VK_SUCCESS) {
+        LOGE("vkCreateGraphicsPipelines failed to link (%d)\n", vkRes);
+    }
+
+    grPipelineStatsAddFeedback(grPipeline->stats, &feedback);
+    return vkPipeline;
+}
+
+static void optimizeGraphicsPipeline(
+    void* param)
+{
+    GrPipeline* grPipeline = param;
+    GrDevice* grDevice = GET_OBJ_DEVICE(grPipeline);
+    const PipelineCreateInfo* createInfo = grPipeline->createInfo;
+
+    VkPipeline fragmentOutputLibrary = getFragmentOutputLibrary(grDevice, createInfo,
+                                                                createInfo->depthFormat,
+                                                                createInfo->stencilFormat,
+                                                                grPipeline->stats);
+
+    grPipeline->optimizedPipeline = linkVkGraphicsPipeline(grPipeline, fragmentOutputLibrary, true);
+    if (grPipeline->optimizedPipeline != VK_NULL_HANDLE) {
+        // Publish the handle, draws switch over the next time the pipeline gets bound
+        InterlockedExchange(&grPipeline->optimizedPipelineReady, 1);
+    }
+}
+
+static VkShaderStageFlags getNextShaderStage(
+    VkShaderStageFlagBits stage,
+    VkShaderStageFlags presentStages)
+{
+    switch (stage) {
+    case VK_SHADER_STAGE_VERTEX_BIT:
+        if (presentStages & VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT) {
+            return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+        } else if (presentStages & VK_SHADER_STAGE_GEOMETRY_BIT) {
+            return VK_SHADER_STAGE_GEOMETRY_BIT;
+        }
+        return presentStages & VK_SHADER_STAGE_FRAGMENT_BIT;
+    case VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT:
+        return VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+    case VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT:
+        if (presentStages & VK_SHADER_STAGE_GEOMETRY_BIT) {
+            return VK_SHADER_STAGE_GEOMETRY_BIT;
+        }
+        return presentStages & VK_SHADER_STAGE_FRAGMENT_BIT;
+    case VK_SHADER_STAGE_GEOMETRY_BIT:
+        return presentStages & VK_SHADER_STAGE_FRAGMENT_BIT;
+    default:
+        return 0;
+    }
+}
+
+static unsigned getShaderStageIndex(
+    VkShaderStageFlagBits stage)
+{
+    switch (stage) {
+    case VK_SHADER_STAGE_VERTEX_BIT:
+        return 0;
+    case VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT:
+        return 1;
+    case VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT:
+        return 2;
+    case VK_SHADER_STAGE_GEOMETRY_BIT:
+        return 3;
+    case VK_SHADER_STAGE_FRAGMENT_BIT:
+        return 4;
+    default:
+        assert(false);
+        return 0;
+    }
+}
+
+// Creates linked shader objects, stored in VS/HS/DS/GS/PS order so that they can be bound in a
+// single call with the missing stages left unbound
+static bool createVkShaders(
+    GrDevice* grDevice,
+    unsigned stageCount,
+    const VkPipelineShaderStageCreateInfo* stageCreateInfos,
+    void* const* shaderCode,
+    const unsigned* shaderCodeSizes,
+    unsigned descriptorSetCount,
+    VkShaderEXT* shaders)
+{
+    VkDescriptorSetLayout setLayouts[32];
+    VkShaderCreateInfoEXT shaderCreateInfos[MAX_STAGE_COUNT];
+    VkShaderEXT createdShaders[MAX_STAGE_COUNT] = { VK_NULL_HANDLE };
+    VkShaderStageFlags presentStages = 0;
+
+    // Must match the pipeline layout, it's still used to bind descriptors and push constants
+    assert((descriptorSetCount + 2) <= COUNT_OF(setLayouts));
+    unsigned setLayoutCount = getDescriptorSetLayouts(grDevice, descriptorSetCount, setLayouts);
+    const VkPushConstantRange pushConstantRange = getPushConstantRange(VK_PIPELINE_BIND_POINT_GRAPHICS);
+
+    for (unsigned i = 0; i < stageCount; i++) {
+        presentStages |= stageCreateInfos[i].stage;
+    }
+
+    for (unsigned i = 0; i < stageCount; i++) {
+        const VkPipelineShaderStageCreateInfo* stageCreateInfo = &stageCreateInfos[i];
+
+        shaderCreateInfos[i] = (VkShaderCreateInfoEXT) {
+            .sType = VK_STRUCTURE_TYPE_SHADER_CREATE_INFO_EXT,
+            .pNext = NULL,
+            .flags = stageCount > 1 ? VK_SHADER_CREATE_LINK_STAGE_BIT_EXT : 0,
+            .stage = stageCreateInfo->stage,
+            .nextStage = getNextShaderStage(stageCreateInfo->stage, presentStages),
+            .codeType = VK_SHADER_CODE_TYPE_SPIRV_EXT,
+            .codeSize = shaderCodeSizes[i],
+            .pCode = shaderCode[i],
+            .pName = stageCreateInfo->pName,
+            .setLayoutCount = setLayoutCount,
+            .pSetLayouts = setLayouts,
+            .pushConstantRangeCount = 1,
+            .pPushConstantRanges = &pushConstantRange,
+            .pSpecializationInfo = stageCreateInfo->pSpecializationInfo,
+        };
+    }
+
+    VkResult vkRes = VKD.vkCreateShadersEXT(grDevice->device, stageCount, shaderCreateInfos, NULL,
+                                            createdShaders);
+    if (vkRes != VK_SUCCESS) {
+        LOGE("vkCreateShadersEXT failed (%d)\n", vkRes);
+        for (unsigned i = 0; i < stageCount; i++) {
+            VKD.vkDestroyShaderEXT(grDevice->device, createdShaders[i], NULL);
+        }
+        return false;
+    }
+
+    for (unsigned i = 0; i < stageCount; i++) {
+        shaders[getShaderStageIndex(stageCreateInfos[i].stage)] = createdShaders[i];
+    }
+
+    return true;
+}
+
+static void compileGraphicsPipeline(
+    void* param)
+{
+    GrPipeline* grPipeline = param;
+    GrDevice* grDevice = GET_OBJ_DEVICE(grPipeline);
+    const PipelineCreateInfo* createInfo = grPipeline->createInfo;
+
+    grPipeline->pipelineDepthFormat = createInfo->depthFormat;
+    grPipeline->pipelineStencilFormat = createInfo->stencilFormat;
+
+    if (grDevice->shaderObjectSupported) {
+        unsigned descriptorSetCount = 0;
+        for (unsigned i = 0; i < GR_MAX_DESCRIPTOR_SETS; i++) {
+            descriptorSetCount += grPipeline->descriptorSetCounts[i];
+        }
+
+        // Attachment formats aren't baked into shader objects, no variants needed
+        createVkShaders(grDevice, grPipeline->stageCount, createInfo->stageCreateInfos,
+                        grPipeline->shaderCode, grPipeline->shaderCodeSizes,
+                        descriptorSetCount * (1 + grDevice->descriptorUseSingleDescriptor),
+                        grPipeline->shaders);
+        return;
+    }
+
+    if (grDevice->graphicsPipelineLibrarySupported && createPipelineLibraries(grPipeline)) {
+        // Fast-link now, and let the link-time optimized pipeline replace it once it's ready
+        VkPipeline fragmentOutputLibrary = getFragmentOutputLibrary(grDevice, createInfo,
+                                                                    createInfo->depthFormat,
+                                                                    createInfo->stencilFormat,
+                                                                    grPipeline->stats);
+
+        grPipeline->pipeline = linkVkGraphicsPipeline(grPipeline, fragmentOutputLibrary, false);
+        if (grPipeline->pipeline != VK_NULL_HANDLE) {
+            threadPoolSubmit(grDevice->compilerPool, &grPipeline->optimizeJob,
+                             optimizeGraphicsPipeline, grPipeline);
+            return;
+        }
+    }
+
+    // Speculatively build against the declared formats, they match the bound targets most of the time
+    grPipeline->pipeline = createVkGraphicsPipeline(grPipeline, grDevice->pipelineCache,
+                                                    createInfo->depthFormat,
+                                                    createInfo->stencilFormat,
+                                                    grPipeline->stats);
+}
+
+static void optimizePipelineVariant(
+    void* param)
+{
+    PipelineVariant* variant = param;
+    GrPipeline* grPipeline = variant->grPipeline;
+    GrDevice* grDevice = GET_OBJ_DEVICE(grPipeline);
+
+    VkPipeline fragmentOutputLibrary = getFragmentOutputLibrary(grDevice, grPipeline->createInfo,
+                                                                variant->depthFormat,
+                                                                variant->stencilFormat,
+                                                                grPipeline->stats);
+
+    variant->optimizedPipeline = linkVkGraphicsPipeline(grPipeline, fragmentOutputLibrary, true);
+    if (variant->optimizedPipeline != VK_NULL_HANDLE) {
+        InterlockedExchange(&variant->optimizedPipelineReady, 1);
+    }
+}
+
+// Must be called with the variant lock held
+static VkPipeline findPipelineVariant(
+    const GrPipeline* grPipeline,
+    VkFormat depthFormat,
+    VkFormat stencilFormat)
+{
+    for (unsigned i = 0; i < grPipeline->variantCount; i++) {
+        const PipelineVariant* variant = grPipeline->variants[i];
+
+        if (variant->depthFormat == depthFormat && variant->stencilFormat == stencilFormat) {
+            return variant->optimizedPipelineReady ? variant->optimizedPipeline
+                                                   : variant->pipeline;
+        }
+    }
+
+    return VK_NULL_HANDLE;
+}
+
+static VkPipeline getPipelineVariant(
+    GrPipeline* grPipeline,
+    VkFormat depthFormat,
+    VkFormat stencilFormat)
+{
+    GrDevice* grDevice = GET_OBJ_DEVICE(grPipeline);
+    VkPipeline vkPipeline;
+
+    AcquireSRWLockShared(&grPipeline->variantLock);
+    vkPipeline = findPipelineVariant(grPipeline, depthFormat, stencilFormat);
+    ReleaseSRWLockShared(&grPipeline->variantLock);
+
+    if (vkPipeline != VK_NULL_HANDLE) {
+        return vkPipeline;
+    }
+
+    AcquireSRWLockExclusive(&grPipeline->variantLock);
+
+    // Another thread may have built it in the meantime
+    vkPipeline = findPipelineVariant(grPipeline, depthFormat, stencilFormat);
+    if (vkPipeline == VK_NULL_HANDLE) {
+        LOGD("depth-stencil attachment format mismatch, got %d %d, expected %d %d\n",
+             depthFormat, stencilFormat,
+             grPipeline->pipelineDepthFormat, grPipeline->pipelineStencilFormat);
+        InterlockedIncrement(&grDevice->pipelineCompileMissCount);
+
+        if (grPipeline->preRasterizationLibrary != VK_NULL_HANDLE) {
+            // Linking is cheap enough to be done at draw time
+            VkPipeline fragmentOutputLibrary = getFragmentOutputLibrary(grDevice,
+                                                                        grPipeline->createInfo,
+                                                                        depthFormat, stencilFormat,
+                                                                        grPipeline->stats);
+            vkPipeline = linkVkGraphicsPipeline(grPipeline, fragmentOutputLibrary, false);
+        } else {
+            vkPipeline = createVkGraphicsPipeline(grPipeline, grDevice->pipelineCache,
+                                                  depthFormat, stencilFormat, grPipeline->stats);
+        }
+        if (vkPipeline != VK_NULL_HANDLE) {
+            // Variants are kept by pointer, their optimization jobs must not move
+            PipelineVariant* variant = malloc(sizeof(PipelineVariant));
+            *variant = (PipelineVariant) {
+                .grPipeline = grPipeline,
+                .depthFormat = depthFormat,
+                .stencilFormat = stencilFormat,
+                .pipeline = vkPipeline,
+                .optimizeJob = { 0 },
+                .optimizedPipelineReady = 0,
+                .optimizedPipeline = VK_NULL_HANDLE,
+            };
+
+            grPipeline->variantCount++;
+            grPipeline->variants = realloc(grPipeline->variants,
+                                           grPipeline->variantCount * sizeof(PipelineVariant*));
+            grPipeline->variants[grPipeline->variantCount - 1] = variant;
+
+            if (grPipeline->preRasterizationLibrary != VK_NULL_HANDLE) {
+                // Same as the declared formats, the fast-linked variant gets replaced once optimized
+                threadPoolSubmit(grDevice->compilerPool, &variant->optimizeJob,
+                                 optimizePipelineVariant, variant);
+            }
+
+            grPipelineManifestRecordVariant(grDevice, grPipeline, depthFormat, stencilFormat);
+        }
+    }
+
+    ReleaseSRWLockExclusive(&grPipeline->variantLock);
+
+    return vkPipeline;
+}
+
+#ifdef PIPELINE_CACHE
+static void* buildPipelineCacheData(
+    const GrPipeline* grPipeline,
+    size_t* size)
+{
+    GrDevice* grDevice = GET_OBJ_DEVICE(grPipeline);
+    VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+    VkPipeline vkPipeline = VK_NULL_HANDLE;
+    void* data = NULL;
+    VkResult vkRes;
+
+    *size = 0;
+
+    const VkPipelineCacheCreateInfo cacheCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .initialDataSize = 0,
+        .pInitialData = NULL,
+    };
+
+    vkRes = VKD.vkCreatePipelineCache(grDevice->device, &cacheCreateInfo, NULL, &pipelineCache);
+    if (vkRes != VK_SUCCESS) {
+        LOGW("vkCreatePipelineCache failed (%d)\n", vkRes);
+        return NULL;
+    }
+
+    // Build the pipeline again into an empty cache to only capture its own entries,
+    // the driver should get most of it from its internal caches
+    if (grPipeline->createInfo != NULL) {
+        // Not a compile the title waits for, keep it out of the stats
+        vkPipeline = createVkGraphicsPipeline(grPipeline, pipelineCache,
+                                              grPipeline->createInfo->depthFormat,
+                                              grPipeline->createInfo->stencilFormat, NULL);
+    } else {
+        const VkComputePipelineCreateInfo pipelineCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+            .pNext = NULL,
+            .flags = grPipeline->createFlags,
+            .stage = {
+                .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                .pNext = NULL,
+                .flags = 0,
+                .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                .module = grPipeline->shaderModules[0],
+                .pName = "main",
+                .pSpecializationInfo = &grPipeline->specInfos[0],
+            },
+            .layout = grPipeline->pipelineLayout,
+            .basePipelineHandle = VK_NULL_HANDLE,
+            .basePipelineIndex = 0,
+        };
+
+        vkRes = VKD.vkCreateComputePipelines(grDevice->device, pipelineCache, 1,
+                                             &pipelineCreateInfo, NULL, &vkPipeline);
+        if (vkRes != VK_SUCCESS) {
+            LOGE("vkCreateComputePipelines failed (%d)\n", vkRes);
+        }
+    }
+
+    if (vkPipeline != VK_NULL_HANDLE &&
+        VKD.vkGetPipelineCacheData(grDevice->device, pipelineCache, size, NULL) == VK_SUCCESS &&
+        *size > 0) {
+        data = malloc(*size);
+
+        vkRes = VKD.vkGetPipelineCacheData(grDevice->device, pipelineCache, size, data);
+        if (vkRes != VK_SUCCESS) {
+            LOGW("vkGetPipelineCacheData failed (%d)\n", vkRes);
+            free(data);
+            data = NULL;
+        }
+    }
+
+    if (data == NULL) {
+        *size = 0;
+    }
+
+    VKD.vkDestroyPipeline(grDevice->device, vkPipeline, NULL);
+    VKD.vkDestroyPipelineCache(grDevice->device, pipelineCache, NULL);
+    return data;
+}
+
+// Titles query the size then store, only build the pipeline again the first time
+static const void* getPipelineCacheData(
+    GrPipeline* grPipeline,
+    size_t* size)
+{
+    AcquireSRWLockExclusive(&grPipeline->storedCacheDataLock);
+
+    if (!grPipeline->storedCacheDataBuilt) {
+        grPipeline->storedCacheData = buildPipelineCacheData(grPipeline,
+                                                             &grPipeline->storedCacheDataSize);
+        grPipeline->storedCacheDataBuilt = true;
+    }
+
+    *size = grPipeline->storedCacheDataSize;
+    ReleaseSRWLockExclusive(&grPipeline->storedCacheDataLock);
+
+    return grPipeline->storedCacheData;
+}
+#endif
+
+static GrStoredPipelineRange reserveStoredPipelineRange(
+    uint32_t* blobSize,
+    size_t size)
+{
+    const GrStoredPipelineRange range = {
+        .offset = size > 0 ? *blobSize : 0,
+        .size = size,
+    };
+
+    *blobSize = ALIGN(*blobSize + size, GR_STORED_PIPELINE_ALIGNMENT);
+    return range;
+}
+
+static bool isStoredPipelineRangeValid(
+    const GrStoredPipelineBlob* blob,
+    GrStoredPipelineRange range)
+{
+    if (range.size == 0) {
+        return true;
+    }
+
+    return range.offset >= sizeof(GrStoredPipelineBlob) &&
+           range.offset % GR_STORED_PIPELINE_ALIGNMENT == 0 &&
+           range.offset <= blob->size &&
+           range.size <= blob->size - range.offset;
+}
+
+static uint32_t getStoredPipelineChecksum(
+    const void* data,
+    uint32_t size)
+{
+    const size_t offset = OFFSET_OF(GrStoredPipelineBlob, checksum) +
+                          MEMBER_SIZEOF(GrStoredPipelineBlob, checksum);
+
+    return crc32_fast((const uint8_t*)data + offset, size - offset, 0);
+}
+
+// Fills in the header and lays out the sections, returns the total blob size
+static uint32_t initStoredPipelineBlob(
+    GrStoredPipelineBlob* blob,
+    const GrPipeline* grPipeline,
+    size_t pipelineCacheDataSize)
+{
+    const GrDevice* grDevice = GET_OBJ_DEVICE(grPipeline);
+    const PipelineCreateInfo* createInfo = grPipeline->createInfo;
+    uint32_t size = ALIGN(sizeof(GrStoredPipelineBlob), GR_STORED_PIPELINE_ALIGNMENT);
+    unsigned descriptorSlotCount = 0;
+
+    // Set field by field to keep the padding zeroed, it's part of the checksum
+    memset(blob, 0, sizeof(*blob));
+    blob->magic = GR_STORED_PIPELINE_MAGIC;
+    blob->version = GR_STORED_PIPELINE_VERSION;
+    blob->driverId = grDevice->vendorId;
+    blob->createFlags = grPipeline->createFlags & ~VK_PIPELINE_CREATE_DESCRIPTOR_BUFFER_BIT_EXT;
+    blob->stageCount = grPipeline->stageCount;
+    blob->isGraphics = createInfo != NULL;
+    blob->dynamicMappingUsed = grPipeline->dynamicMappingUsed;
+    blob->dynamicDescriptorSlot = grPipeline->dynamicDescriptorSlot;
+
+    if (createInfo != NULL) {
+        GrStoredGraphicsPipelineInfo* graphicsInfo = &blob->graphicsInfo;
+
+        graphicsInfo->topology = createInfo->topology;
+        graphicsInfo->patchControlPoints = createInfo->patchControlPoints;
+        graphicsInfo->depthClipEnable = createInfo->depthClipEnable;
+        graphicsInfo->alphaToCoverageEnable = createInfo->alphaToCoverageEnable;
+        graphicsInfo->logicOpEnable = createInfo->logicOpEnable;
+        graphicsInfo->logicOp = createInfo->logicOp;
+        memcpy(graphicsInfo->colorFormats, createInfo->colorFormats,
+               sizeof(graphicsInfo->colorFormats));
+        memcpy(graphicsInfo->colorWriteMasks, createInfo->colorWriteMasks,
+               sizeof(graphicsInfo->colorWriteMasks));
+        graphicsInfo->depthFormat = createInfo->depthFormat;
+        graphicsInfo->stencilFormat = createInfo->stencilFormat;
+    }
+
+    for (unsigned i = 0; i < GR_MAX_DESCRIPTOR_SETS; i++) {
+        blob->descriptorSetCounts[i] = grPipeline->descriptorSetCounts[i];
+        descriptorSlotCount += grPipeline->descriptorSetCounts[i];
+    }
+
+    blob->descriptorSlots = reserveStoredPipelineRange(&size, descriptorSlotCount *
+                                                              sizeof(PipelineDescriptorSlot));
+    blob->pipelineCacheData = reserveStoredPipelineRange(&size, pipelineCacheDataSize);
+
+    for (unsigned i = 0; i < grPipeline->stageCount; i++) {
+        GrStoredPipelineStage* stage = &blob->stages[i];
+        const VkSpecializationInfo* specInfo = &grPipeline->specInfos[i];
+
+        stage->stageFlags = createInfo != NULL ? createInfo->stageCreateInfos[i].stage
+                                               : VK_SHADER_STAGE_COMPUTE_BIT;
+        stage->mapEntryCount = specInfo->mapEntryCount;
+        stage->code = reserveStoredPipelineRange(&size, grPipeline->shaderCodeSizes[i]);
+        stage->specData = reserveStoredPipelineRange(&size, specInfo->dataSize);
+        stage->mapEntries = reserveStoredPipelineRange(&size, specInfo->mapEntryCount *
+                                                              sizeof(VkSpecializationMapEntry));
+    }
+
+    blob->size = size;
+    return size;
+}
+
+static bool isStoredPipelineBlobValid(
+    const GrStoredPipelineBlob* blob)
+{
+    unsigned descriptorSlotCount = 0;
+
+    if (blob->stageCount == 0 || blob->stageCount > MAX_STAGE_COUNT ||
+        (!blob->isGraphics && blob->stageCount != 1)) {
+        LOGE("invalid stage count %u\n", blob->stageCount);
+        return false;
+    }
+
+    for (unsigned i = 0; i < GR_MAX_DESCRIPTOR_SETS; i++) {
+        if (blob->descriptorSetCounts[i] > blob->size / sizeof(PipelineDescriptorSlot)) {
+            LOGE("invalid descriptor set size\n");
+            return false;
+        }
+        descriptorSlotCount += blob->descriptorSetCounts[i];
+    }
+
+    if (!isStoredPipelineRangeValid(blob, blob->descriptorSlots) ||
+        blob->descriptorSlots.size != descriptorSlotCount * sizeof(PipelineDescriptorSlot) ||
+        !isStoredPipelineRangeValid(blob, blob->pipelineCacheData)) {
+        LOGE("invalid descriptor slots or pipeline cache data\n");
+        return false;
+    }
+
+    for (unsigned i = 0; i < blob->stageCount; i++) {
+        const GrStoredPipelineStage* stage = &blob->stages[i];
+
+        if (stage->stageFlags == 0 ||
+            (!blob->isGraphics && stage->stageFlags != VK_SHADER_STAGE_COMPUTE_BIT) ||
+            stage->code.size == 0 || stage->code.size % sizeof(uint32_t) != 0 ||
+            !isStoredPipelineRangeValid(blob, stage->code)) {
+            LOGE("invalid shader code for stage %u\n", i);
+            return false;
+        }
+        if (!isStoredPipelineRangeValid(blob, stage->specData) ||
+            !isStoredPipelineRangeValid(blob, stage->mapEntries) ||
+            stage->mapEntryCount > blob->size / sizeof(VkSpecializationMapEntry) ||
+            stage->mapEntries.size != stage->mapEntryCount * sizeof(VkSpecializationMapEntry) ||
+            (stage->mapEntryCount > 0) != (stage->specData.size > 0)) {
+            LOGE("invalid specialization info for stage %u\n", i);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void writeStoredPipelineBlob(
+    void* pData,
+    const GrStoredPipelineBlob* header,
+    const GrPipeline* grPipeline,
+    const void* pipelineCacheData)
+{
+    uint8_t* data = pData;
+    unsigned descriptorSlotIndex = 0;
+
+    memset(data, 0, header->size);
+    memcpy(data, header, sizeof(*header));
+
+    for (unsigned i = 0; i < GR_MAX_DESCRIPTOR_SETS; i++) {
+        PipelineDescriptorSlot* slots = (PipelineDescriptorSlot*)&data[header->descriptorSlots.offset];
+
+        if (grPipeline->descriptorSetCounts[i] > 0) {
+            memcpy(&slots[descriptorSlotIndex], grPipeline->descriptorSlots[i],
+                   grPipeline->descriptorSetCounts[i] * sizeof(PipelineDescriptorSlot));
+            descriptorSlotIndex += grPipeline->descriptorSetCounts[i];
+        }
+    }
+
+    if (pipelineCacheData != NULL) {
+        memcpy(&data[header->pipelineCacheData.offset], pipelineCacheData,
+               header->pipelineCacheData.size);
+    }
+
+    for (unsigned i = 0; i < header->stageCount; i++) {
+        const GrStoredPipelineStage* stage = &header->stages[i];
+
+        memcpy(&data[stage->code.offset], grPipeline->shaderCode[i], stage->code.size);
+        if (stage->specData.size > 0) {
+            memcpy(&data[stage->specData.offset], grPipeline->specData[i], stage->specData.size);
+        }
+        if (stage->mapEntries.size > 0) {
+            memcpy(&data[stage->mapEntries.offset], grPipeline->mapEntries[i], stage->mapEntries.size);
+        }
+    }
+
+    ((GrStoredPipelineBlob*)data)->checksum = getStoredPipelineChecksum(data, header->size);
+}
+
+static GR_RESULT validateStoredPipelineBlob(
+    const GrDevice* grDevice,
+    const void* data,
+    GR_SIZE dataSize)
+{
+    const GrStoredPipelineBlob* blob = data;
+
+    if (dataSize < sizeof(GrStoredPipelineBlob)) {
+        return GR_ERROR_INVALID_MEMORY_SIZE;
+    }
+    if (blob->magic != GR_STORED_PIPELINE_MAGIC || blob->version != GR_STORED_PIPELINE_VERSION) {
+        LOGE("unsupported pipeline data version %u\n", blob->version);
+        return GR_ERROR_BAD_PIPELINE_DATA;
+    }
+    if (blob->size < sizeof(GrStoredPipelineBlob) || blob->size > dataSize) {
+        return GR_ERROR_INVALID_MEMORY_SIZE;
+    }
+
+    unsigned checksum = getStoredPipelineChecksum(data, blob->size);
+    if (checksum != blob->checksum) {
+        LOGE("checksum mismatch, expected 0x%X, got 0x%X\n", blob->checksum, checksum);
+        return GR_ERROR_BAD_PIPELINE_DATA;
+    }
+    if (!isStoredPipelineBlobValid(blob)) {
+        return GR_ERROR_BAD_PIPELINE_DATA;
+    }
+    if (blob->driverId != grDevice->vendorId) {
+        return GR_ERROR_INCOMPATIBLE_DEVICE;
+    }
+
+    return GR_SUCCESS;
+}
+
+// Exported Functions
+
+void* grPipelineSerialize(
+    const GrPipeline* grPipeline,
+    uint32_t* size)
+{
+    GrStoredPipelineBlob header;
+
+    *size = initStoredPipelineBlob(&header, grPipeline, 0);
+
+    void* data = malloc(*size);
+    writeStoredPipelineBlob(data, &header, grPipeline, NULL);
+    return data;
+}
+
+bool grPipelinePrewarm(
+    GrDevice* grDevice,
+    const void* data,
+    uint32_t size,
+    unsigned formatCount,
+    const PipelineFormats* formats)
+{
+    const GrStoredPipelineBlob* blob = data;
+    const uint8_t* blobData = data;
+    VkShaderModule shaderModules[MAX_STAGE_COUNT] = { VK_NULL_HANDLE };
+    void* shaderCode[MAX_STAGE_COUNT] = { NULL };
+    unsigned shaderCodeSizes[MAX_STAGE_COUNT] = { 0 };
+    VkSpecializationInfo specInfos[MAX_STAGE_COUNT];
+    VkPipelineShaderStageCreateInfo stageCreateInfos[MAX_STAGE_COUNT];
+    VkPipelineLayout pipelineLayout;
+    bool valid = false;
+
+    if (validateStoredPipelineBlob(grDevice, data, size) != GR_SUCCESS) {
+        return false;
+    }
+
+    for (unsigned i = 0; i < blob->stageCount; i++) {
+        const GrStoredPipelineStage* stage = &blob->stages[i];
+
+        if (grShaderModuleCacheAcquire(grDevice, &blobData[stage->code.offset], stage->code.size,
+                                       &shaderCode[i], &shaderModules[i]) != VK_SUCCESS) {
+            goto bail;
+        }
+        shaderCodeSizes[i] = stage->code.size;
+
+        // Specialization data is read in place, the blob outlives the compilation
+        specInfos[i] = (VkSpecializationInfo) {
+            .mapEntryCount = stage->mapEntryCount,
+            .pMapEntries = (const VkSpecializationMapEntry*)&blobData[stage->mapEntries.offset],
+            .dataSize = stage->specData.size,
+            .pData = &blobData[stage->specData.offset],
+        };
+
+        stageCreateInfos[i] = (VkPipelineShaderStageCreateInfo) {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .pNext = NULL,
+            .flags = 0,
+            .stage = stage->stageFlags,
+            .module = shaderModules[i],
+            .pName = "main",
+            .pSpecializationInfo = &specInfos[i],
+        };
+    }
+
+    unsigned descriptorSetCount = 0;
+    for (unsigned i = 0; i < GR_MAX_DESCRIPTOR_SETS; i++) {
+        descriptorSetCount += blob->descriptorSetCounts[i];
+    }
+
+    VkPipelineCreateFlags createFlags = blob->createFlags |
+        (grDevice->descriptorBufferSupported ? VK_PIPELINE_CREATE_DESCRIPTOR_BUFFER_BIT_EXT : 0);
+
+    pipelineLayout = getVkPipelineLayout(grDevice, descriptorSetCount * (1 + grDevice->descriptorUseSingleDescriptor),
+                                         blob->isGraphics ? VK_PIPELINE_BIND_POINT_GRAPHICS : VK_PIPELINE_BIND_POINT_COMPUTE);
+    if (pipelineLayout == VK_NULL_HANDLE) {
+        goto bail;
+    }
+
+    if (blob->isGraphics && grDevice->shaderObjectSupported) {
+        // Shader objects don't go through the pipeline cache, this only primes the driver's own cache
+        VkShaderEXT shaders[MAX_STAGE_COUNT] = { VK_NULL_HANDLE };
+
+        bool created = createVkShaders(grDevice, blob->stageCount, stageCreateInfos, shaderCode,
+                                       shaderCodeSizes, descriptorSetCount * (1 + grDevice->descriptorUseSingleDescriptor),
+                                       shaders);
+        for (unsigned i = 0; i < MAX_STAGE_COUNT; i++) {
+            VKD.vkDestroyShaderEXT(grDevice->device, shaders[i], NULL);
+        }
+
+        if (!created) {
+            goto bail;
+        }
+    } else if (blob->isGraphics) {
+        const GrStoredGraphicsPipelineInfo* graphicsInfo = &blob->graphicsInfo;
+        PipelineCreateInfo createInfo = {
+            .stageCreateInfos = { { 0 } }, // Initialized below
+            .topology = graphicsInfo->topology,
+            .patchControlPoints = graphicsInfo->patchControlPoints,
+            .depthClipEnable = graphicsInfo->depthClipEnable,
+            .alphaToCoverageEnable = graphicsInfo->alphaToCoverageEnable,
+            .logicOpEnable = graphicsInfo->logicOpEnable,
+            .logicOp = graphicsInfo->logicOp,
+            .colorFormats = { 0 }, // Initialized below
+            .colorWriteMasks = { 0 }, // Initialized below
+            .depthFormat = graphicsInfo->depthFormat,
+            .stencilFormat = graphicsInfo->stencilFormat,
+        };
+
+        memcpy(createInfo.stageCreateInfos, stageCreateInfos,
+               blob->stageCount * sizeof(VkPipelineShaderStageCreateInfo));
+        memcpy(createInfo.colorFormats, graphicsInfo->colorFormats, sizeof(createInfo.colorFormats));
+        memcpy(createInfo.colorWriteMasks, graphicsInfo->colorWriteMasks, sizeof(createInfo.colorWriteMasks));
+
+        // Only what's needed to build a pipeline, prewarming is kept out of the stats
+        GrPipeline grPipeline = {
+            .grObj = { GR_OBJ_TYPE_PIPELINE, grDevice },
+            .createFlags = createFlags,
+            .createInfo = &createInfo,
+            .pipelineLayout = pipelineLayout,
+            .stageCount = blob->stageCount,
+            .stats = NULL,
+        };
+
+        // Take the same path as the pipeline will, libraries and fast links go through the cache too
+        bool useLibraries = grDevice->graphicsPipelineLibrarySupported &&
+                            createPipelineLibraries(&grPipeline);
+
+        // The declared formats come first, then the variants seen at draw time
+        for (unsigned i = 0; i <= formatCount; i++) {
+            VkFormat depthFormat = i == 0 ? createInfo.depthFormat : formats[i - 1].depthFormat;
+            VkFormat stencilFormat = i == 0 ? createInfo.stencilFormat : formats[i - 1].stencilFormat;
+            VkPipeline vkPipeline;
+
+            if (useLibraries) {
+                VkPipeline fragmentOutputLibrary = getFragmentOutputLibrary(grDevice, &createInfo,
+                                                                            depthFormat, stencilFormat,
+                                                                            NULL);
+                vkPipeline = linkVkGraphicsPipeline(&grPipeline, fragmentOutputLibrary, false);
+            } else {
+                vkPipeline = createVkGraphicsPipeline(&grPipeline, grDevice->pipelineCache,
+                                                      depthFormat, stencilFormat, NULL);
+            }
+
+            if (vkPipeline == VK_NULL_HANDLE) {
+                break;
+            }
+
+            VKD.vkDestroyPipeline(grDevice->device, vkPipeline, NULL);
+            valid = i == formatCount;
+        }
+
+        // The vertex input library is owned by the device
+        VKD.vkDestroyPipeline(grDevice->device, grPipeline.preRasterizationLibrary, NULL);
+        VKD.vkDestroyPipeline(grDevice->device, grPipeline.fragmentShaderLibrary, NULL);
+
+        if (!valid) {
+            goto bail;
+        }
+    } else {
+        const VkComputePipelineCreateInfo pipelineCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+            .pNext = NULL,
+            .flags = createFlags,
+            .stage = stageCreateInfos[0],
+            .layout = pipelineLayout,
+            .basePipelineHandle = VK_NULL_HANDLE,
+            .basePipelineIndex = 0,
+        };
+        VkPipeline vkPipeline = VK_NULL_HANDLE;
+
+        VkResult vkRes;
+
+        AcquireSRWLockShared(&grDevice->pipelineCacheLock);
+        vkRes = VKD.vkCreateComputePipelines(grDevice->device, grDevice->pipelineCache, 1,
+                                             &pipelineCreateInfo, NULL, &vkPipeline);
+        ReleaseSRWLockShared(&grDevice->pipelineCacheLock);
+        if (vkRes != VK_SUCCESS) {
+            LOGE("vkCreateComputePipelines failed (%d)\n", vkRes);
+            goto bail;
+        }
+
+        VKD.vkDestroyPipeline(grDevice->device, vkPipeline, NULL);
+    }
+
+    valid = true;
+
+bail:
+    for (unsigned i = 0; i < MAX_STAGE_COUNT; i++) {
+        grShaderModuleCacheRelease(grDevice, shaderCode[i]);
+    }
+
+    return valid;
+}
+
+void grPipelineWaitCompilation(
+    GrPipeline* grPipeline)
+{
+    if (threadPoolIsJobDone(&grPipeline->compileJob)) {
+        return;
+    }
+
+    GrDevice* grDevice = GET_OBJ_DEVICE(grPipeline);
+    threadPoolWait(grDevice->compilerPool, &grPipeline->compileJob);
+}
+
+void grPipelineCancelOptimization(
+    GrPipeline* grPipeline)
+{
+    GrDevice* grDevice = GET_OBJ_DEVICE(grPipeline);
+
+    if (!threadPoolCancel(grDevice->compilerPool, &grPipeline->optimizeJob)) {
+        threadPoolWait(grDevice->compilerPool, &grPipeline->optimizeJob);
+    }
+
+    for (unsigned i = 0; i < grPipeline->variantCount; i++) {
+        PipelineVariant* variant = grPipeline->variants[i];
+
+        if (!threadPoolCancel(grDevice->compilerPool, &variant->optimizeJob)) {
+            threadPoolWait(grDevice->compilerPool, &variant->optimizeJob);
+        }
+    }
+}
+
+VkPipeline grPipelineGetVkPipeline(
+    GrPipeline* grPipeline,
+    VkFormat depthFormat,
+    VkFormat stencilFormat)
+{
+    GrDevice* grDevice = GET_OBJ_DEVICE(grPipeline);
+
+    if (!threadPoolIsJobDone(&grPipeline->compileJob)) {
+        InterlockedIncrement(&grDevice->pipelineCompileWaitCount);
+        LOGV("waiting for pipeline %p compilation\n", grPipeline);
+        threadPoolWait(grDevice->compilerPool, &grPipeline->compileJob);
+    }
+
+    if (grPipeline->pipelineDepthFormat == depthFormat &&
+        grPipeline->pipelineStencilFormat == stencilFormat) {
+        return grPipeline->optimizedPipelineReady ? grPipeline->optimizedPipeline
+                                                  : grPipeline->pipeline;
+    }
 
-    const VkPipelineDynamicStateCreateInfo dynamicStateCreateInfo = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
-        .pNext = NULL,
-        .flags = 0,
-        .dynamicStateCount = COUNT_OF(dynamicStates),
-        .pDynamicStates = dynamicStates,
-    };
+    return getPipelineVariant(grPipeline, depthFormat, stencilFormat);
+}
 
-    if (depthFormat != createInfo->depthFormat ||
-        stencilFormat != createInfo->stencilFormat) {
-        LOGD("depth-stencil attachment format mismatch, got %d %d, expected %d %d\n",
-             depthFormat, stencilFormat, createInfo->depthFormat, createInfo->stencilFormat);
+const VkShaderEXT* grPipelineGetVkShaders(
+    GrPipeline* grPipeline)
+{
+    GrDevice* grDevice = GET_OBJ_DEVICE(grPipeline);
+
+    if (!threadPoolIsJobDone(&grPipeline->compileJob)) {
+        InterlockedIncrement(&grDevice->pipelineCompileWaitCount);
+        LOGV("waiting for pipeline %p compilation\n", grPipeline);
+        threadPoolWait(grDevice->compilerPool, &grPipeline->compileJob);
     }
 
-    const VkPipelineRenderingCreateInfo renderingCreateInfo = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
-        .pNext = NULL,
-        .viewMask = 0,
-        .colorAttachmentCount = GR_MAX_COLOR_TARGETS,
-        .pColorAttachmentFormats = createInfo->colorFormats,
-        .depthAttachmentFormat = depthFormat,
-        .stencilAttachmentFormat = stencilFormat,
-    };
+    return grPipeline->shaders;
+}
 
-    const VkGraphicsPipelineCreateInfo pipelineCreateInfo = {
-        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
-        .pNext = &renderingCreateInfo,
-        .flags = grPipeline->createFlags,
-        .stageCount = grPipeline->stageCount,
-        .pStages = createInfo->stageCreateInfos,
-        .pVertexInputState = &vertexInputStateCreateInfo,
-        .pInputAssemblyState = &inputAssemblyStateCreateInfo,
-        .pTessellationState = &tessellationStateCreateInfo,
-        .pViewportState = &viewportStateCreateInfo,
-        .pRasterizationState = &rasterizationStateCreateInfo,
-        .pMultisampleState = &msaaStateCreateInfo,
-        .pDepthStencilState = &depthStencilStateCreateInfo,
-        .pColorBlendState = &colorBlendStateCreateInfo,
-        .pDynamicState = &dynamicStateCreateInfo,
-        .layout = grPipeline->pipelineLayout,
-        .renderPass = VK_NULL_HANDLE,
-        .subpass = 0,
-        .basePipelineHandle = VK_NULL_HANDLE,
-        .basePipelineIndex = 0,
-    };
+static void compileShader(
+    void* param)
+{
+    GrShader* grShader = param;
+    LONGLONG startTime = grPipelineStatsGetTime();
+
+    IlcShader ilcShader = ilcCompileShader(grShader->ilCode, grShader->ilCodeSize,
+                                           &grShader->ilcOptions);
+
+    grShader->compileTime = grPipelineStatsGetTime() - startTime;
+
+    grShader->bindingCount = ilcShader.bindingCount;
+    grShader->bindings = ilcShader.bindings;
+    grShader->inputCount = ilcShader.inputCount;
+    grShader->inputs = ilcShader.inputs;
+    grShader->outputCount = ilcShader.outputCount;
+    grShader->outputLocations = ilcShader.outputLocations;
+    grShader->name = ilcShader.name;
+    grShader->codeSize = ilcShader.codeSize;
+    grShader->code = ilcShader.code;
+
+    free(grShader->ilCode);
+    grShader->ilCode = NULL;
+}
 
-    vkRes = VKD.vkCreateGraphicsPipelines(grDevice->device, VK_NULL_HANDLE, 1, &pipelineCreateInfo,
-                                          NULL, &vkPipeline);
-    if (vkRes != VK_SUCCESS) {
-        LOGE("vkCreateGraphicsPipelines failed (%d)\n", vkRes);
+void grShaderWaitCompilation(
+    GrShader* grShader)
+{
+    // Check before touching the device, shaders may outlive it (see QUIRK_KEEP_VK_DEVICE)
+    if (threadPoolIsJobDone(&grShader->compileJob)) {
+        return;
     }
 
-    return vkPipeline;
+    const GrDevice* grDevice = GET_OBJ_DEVICE(grShader);
+    threadPoolWait(grDevice->compilerPool, &grShader->compileJob);
 }
 
 // Shader and Pipeline Functions
@@ -578,26 +2263,39 @@ GR_RESULT GR_STDCALL grCreateShader(
     LOGT("%p %p %p\n", device, pCreateInfo, pShader);
     GrDevice* grDevice = (GrDevice*)device;
 
-    // ALLOW_RE_Z flag doesn't have a Vulkan equivalent. RADV determines it automatically.
-    IlcOptions options = {
-        .fragmentMaskSupported = grDevice->fragmentMaskSupported,
-    };
-    IlcShader ilcShader = ilcCompileShader(pCreateInfo->pCode, pCreateInfo->codeSize, &options);
+    // The application is free to release the IL once we return, keep a copy around
+    void* ilCode = malloc(pCreateInfo->codeSize);
+    memcpy(ilCode, pCreateInfo->pCode, pCreateInfo->codeSize);
 
     GrShader* grShader = malloc(sizeof(GrShader));
     *grShader = (GrShader) {
         .grObj = { GR_OBJ_TYPE_SHADER, grDevice },
-        .bindingCount = ilcShader.bindingCount,
-        .bindings = ilcShader.bindings,
-        .inputCount = ilcShader.inputCount,
-        .inputs = ilcShader.inputs,
-        .outputCount = ilcShader.outputCount,
-        .outputLocations = ilcShader.outputLocations,
-        .name = ilcShader.name,
-        .codeSize = ilcShader.codeSize,
-        .code = ilcShader.code,
+        .compileJob = { 0 }, // Initialized below
+        .ilCode = ilCode,
+        .ilCodeSize = pCreateInfo->codeSize,
+        // ALLOW_RE_Z flag doesn't have a Vulkan equivalent. RADV determines it automatically.
+        .ilcOptions = {
+            .fragmentMaskSupported = grDevice->fragmentMaskSupported,
+        },
+        .bindingCount = 0,
+        .bindings = NULL,
+        .inputCount = 0,
+        .inputs = NULL,
+        .outputCount = 0,
+        .outputLocations = NULL,
+        .name = NULL,
+        .codeSize = 0,
+        .code = NULL,
+        .compileTime = 0,
+        .id = InterlockedIncrement(&grDevice->lastShaderId),
+        .descriptorMappingLock = SRWLOCK_INIT,
+        .descriptorMappingCount = 0,
+        .descriptorMappingBuckets = { NULL },
     };
 
+    // Translate in the background, pipeline creation only waits for the shaders it references
+    threadPoolSubmit(grDevice->compilerPool, &grShader->compileJob, compileShader, grShader);
+
     *pShader = (GR_SHADER)grShader;
     return GR_SUCCESS;
 }
@@ -611,11 +2309,11 @@ GR_RESULT GR_STDCALL grCreateGraphicsPipeline(
     GrDevice* grDevice = (GrDevice*)device;
     GR_RESULT res = GR_SUCCESS;
     VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+    const ScratchMark scratchMark = scratchGetMark();
 
     VkShaderModule shaderModules[MAX_STAGE_COUNT] = { 0 };
     IlcBindingPatchEntry* patchEntries[MAX_STAGE_COUNT] = { NULL };
     uint32_t* specData[MAX_STAGE_COUNT] = { NULL };
-    uint32_t* descriptorSetIndices[MAX_STAGE_COUNT] = { NULL };
     VkSpecializationMapEntry* mapEntries[MAX_STAGE_COUNT] = { NULL };
     VkSpecializationInfo specInfos[MAX_STAGE_COUNT] = { { 0 } };
 
@@ -626,6 +2324,11 @@ GR_RESULT GR_STDCALL grCreateGraphicsPipeline(
     unsigned descriptorSetCounts[GR_MAX_DESCRIPTOR_SETS] = { 0 };
     PipelineDescriptorSlot* pipelineDescriptorSlots[GR_MAX_DESCRIPTOR_SETS] = { NULL };
 
+    const GrShader* grShaders[MAX_STAGE_COUNT];
+    unsigned grShaderCount = 0;
+    PipelineStats stats = { 0 };
+    LONGLONG startTime;
+
     VkResult vkRes;
 
     // TODO validate parameters
@@ -646,7 +2349,12 @@ GR_RESULT GR_STDCALL grCreateGraphicsPipeline(
     unsigned stageCount = 0;
     VkPipelineShaderStageCreateInfo shaderStageCreateInfo[COUNT_OF(stages)];
 
-    bool dynamicMappingUsed = false;
+    for (int i = 0; i < COUNT_OF(stages); i++) {
+        if (stages[i].shader->shader != GR_NULL_HANDLE) {
+            grShaderWaitCompilation((GrShader*)stages[i].shader->shader);
+        }
+    }
+
     for (int i = 0; i < COUNT_OF(stages); i++) {
         Stage* stage = &stages[i];
 
@@ -659,16 +2367,15 @@ GR_RESULT GR_STDCALL grCreateGraphicsPipeline(
         if (grShader->bindingCount == 0) {
             continue;
         }
-        patchEntries[i] = malloc(sizeof(IlcBindingPatchEntry) * grShader->bindingCount);
-        mapEntries[i] = malloc(grShader->bindingCount * 2 * sizeof(VkSpecializationMapEntry));
-        specData[i] = malloc(sizeof(uint32_t) * 2 * grShader->bindingCount);
+        patchEntries[i] = scratchAlloc(sizeof(IlcBindingPatchEntry) * grShader->bindingCount);
+        mapEntries[i] = scratchAlloc(grShader->bindingCount * 2 * sizeof(VkSpecializationMapEntry));
+        specData[i] = scratchAlloc(sizeof(uint32_t) * 2 * grShader->bindingCount);
         specInfos[i] = (VkSpecializationInfo) {
             .pData = specData[i],
             .pMapEntries = mapEntries[i],
             .dataSize = sizeof(uint32_t) * grShader->bindingCount * 2,
             .mapEntryCount = grShader->bindingCount * 2,
         };
-        descriptorSetIndices[i] = &specData[i][grShader->bindingCount];
         for (unsigned j = 0; j < grShader->bindingCount; ++j) {
             mapEntries[i][j * 2] = (VkSpecializationMapEntry) {
                 .constantID = grShader->bindings[j].offsetSpecId,
@@ -681,24 +2388,12 @@ GR_RESULT GR_STDCALL grCreateGraphicsPipeline(
                 .size = sizeof(uint32_t),
             };
         }
-
-        dynamicMappingUsed |= handleDynamicDescriptorSlots(
-            &dynamicDescriptorSlot,
-            &stage->shader->dynamicMemoryViewMapping,
-            grDevice->descriptorBufferSupported,
-            grShader->bindingCount, grShader->bindings,
-            specData[i],
-            &specData[i][grShader->bindingCount],
-            patchEntries[i]);
     }
 
-    unsigned descriptorSetCount = 0;
-    for (unsigned i = 0; i < GR_MAX_DESCRIPTOR_SETS; i++) {
-        getDescriptorSlotMappings(&descriptorSetCounts[i], &pipelineDescriptorSlots[i],
-                                  grDevice, COUNT_OF(stages), stages, patchEntries, specData, descriptorSetIndices, i,
-                                  descriptorSetCount + (grDevice->descriptorBufferSupported ? DESCRIPTOR_BUFFERS_BASE_DESCRIPTOR_SET_ID : DESCRIPTOR_SET_ID));
-        descriptorSetCount += descriptorSetCounts[i];
-    }
+    bool dynamicMappingUsed = resolveDescriptorMappings(&dynamicDescriptorSlot, descriptorSetCounts,
+                                                        pipelineDescriptorSlots, grDevice,
+                                                        COUNT_OF(stages), stages,
+                                                        patchEntries, specData);
 
     for (int i = 0; i < COUNT_OF(stages); i++) {
         Stage* stage = &stages[i];
@@ -713,37 +2408,40 @@ GR_RESULT GR_STDCALL grCreateGraphicsPipeline(
         }
 
         GrShader* grShader = (GrShader*)stage->shader->shader;
+        grShaders[grShaderCount] = grShader;
+        grShaderCount++;
 
-        void* code = malloc(grShader->codeSize);
+        void* code = scratchAlloc(grShader->codeSize);
+        void* recompiledCode = NULL;
         unsigned codeSize = grShader->codeSize;
         memcpy(code, grShader->code, grShader->codeSize);
 
+        startTime = grPipelineStatsGetTime();
         patchShaderBindings(
             code,
             grShader->codeSize,
             patchEntries[i],
             grShader->bindingCount);
+        stats.patchTime += grPipelineStatsGetTime() - startTime;
 
         if (stage->flags == VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT && stages[0].shader->shader != GR_NULL_HANDLE) {
             GrShader* grVertexShader = (GrShader*)stages[0].shader->shader;
+            startTime = grPipelineStatsGetTime();
             IlcRecompiledShader recompiledShader = ilcRecompileHullShader(code, codeSize,
                                                                           grVertexShader->outputLocations, grVertexShader->outputCount);
-            free(code);
+            stats.hullRecompileTime += grPipelineStatsGetTime() - startTime;
+            recompiledCode = recompiledShader.code;
             code = recompiledShader.code;
             codeSize = recompiledShader.codeSize;
         }
 
-        const VkShaderModuleCreateInfo createInfo = {
-            .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-            .pNext = NULL,
-            .flags = 0,
-            .codeSize = codeSize,
-            .pCode = code,
-        };
-
-        vkRes = VKD.vkCreateShaderModule(grDevice->device, &createInfo, NULL, &shaderModules[stageCount]);
-        shaderCode[stageCount] = code;
+        // Many pipelines end up with identical stages, share them
+        startTime = grPipelineStatsGetTime();
+        vkRes = grShaderModuleCacheAcquire(grDevice, code, codeSize,
+                                           &shaderCode[stageCount], &shaderModules[stageCount]);
+        stats.shaderModuleTime += grPipelineStatsGetTime() - startTime;
         shaderCodeSizes[stageCount] = codeSize;
+        free(recompiledCode);
 
         if (vkRes != VK_SUCCESS) {
             res = getGrResult(vkRes);
@@ -789,19 +2487,12 @@ GR_RESULT GR_STDCALL grCreateGraphicsPipeline(
             grPixelShader != NULL ? grPixelShader->inputCount : 0,
             grPixelShader != NULL ? grPixelShader->inputs : NULL);
 
-        const VkShaderModuleCreateInfo rectangleShaderModuleCreateInfo = {
-            .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-            .pNext = NULL,
-            .flags = 0,
-            .codeSize = rectangleShader.codeSize,
-            .pCode = rectangleShader.code,
-        };
-
-        vkRes = VKD.vkCreateShaderModule(grDevice->device, &rectangleShaderModuleCreateInfo, NULL,
-                                         &shaderModules[stageCount]);
-
-        shaderCode[stageCount] = rectangleShader.code;
+        startTime = grPipelineStatsGetTime();
+        vkRes = grShaderModuleCacheAcquire(grDevice, rectangleShader.code, rectangleShader.codeSize,
+                                           &shaderCode[stageCount], &shaderModules[stageCount]);
+        stats.shaderModuleTime += grPipelineStatsGetTime() - startTime;
         shaderCodeSizes[stageCount] = rectangleShader.codeSize;
+        free(rectangleShader.code);
 
         if (vkRes != VK_SUCCESS) {
             res = getGrResult(vkRes);
@@ -831,8 +2522,7 @@ GR_RESULT GR_STDCALL grCreateGraphicsPipeline(
         colorWriteMasks[i] = getVkColorComponentFlags(target->channelWriteMask);
     }
 
-    PipelineCreateInfo* pipelineCreateInfo = malloc(sizeof(PipelineCreateInfo));
-    *pipelineCreateInfo = (PipelineCreateInfo) {
+    PipelineCreateInfo pipelineCreateInfo = {
         .stageCreateInfos = { { 0 } }, // Initialized below
         .topology = getVkPrimitiveTopology(pCreateInfo->iaState.topology),
         .patchControlPoints = pCreateInfo->tessState.patchControlPoints,
@@ -846,14 +2536,14 @@ GR_RESULT GR_STDCALL grCreateGraphicsPipeline(
         .stencilFormat = getStencilVkFormat(pCreateInfo->dbState.format),
     };
 
-    memcpy(pipelineCreateInfo->stageCreateInfos, shaderStageCreateInfo,
+    memcpy(pipelineCreateInfo.stageCreateInfos, shaderStageCreateInfo,
            stageCount * sizeof(VkPipelineShaderStageCreateInfo));
-    memcpy(pipelineCreateInfo->colorFormats, colorFormats,
+    memcpy(pipelineCreateInfo.colorFormats, colorFormats,
            GR_MAX_COLOR_TARGETS * sizeof(VkFormat));
-    memcpy(pipelineCreateInfo->colorWriteMasks, colorWriteMasks,
+    memcpy(pipelineCreateInfo.colorWriteMasks, colorWriteMasks,
            GR_MAX_COLOR_TARGETS * sizeof(VkColorComponentFlags));
 
-    descriptorSetCount = 0;
+    unsigned descriptorSetCount = 0;
     for (unsigned i = 0; i < GR_MAX_DESCRIPTOR_SETS; i++) {
         descriptorSetCount += descriptorSetCounts[i];
     }
@@ -863,7 +2553,8 @@ GR_RESULT GR_STDCALL grCreateGraphicsPipeline(
         goto bail;
     }
     // TODO keep track of rectangle shader module
-    GrPipeline* grPipeline = malloc(sizeof(GrPipeline));
+    GrPipeline* grPipeline = malloc(getPipelineDataSize(&pipelineCreateInfo, specInfos,
+                                                        descriptorSetCounts));
     *grPipeline = (GrPipeline) {
         .grObj = { GR_OBJ_TYPE_PIPELINE, grDevice },
         .shaderModules = { VK_NULL_HANDLE },
@@ -873,9 +2564,28 @@ GR_RESULT GR_STDCALL grCreateGraphicsPipeline(
         ((pCreateInfo->flags & GR_PIPELINE_CREATE_DISABLE_OPTIMIZATION) != 0 ?
                         VK_PIPELINE_CREATE_DISABLE_OPTIMIZATION_BIT : 0) |
         (grDevice->descriptorBufferSupported ? VK_PIPELINE_CREATE_DESCRIPTOR_BUFFER_BIT_EXT : 0),
-        .createInfo = pipelineCreateInfo,
-        .pipeline = VK_NULL_HANDLE, // We don't know the attachment formats yet (Frostbite bug)
+        .createInfo = NULL, // Initialized below
+        .compileJob = { 0 }, // Initialized below
+        .pipeline = VK_NULL_HANDLE, // Initialized below
+        .pipelineDepthFormat = VK_FORMAT_UNDEFINED, // Initialized below
+        .pipelineStencilFormat = VK_FORMAT_UNDEFINED, // Initialized below
+        .preRasterizationLibrary = VK_NULL_HANDLE,
+        .fragmentShaderLibrary = VK_NULL_HANDLE,
+        .vertexInputLibrary = VK_NULL_HANDLE,
+        .optimizeJob = { 0 },
+        .optimizedPipelineReady = 0,
+        .optimizedPipeline = VK_NULL_HANDLE,
+        .variantLock = SRWLOCK_INIT,
+        .variantCount = 0,
+        .variants = NULL,
+        .shaders = { VK_NULL_HANDLE },
+        .storedCacheDataLock = SRWLOCK_INIT,
+        .storedCacheDataBuilt = false,
+        .storedCacheData = NULL,
+        .storedCacheDataSize = 0,
         .pipelineLayout = pipelineLayout,
+        .manifestEntry = NULL, // Initialized below
+        .stats = NULL, // Initialized below
         .stageCount = stageCount,
         .dynamicMappingUsed = dynamicMappingUsed,
         .dynamicDescriptorSlot = dynamicDescriptorSlot,
@@ -890,36 +2600,30 @@ GR_RESULT GR_STDCALL grCreateGraphicsPipeline(
 
     memcpy(grPipeline->descriptorSetCounts, descriptorSetCounts,
            sizeof(grPipeline->descriptorSetCounts));
-    memcpy(grPipeline->descriptorSlots, pipelineDescriptorSlots,
-           sizeof(grPipeline->descriptorSlots));
-
-    memcpy(grPipeline->specInfos, specInfos, sizeof(specInfos));
-    memcpy(grPipeline->specData, specData, sizeof(specData));
-    memcpy(grPipeline->mapEntries, mapEntries, sizeof(mapEntries));
     memcpy(grPipeline->shaderCode, shaderCode, sizeof(shaderCode));
     memcpy(grPipeline->shaderCodeSizes, shaderCodeSizes, sizeof(shaderCodeSizes));
 
-    for (uint32_t i = 0; i < MAX_STAGE_COUNT; i++) {
-        pipelineCreateInfo->stageCreateInfos[i].pSpecializationInfo = &grPipeline->specInfos[i];
-        free(patchEntries[i]);
-    }
+    initPipelineData(grPipeline, &pipelineCreateInfo, specInfos, pipelineDescriptorSlots);
+    scratchRelease(scratchMark);
+
+    stats.isGraphics = true;
+    grPipeline->stats = grPipelineStatsAdd(grDevice, &stats, grShaderCount, grShaders);
+    grPipelineManifestRecord(grDevice, grPipeline);
+
+    // Build the pipeline in the background so that the first draw doesn't stall. Bound targets
+    // may still differ from the declared formats (Frostbite bug), that's handled at draw time.
+    threadPoolSubmit(grDevice->compilerPool, &grPipeline->compileJob,
+                     compileGraphicsPipeline, grPipeline);
 
     *pPipeline = (GR_PIPELINE)grPipeline;
 
     return GR_SUCCESS;
 
 bail:
-    VKD.vkDestroyPipelineLayout(grDevice->device, pipelineLayout, NULL);
     for (uint32_t i = 0; i < MAX_STAGE_COUNT; i++) {
-        VKD.vkDestroyShaderModule(grDevice->device, shaderModules[i], NULL);
-        free(patchEntries[i]);
-        free(specData[i]);
-        free(mapEntries[i]);
-        free(shaderCode[i]);
-    }
-    for (unsigned i = 0; i < GR_MAX_DESCRIPTOR_SETS; i++) {
-        free(pipelineDescriptorSlots[i]);
+        grShaderModuleCacheRelease(grDevice, shaderCode[i]);
     }
+    scratchRelease(scratchMark);
     return res;
 }
 
@@ -935,18 +2639,20 @@ GR_RESULT GR_STDCALL grCreateComputePipeline(
     VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
     VkShaderModule shaderModule = VK_NULL_HANDLE;
     VkPipeline vkPipeline = VK_NULL_HANDLE;
+    const ScratchMark scratchMark = scratchGetMark();
 
     uint32_t* specData = NULL;
     VkSpecializationMapEntry* mapEntries = NULL;
-    VkSpecializationInfo specInfo = { 0 };
+    VkSpecializationInfo specInfos[MAX_STAGE_COUNT] = { { 0 } };
     IlcBindingPatchEntry* patchEntries = NULL;
-    uint32_t* descriptorOffsets = NULL;
-    uint32_t* descriptorSetIndices = NULL;
 
     PipelineDescriptorSlot dynamicDescriptorSlot = { 0 };
     unsigned descriptorSetCounts[GR_MAX_DESCRIPTOR_SETS] = { 0 };
     PipelineDescriptorSlot* pipelineDescriptorSlots[GR_MAX_DESCRIPTOR_SETS] = { NULL };
 
+    PipelineStats stats = { 0 };
+    LONGLONG startTime;
+
     // TODO validate parameters
 
     Stage stage = { &pCreateInfo->cs, VK_SHADER_STAGE_COMPUTE_BIT };
@@ -956,18 +2662,17 @@ GR_RESULT GR_STDCALL grCreateComputePipeline(
         LOGW("link-time constant buffers are not implemented\n");
     }
     GrShader* grShader = (GrShader*)stage.shader->shader;
+    grShaderWaitCompilation(grShader);
 
-    patchEntries = malloc(sizeof(IlcBindingPatchEntry) * grShader->bindingCount);
-    mapEntries = malloc(grShader->bindingCount * 2 * sizeof(VkSpecializationMapEntry));
-    specData = malloc(sizeof(uint32_t) * 2 * grShader->bindingCount);
-    specInfo = (VkSpecializationInfo) {
+    patchEntries = scratchAlloc(sizeof(IlcBindingPatchEntry) * grShader->bindingCount);
+    mapEntries = scratchAlloc(grShader->bindingCount * 2 * sizeof(VkSpecializationMapEntry));
+    specData = scratchAlloc(sizeof(uint32_t) * 2 * grShader->bindingCount);
+    specInfos[0] = (VkSpecializationInfo) {
         .pData = specData,
         .pMapEntries = mapEntries,
         .dataSize = sizeof(uint32_t) * grShader->bindingCount * 2,
         .mapEntryCount = grShader->bindingCount * 2,
     };
-    descriptorOffsets = specData;
-    descriptorSetIndices = &specData[grShader->bindingCount];
 
     for (unsigned j = 0; j < grShader->bindingCount; ++j) {
         mapEntries[j * 2] = (VkSpecializationMapEntry) {
@@ -981,41 +2686,26 @@ GR_RESULT GR_STDCALL grCreateComputePipeline(
             .size = sizeof(uint32_t)
         };
     }
-    bool dynamicMappingUsed = handleDynamicDescriptorSlots(
-        &dynamicDescriptorSlot,
-        &stage.shader->dynamicMemoryViewMapping,
-        grDevice->descriptorBufferSupported,
-        grShader->bindingCount, grShader->bindings,
-        specData,
-        &specData[grShader->bindingCount],
-        patchEntries);
-
-    unsigned descriptorSetCount = 0;
-    for (unsigned i = 0; i < GR_MAX_DESCRIPTOR_SETS; i++) {
-        getDescriptorSlotMappings(&descriptorSetCounts[i], &pipelineDescriptorSlots[i],
-                                  grDevice, 1, &stage, &patchEntries, &descriptorOffsets, &descriptorSetIndices, i,
-                                  descriptorSetCount + (grDevice->descriptorBufferSupported ? DESCRIPTOR_BUFFERS_BASE_DESCRIPTOR_SET_ID : DESCRIPTOR_SET_ID));
-        descriptorSetCount += descriptorSetCounts[i];
-    }
+    bool dynamicMappingUsed = resolveDescriptorMappings(&dynamicDescriptorSlot, descriptorSetCounts,
+                                                        pipelineDescriptorSlots, grDevice,
+                                                        1, &stage, &patchEntries, &specData);
 
-    void* code = malloc(grShader->codeSize);
-    memcpy(code, grShader->code, grShader->codeSize);
-
-    const VkShaderModuleCreateInfo createInfo = {
-        .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-        .pNext = NULL,
-        .flags = 0,
-        .codeSize = grShader->codeSize,
-        .pCode = code,
-    };
+    void* code = NULL;
+    void* patchedCode = scratchAlloc(grShader->codeSize);
+    memcpy(patchedCode, grShader->code, grShader->codeSize);
 
+    startTime = grPipelineStatsGetTime();
     patchShaderBindings(
-        code,
+        patchedCode,
         grShader->codeSize,
         patchEntries,
         grShader->bindingCount);
+    stats.patchTime = grPipelineStatsGetTime() - startTime;
 
-    vkRes = VKD.vkCreateShaderModule(grDevice->device, &createInfo, NULL, &shaderModule);
+    startTime = grPipelineStatsGetTime();
+    vkRes = grShaderModuleCacheAcquire(grDevice, patchedCode, grShader->codeSize,
+                                       &code, &shaderModule);
+    stats.shaderModuleTime = grPipelineStatsGetTime() - startTime;
 
     if (vkRes != VK_SUCCESS) {
         res = getGrResult(vkRes);
@@ -1029,10 +2719,10 @@ GR_RESULT GR_STDCALL grCreateComputePipeline(
         .stage = stage.flags,
         .module = shaderModule,
         .pName = "main",
-        .pSpecializationInfo = &specInfo,
+        .pSpecializationInfo = &specInfos[0],
     };
 
-    descriptorSetCount = 0;
+    unsigned descriptorSetCount = 0;
     for (unsigned i = 0; i < GR_MAX_DESCRIPTOR_SETS; i++) {
         descriptorSetCount += descriptorSetCounts[i];
     }
@@ -1042,9 +2732,19 @@ GR_RESULT GR_STDCALL grCreateComputePipeline(
         goto bail;
     }
 
+    VkPipelineCreationFeedback feedback = { 0 };
+
+    const VkPipelineCreationFeedbackCreateInfo feedbackCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO,
+        .pNext = NULL,
+        .pPipelineCreationFeedback = &feedback,
+        .pipelineStageCreationFeedbackCount = 0,
+        .pPipelineStageCreationFeedbacks = NULL,
+    };
+
     const VkComputePipelineCreateInfo pipelineCreateInfo = {
         .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
-        .pNext = NULL,
+        .pNext = &feedbackCreateInfo,
         .flags = ((pCreateInfo->flags & GR_PIPELINE_CREATE_DISABLE_OPTIMIZATION) != 0 ?
                   VK_PIPELINE_CREATE_DISABLE_OPTIMIZATION_BIT : 0) |
         (grDevice->descriptorBufferSupported ? VK_PIPELINE_CREATE_DESCRIPTOR_BUFFER_BIT_EXT : 0),
@@ -1054,15 +2754,19 @@ GR_RESULT GR_STDCALL grCreateComputePipeline(
         .basePipelineIndex = 0,
     };
 
-    vkRes = VKD.vkCreateComputePipelines(grDevice->device, VK_NULL_HANDLE, 1, &pipelineCreateInfo,
+    AcquireSRWLockShared(&grDevice->pipelineCacheLock);
+    vkRes = VKD.vkCreateComputePipelines(grDevice->device, grDevice->pipelineCache, 1, &pipelineCreateInfo,
                                          NULL, &vkPipeline);
+    ReleaseSRWLockShared(&grDevice->pipelineCacheLock);
     if (vkRes != VK_SUCCESS) {
         LOGE("vkCreateComputePipelines failed (%d)\n", vkRes);
         res = getGrResult(vkRes);
         goto bail;
     }
 
-    GrPipeline* grPipeline = malloc(sizeof(GrPipeline));
+    grPipelineStatsAddFeedback(&stats, &feedback);
+
+    GrPipeline* grPipeline = malloc(getPipelineDataSize(NULL, specInfos, descriptorSetCounts));
     *grPipeline = (GrPipeline) {
         .grObj = { GR_OBJ_TYPE_PIPELINE, grDevice },
         .shaderModules = { shaderModule },
@@ -1070,47 +2774,57 @@ GR_RESULT GR_STDCALL grCreateComputePipeline(
         .shaderCodeSizes = { grShader->codeSize },
         .createFlags = pipelineCreateInfo.flags,
         .createInfo = NULL,
+        .compileJob = { 0 },
         .pipeline = vkPipeline,
+        .pipelineDepthFormat = VK_FORMAT_UNDEFINED,
+        .pipelineStencilFormat = VK_FORMAT_UNDEFINED,
+        .preRasterizationLibrary = VK_NULL_HANDLE,
+        .fragmentShaderLibrary = VK_NULL_HANDLE,
+        .vertexInputLibrary = VK_NULL_HANDLE,
+        .optimizeJob = { 0 },
+        .optimizedPipelineReady = 0,
+        .optimizedPipeline = VK_NULL_HANDLE,
+        .variantLock = SRWLOCK_INIT,
+        .variantCount = 0,
+        .variants = NULL,
+        .shaders = { VK_NULL_HANDLE },
+        .storedCacheDataLock = SRWLOCK_INIT,
+        .storedCacheDataBuilt = false,
+        .storedCacheData = NULL,
+        .storedCacheDataSize = 0,
         .pipelineLayout = pipelineLayout,
+        .manifestEntry = NULL, // Initialized below
+        .stats = NULL, // Initialized below
         .stageCount = 1,
         .dynamicMappingUsed = dynamicMappingUsed,
         .dynamicDescriptorSlot = dynamicDescriptorSlot,
         .descriptorSetCounts = { 0 }, // Initialized below
         .descriptorSlots = { NULL }, // Initialized below
+        .specInfos = { { 0 } }, // Initialized below
+        .specData = { NULL }, // Initialized below
+        .mapEntries = { NULL }, // Initialized below
     };
 
     memcpy(grPipeline->descriptorSetCounts, descriptorSetCounts,
            sizeof(grPipeline->descriptorSetCounts));
-    memcpy(grPipeline->descriptorSlots, pipelineDescriptorSlots,
-           sizeof(grPipeline->descriptorSlots));
-    memcpy(grPipeline->specInfos, &specInfo,
-           sizeof(specInfo));
-    grPipeline->specData[0] = specData;
-    grPipeline->mapEntries[0] = mapEntries;
-    free(patchEntries);
+
+    initPipelineData(grPipeline, NULL, specInfos, pipelineDescriptorSlots);
+    scratchRelease(scratchMark);
+
+    stats.isGraphics = false;
+    grPipeline->stats = grPipelineStatsAdd(grDevice, &stats, 1, (const GrShader* const*)&grShader);
+    grPipelineManifestRecord(grDevice, grPipeline);
 
     *pPipeline = (GR_PIPELINE)grPipeline;
     return GR_SUCCESS;
 
 bail:
-    free(code);
-    free(patchEntries);
-    free(specData);
-    free(mapEntries);
-    for (unsigned i = 0; i < GR_MAX_DESCRIPTOR_SETS; i++) {
-        free(pipelineDescriptorSlots[i]);
-    }
-    VKD.vkDestroyPipelineLayout(grDevice->device, pipelineLayout, NULL);
-    VKD.vkDestroyShaderModule(grDevice->device, shaderModule, NULL);
+    grShaderModuleCacheRelease(grDevice, code);
+    scratchRelease(scratchMark);
     return res;
 }
 
 
-#define CAST_CHUNK_BASE(blob) ((GrBaseBlobChunk *)((blob)->data))
-#define CAST_CHUNK_DATA(chunk, type) ((type*)((chunk)->data))
-#define align(size, base) ((size) + (base) - 1) & ~((base)-1)
-#define GR_CHUNK_ALIGNMENT 4
-
 GR_RESULT GR_STDCALL grStorePipeline(
     GR_PIPELINE pipeline,
     GR_SIZE* pDataSize,
@@ -1121,151 +2835,22 @@ GR_RESULT GR_STDCALL grStorePipeline(
 
     if (!pDataSize) return GR_ERROR_INVALID_POINTER;
     GrPipeline* grPipeline = (GrPipeline*)pipeline;
-    const GrDevice* grDevice = GET_OBJ_DEVICE(grPipeline);
-
-    GR_SIZE sz = sizeof(GrStoredPipelineBlob);
-    for (unsigned i = 0; i < MAX_STAGE_COUNT; i++) {
-        if (grPipeline->shaderCode[i] != NULL) {
-            sz += align(sizeof(GrBaseBlobChunk) + sizeof(GrSpirvBlobChunk) + grPipeline->shaderCodeSizes[i], GR_CHUNK_ALIGNMENT);
-        }
-        if (grPipeline->specInfos[i].mapEntryCount > 0) {
-            sz += align(sizeof(GrBaseBlobChunk) + sizeof(GrSpecInfoMapEntryBlobChunk) + grPipeline->specInfos[i].mapEntryCount * sizeof(VkSpecializationMapEntry), GR_CHUNK_ALIGNMENT);
-        }
-        if (grPipeline->specInfos[i].dataSize > 0) {
-            sz += align(sizeof(GrBaseBlobChunk) + sizeof(GrSpecInfoDataBlobChunk) + grPipeline->specInfos[i].dataSize, GR_CHUNK_ALIGNMENT);
-        }
-    }
-
-    unsigned descriptorSetCount = 0;
-    for (unsigned i = 0; i < GR_MAX_DESCRIPTOR_SETS; i++) {
-        descriptorSetCount += grPipeline->descriptorSetCounts[i];
-    }
-
-    if (descriptorSetCount > 0) {
-        sz += align(sizeof(GrBaseBlobChunk) + sizeof(GrPipelineDescriptorChunk) + descriptorSetCount * sizeof(PipelineDescriptorSlot), GR_CHUNK_ALIGNMENT);
-    }
-
-    if (grPipeline->createInfo != NULL) {
-        sz += align(sizeof(GrBaseBlobChunk) + sizeof(GrGraphicsPipelineInfoChunk), GR_CHUNK_ALIGNMENT);
-    }
+    GrStoredPipelineBlob header;
+    size_t pipelineCacheDataSize = 0;
 
-    sz += align(sizeof(GrBaseBlobChunk) + sizeof(GrPipelineInfoChunk), GR_CHUNK_ALIGNMENT);
+    const void* pipelineCacheData = getPipelineCacheData(grPipeline, &pipelineCacheDataSize);
+    uint32_t sz = initStoredPipelineBlob(&header, grPipeline, pipelineCacheDataSize);
 
-    LOGT("calculated %d bytes for pipeline %p\n", sz, grPipeline);
-    if (pData != NULL && *pDataSize < sz) {
+    LOGT("calculated %u bytes for pipeline %p\n", sz, grPipeline);
+    if (pData == NULL) {
+        *pDataSize = sz;
+        return GR_SUCCESS;
+    } else if (*pDataSize < sz) {
         return GR_ERROR_INVALID_MEMORY_SIZE;
     }
 
-    if (pData != NULL) {
-        GrStoredPipelineBlob* blob = (GrStoredPipelineBlob*)pData;
-        blob->version = 0;
-        blob->driverId = grDevice->vendorId;
-
-        GrBaseBlobChunk* chunk = CAST_CHUNK_BASE(blob);
-
-        chunk->type = PIPELINE_INFO;
-        chunk->size = sizeof(GrPipelineInfoChunk);
-
-        GrPipelineInfoChunk* pipelineChunk = CAST_CHUNK_DATA(chunk, GrPipelineInfoChunk);
-        *pipelineChunk = (GrPipelineInfoChunk) {
-            .createFlags = grPipeline->createFlags & ~(VK_PIPELINE_CREATE_DESCRIPTOR_BUFFER_BIT_EXT),
-            .stageCount = grPipeline->stageCount,
-            .dynamicMappingUsed = grPipeline->dynamicMappingUsed,
-            .dynamicDescriptorSlot = { }, // initialized below
-        };
-
-        memcpy(&pipelineChunk->dynamicDescriptorSlot, &grPipeline->dynamicDescriptorSlot, sizeof(grPipeline->dynamicDescriptorSlot));
-
-        chunk = (GrBaseBlobChunk*)&chunk->data[align(chunk->size, GR_CHUNK_ALIGNMENT)];
-
-        if (grPipeline->createInfo != NULL) {
-            chunk->type = GRAPHICS_PIPELINE_INFO;
-            chunk->size = sizeof(GrGraphicsPipelineInfoChunk);
-
-            GrGraphicsPipelineInfoChunk* graphicsPipelineChunk = CAST_CHUNK_DATA(chunk, GrGraphicsPipelineInfoChunk);
-            *graphicsPipelineChunk = (GrGraphicsPipelineInfoChunk) {
-                .topology = grPipeline->createInfo->topology,
-                .patchControlPoints = grPipeline->createInfo->patchControlPoints,
-                .depthClipEnable = grPipeline->createInfo->depthClipEnable,
-                .alphaToCoverageEnable = grPipeline->createInfo->alphaToCoverageEnable,
-                .logicOpEnable = grPipeline->createInfo->logicOpEnable,
-                .logicOp = grPipeline->createInfo->logicOp,
-                .colorFormats = { }, // written below
-                .colorWriteMasks = { }, // written below
-                .depthFormat = grPipeline->createInfo->depthFormat,
-                .stencilFormat = grPipeline->createInfo->stencilFormat,
-            };
-
-            memcpy(graphicsPipelineChunk->colorFormats, grPipeline->createInfo->colorFormats, sizeof(grPipeline->createInfo->colorFormats));
-            memcpy(graphicsPipelineChunk->colorWriteMasks, grPipeline->createInfo->colorWriteMasks, sizeof(grPipeline->createInfo->colorWriteMasks));
-
-            chunk = (GrBaseBlobChunk*)&chunk->data[align(chunk->size, GR_CHUNK_ALIGNMENT)];
-            LOGT("gp info offset is %p %d\n", (uint8_t*)chunk - (uint8_t*)pData, sz);
-        }
-
-        if (descriptorSetCount > 0) {
-            chunk->type = DESCRIPTOR_SLOTS;
-            chunk->size = sizeof(GrPipelineDescriptorChunk) + descriptorSetCount * sizeof(PipelineDescriptorSlot);
-
-            GrPipelineDescriptorChunk* descriptorChunk = CAST_CHUNK_DATA(chunk, GrPipelineDescriptorChunk);
-            memcpy(descriptorChunk->descriptorSetCounts, grPipeline->descriptorSetCounts, sizeof(grPipeline->descriptorSetCounts));
-            unsigned descriptorIndex = 0;
-            for (unsigned i = 0; i < GR_MAX_DESCRIPTOR_SETS; i++) {
-                memcpy(&descriptorChunk->data[descriptorIndex], grPipeline->descriptorSlots[i],
-                       sizeof(PipelineDescriptorSlot) * grPipeline->descriptorSetCounts[i]);
-                descriptorIndex += grPipeline->descriptorSetCounts[i];
-            }
-
-            chunk = (GrBaseBlobChunk*)&chunk->data[align(chunk->size, GR_CHUNK_ALIGNMENT)];
-            LOGT("descriptor offset is %p %d\n", (uint8_t*)chunk - (uint8_t*)pData, sz);
-        }
-
-        for (unsigned i = 0; i < MAX_STAGE_COUNT; i++) {
-            if (grPipeline->shaderCode[i] != NULL) {
-                chunk->type = SPIRV;
-                chunk->size = sizeof(GrSpirvBlobChunk) + grPipeline->shaderCodeSizes[i];
-
-                GrSpirvBlobChunk* shaderChunk = CAST_CHUNK_DATA(chunk, GrSpirvBlobChunk);
-                shaderChunk->stageIndex = i;
-                shaderChunk->stageFlags = grPipeline->createInfo == NULL ? VK_SHADER_STAGE_COMPUTE_BIT : grPipeline->createInfo->stageCreateInfos[i].stage;
-                shaderChunk->codeSize = grPipeline->shaderCodeSizes[i];
-                memcpy(shaderChunk->code, grPipeline->shaderCode[i], grPipeline->shaderCodeSizes[i]);
-
-                chunk = (GrBaseBlobChunk*)&chunk->data[align(chunk->size, GR_CHUNK_ALIGNMENT)];
-                LOGT("spirv offset is %p %d\n", (uint8_t*)chunk - (uint8_t*)pData, sz);
-            }
-            if (grPipeline->specInfos[i].dataSize > 0) {
-                chunk->type = SPEC_INFO;
-                chunk->size = sizeof(GrSpecInfoDataBlobChunk) + grPipeline->specInfos[i].dataSize;
-
-                GrSpecInfoDataBlobChunk* dataChunk = CAST_CHUNK_DATA(chunk, GrSpecInfoDataBlobChunk);
-                dataChunk->stageIndex = i;
-                dataChunk->dataSize = grPipeline->specInfos[i].dataSize;
-                memcpy(&dataChunk->data, grPipeline->specData[i], grPipeline->specInfos[i].dataSize);
-
-                chunk = (GrBaseBlobChunk*)&chunk->data[align(chunk->size, GR_CHUNK_ALIGNMENT)];
-                LOGT("specinfo offset is %p %d\n", (uint8_t*)chunk - (uint8_t*)pData, sz);
-            }
-            if (grPipeline->specInfos[i].mapEntryCount > 0) {
-                LOGT("storing spec map %d %d\n", i, grPipeline->specInfos[i].mapEntryCount);
-                chunk->type = SPEC_INFO_ENTRIES;
-                chunk->size = sizeof(GrSpecInfoMapEntryBlobChunk) + grPipeline->specInfos[i].mapEntryCount * sizeof(VkSpecializationMapEntry);
-
-                GrSpecInfoMapEntryBlobChunk* entryChunk = CAST_CHUNK_DATA(chunk, GrSpecInfoMapEntryBlobChunk);
-                entryChunk->stageIndex = i;
-                entryChunk->mapEntryCount = grPipeline->specInfos[i].mapEntryCount;
-                memcpy(&entryChunk->data, grPipeline->mapEntries[i], grPipeline->specInfos[i].mapEntryCount * sizeof(VkSpecializationMapEntry));
-
-                chunk = (GrBaseBlobChunk*)&chunk->data[align(chunk->size, GR_CHUNK_ALIGNMENT)];
-                LOGT("spec map offset is %p %d %d\n", (uint8_t*)chunk - (uint8_t*)pData, sz, i);
-            }
-        }
-        LOGT("offset is %p %d\n", (uint8_t*)chunk - (uint8_t*)pData, sz);
-        /* calculate CRC32 */
-        blob->checksum = crc32_fast(blob->data, *pDataSize - sizeof(*blob), 0);
-    } else {
-        *pDataSize = sz;
-    }
+    writeStoredPipelineBlob(pData, &header, grPipeline, pipelineCacheData);
+    *pDataSize = sz;
 
     return GR_SUCCESS;
 #else
@@ -1285,307 +2870,197 @@ GR_RESULT GR_STDCALL grLoadPipeline(
 #ifdef PIPELINE_CACHE
     LOGT("%p %d %p %p\n", device, dataSize, pData, pPipeline);
     GrDevice* grDevice = (GrDevice*)device;
-    // validate it first
-    if (dataSize <= (sizeof(GrStoredPipelineBlob) + sizeof(GrBaseBlobChunk))) {
-        return GR_ERROR_INVALID_MEMORY_SIZE;
-    }
     if (pData == NULL) {
         return GR_ERROR_INVALID_POINTER;
     }
 
-    GrStoredPipelineBlob* blob = (GrStoredPipelineBlob*)pData;
-    /* TODO: validate chunks */
-    GR_SIZE sz = sizeof(GrStoredPipelineBlob);
-    GrBaseBlobChunk* chunk = CAST_CHUNK_BASE(blob);
+    // The blob is used in place, only what the pipeline keeps around gets copied
+    const GrStoredPipelineBlob* blob = pData;
+    const uint8_t* data = pData;
 
-    GR_RESULT res = GR_ERROR_BAD_PIPELINE_DATA;
-    unsigned checksum = crc32_fast(blob->data, dataSize - sizeof(*blob), 0);
-    if (checksum != blob->checksum) {
-        LOGE("checksum mismatch, expected 0x%X, got 0x%X\n", blob->checksum, checksum);
-        return GR_ERROR_BAD_PIPELINE_DATA;
-    }
-    /* chunk size validation */
-    while (sz < dataSize) {
-        if ((sz + chunk->size + sizeof(GrBaseBlobChunk)) > dataSize) {
-            return GR_ERROR_INVALID_MEMORY_SIZE;
-        }
-        switch (chunk->type) {
-        case SPIRV: {
-            GrSpirvBlobChunk* shaderChunk = CAST_CHUNK_DATA(chunk, GrSpirvBlobChunk);
-            if ((shaderChunk->codeSize + sizeof(GrSpirvBlobChunk)) > chunk->size) {
-                LOGE("incorrect shader size\n");
-                return GR_ERROR_INVALID_MEMORY_SIZE;
-            }
-            break;
-        }
-        case SPEC_INFO: {
-            GrSpecInfoDataBlobChunk* dataChunk = CAST_CHUNK_DATA(chunk, GrSpecInfoDataBlobChunk);
-            if ((dataChunk->dataSize + sizeof(GrSpecInfoDataBlobChunk)) > chunk->size) {
-                LOGE("incorrect spec info size\n");
-                return GR_ERROR_INVALID_MEMORY_SIZE;
-            }
-            break;
-        }
-        case SPEC_INFO_ENTRIES: {
-            GrSpecInfoMapEntryBlobChunk* dataChunk = CAST_CHUNK_DATA(chunk, GrSpecInfoMapEntryBlobChunk);
-            if ((sizeof(GrSpecInfoMapEntryBlobChunk) + dataChunk->mapEntryCount * sizeof(VkSpecializationMapEntry)) > chunk->size) {
-                LOGE("incorrect spec map entries size\n");
-                return GR_ERROR_INVALID_MEMORY_SIZE;
-            }
-            break;
-        }
-        case DESCRIPTOR_SLOTS: {
-            const GrPipelineDescriptorChunk* dataChunk = CAST_CHUNK_DATA(chunk, GrPipelineDescriptorChunk);
-            unsigned descriptorSetCount = 0;
-            for (unsigned i = 0; i < GR_MAX_DESCRIPTOR_SETS; i++) {
-                descriptorSetCount += dataChunk->descriptorSetCounts[i];
-            }
-            if ((sizeof(GrPipelineDescriptorChunk) + descriptorSetCount * sizeof(PipelineDescriptorSlot)) > chunk->size) {
-                LOGE("incorrect descriptor sets size\n");
-                return GR_ERROR_INVALID_MEMORY_SIZE;
-            }
-            break;
-        }
-        case GRAPHICS_PIPELINE_INFO: {
-            if (chunk->size != sizeof(GrGraphicsPipelineInfoChunk)) {
-                LOGE("incorrect graphics pipeline info size\n");
-                return GR_ERROR_INVALID_MEMORY_SIZE;
-            }
-            break;
-        }
-        case PIPELINE_INFO: {
-            if (chunk->size != sizeof(GrPipelineInfoChunk)) {
-                LOGE("incorrect pipeline info size\n");
-                return GR_ERROR_INVALID_MEMORY_SIZE;
-            }
-            break;
-        }
-        }
-        sz += align(sizeof(GrBaseBlobChunk) + chunk->size, GR_CHUNK_ALIGNMENT);
-        chunk = (GrBaseBlobChunk*)&chunk->data[align(chunk->size, GR_CHUNK_ALIGNMENT)];
+    GR_RESULT res = validateStoredPipelineBlob(grDevice, pData, dataSize);
+    if (res != GR_SUCCESS) {
+        return res;
     }
 
-    LOGT("size is correct\n");
-    if (blob->driverId != grDevice->vendorId) {
-        return GR_ERROR_INCOMPATIBLE_DEVICE;
+    if (blob->pipelineCacheData.size > 0 &&
+        !grPipelineCacheMerge(grDevice, &data[blob->pipelineCacheData.offset],
+                              blob->pipelineCacheData.size)) {
+        LOGW("ignoring stored pipeline cache data\n");
     }
+
+    res = GR_ERROR_BAD_PIPELINE_DATA;
     /* shader code */
     VkShaderModule shaderModules[MAX_STAGE_COUNT] = { VK_NULL_HANDLE };
     void* shaderCode[MAX_STAGE_COUNT] = { NULL };
     unsigned shaderCodeSizes[MAX_STAGE_COUNT] = { 0 };
-    VkShaderStageFlags stageFlags[MAX_STAGE_COUNT] = { 0 };
     /* descriptor slots */
-    unsigned descriptorSetCounts[GR_MAX_DESCRIPTOR_SETS] = { 0, 0 };
     PipelineDescriptorSlot* descriptorSlots[GR_MAX_DESCRIPTOR_SETS] = { NULL };
     /* spec info */
     VkSpecializationInfo specInfos[MAX_STAGE_COUNT] = {};
-    void* specData[MAX_STAGE_COUNT] = { NULL };
-    VkSpecializationMapEntry* mapEntries[MAX_STAGE_COUNT] = { NULL };
     /*  */
+    PipelineCreateInfo graphicsCreateInfo;
     PipelineCreateInfo* createInfo = NULL;
-    unsigned stageCount = 0;
-    bool dynamicMappingUsed = FALSE;
-    PipelineDescriptorSlot dynamicDescriptorSlot = {};
-    VkPipelineCreateFlags pipelineCreateFlags = 0;
+    unsigned stageCount = blob->stageCount;
     VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
     VkPipeline vkPipeline = VK_NULL_HANDLE;
     GrPipeline* grPipeline = NULL;
-
-    chunk = CAST_CHUNK_BASE(blob);
-    sz = sizeof(GrStoredPipelineBlob);
-    while (sz < dataSize) {
-        switch (chunk->type) {
-        case SPIRV: {
-            GrSpirvBlobChunk* shaderChunk = CAST_CHUNK_DATA(chunk, GrSpirvBlobChunk);
-            if (shaderChunk->stageIndex >= MAX_STAGE_COUNT || stageFlags[shaderChunk->stageIndex] != 0) {
-                goto bail;
-            }
-            stageFlags[shaderChunk->stageIndex] = shaderChunk->stageFlags;
-            shaderCode[shaderChunk->stageIndex] = malloc(shaderChunk->codeSize);
-            shaderCodeSizes[shaderChunk->stageIndex] = shaderChunk->codeSize;
-            memcpy(shaderCode[shaderChunk->stageIndex], &shaderChunk->code, shaderCodeSizes[shaderChunk->stageIndex]);
-            break;
-        }
-        case SPEC_INFO: {
-            GrSpecInfoDataBlobChunk* dataChunk = CAST_CHUNK_DATA(chunk, GrSpecInfoDataBlobChunk);
-            // TODO: move to validation
-            if (dataChunk->stageIndex >= MAX_STAGE_COUNT) {
-                goto bail;
-            }
-            unsigned index = dataChunk->stageIndex;
-            specData[index] = malloc(dataChunk->dataSize);
-            memcpy(specData[index], &dataChunk->data, dataChunk->dataSize);
-            specInfos[index].dataSize = dataChunk->dataSize;
-            specInfos[index].pData = specData[index];
-            break;
-        }
-        case SPEC_INFO_ENTRIES: {
-            GrSpecInfoMapEntryBlobChunk* dataChunk = CAST_CHUNK_DATA(chunk, GrSpecInfoMapEntryBlobChunk);
-            if (dataChunk->stageIndex >= MAX_STAGE_COUNT) {
-                goto bail;
-            }
-            unsigned index = dataChunk->stageIndex;
-            mapEntries[index] = malloc(dataChunk->mapEntryCount * sizeof(VkSpecializationMapEntry));
-            memcpy(mapEntries[index], &dataChunk->data, dataChunk->mapEntryCount * sizeof(VkSpecializationMapEntry));
-            specInfos[index].mapEntryCount = dataChunk->mapEntryCount;
-            specInfos[index].pMapEntries = mapEntries[index];
-            break;
-        }
-        case DESCRIPTOR_SLOTS: {
-            const GrPipelineDescriptorChunk* dataChunk = CAST_CHUNK_DATA(chunk, GrPipelineDescriptorChunk);
-            unsigned descriptorSetIndex = 0;
-            for (unsigned i = 0; i < GR_MAX_DESCRIPTOR_SETS; i++) {
-                if (dataChunk->descriptorSetCounts[i] > 0) {
-                    descriptorSlots[i] = malloc(dataChunk->descriptorSetCounts[i] * sizeof(PipelineDescriptorSlot));
-                    descriptorSetCounts[i] = dataChunk->descriptorSetCounts[i];
-                    memcpy(descriptorSlots[i], &dataChunk->data[descriptorSetIndex], dataChunk->descriptorSetCounts[i] * sizeof(PipelineDescriptorSlot));
-                }
-                descriptorSetIndex += dataChunk->descriptorSetCounts[i];
-            }
-            break;
-        }
-        case GRAPHICS_PIPELINE_INFO: {
-            if (createInfo != NULL) {
-                goto bail;
-            }
-            createInfo = malloc(sizeof(PipelineCreateInfo));
-            GrGraphicsPipelineInfoChunk* graphicsPipelineChunk = CAST_CHUNK_DATA(chunk, GrGraphicsPipelineInfoChunk);
-            *createInfo = (PipelineCreateInfo) {
-                .stageCreateInfos = { { 0 } }, // Initialized later
-                .topology = graphicsPipelineChunk->topology,
-                .patchControlPoints = graphicsPipelineChunk->patchControlPoints,
-                .depthClipEnable = graphicsPipelineChunk->depthClipEnable,
-                .alphaToCoverageEnable = graphicsPipelineChunk->alphaToCoverageEnable,
-                .logicOpEnable = graphicsPipelineChunk->logicOpEnable,
-                .logicOp = graphicsPipelineChunk->logicOp,
-                .colorFormats = { 0 }, // written below
-                .colorWriteMasks = { 0 }, // written below
-                .depthFormat = graphicsPipelineChunk->depthFormat,
-                .stencilFormat = graphicsPipelineChunk->stencilFormat,
-            };
-
-            memcpy(createInfo->colorFormats, graphicsPipelineChunk->colorFormats, sizeof(createInfo->colorFormats));
-            memcpy(createInfo->colorWriteMasks, graphicsPipelineChunk->colorWriteMasks, sizeof(createInfo->colorWriteMasks));
-
-            break;
-        }
-        case PIPELINE_INFO: {
-            GrPipelineInfoChunk* pipelineInfoChunk = CAST_CHUNK_DATA(chunk, GrPipelineInfoChunk);
-            stageCount = pipelineInfoChunk->stageCount;
-            dynamicMappingUsed = pipelineInfoChunk->dynamicMappingUsed;
-            pipelineCreateFlags = pipelineInfoChunk->createFlags;
-            memcpy(&dynamicDescriptorSlot, &pipelineInfoChunk->dynamicDescriptorSlot, sizeof(dynamicDescriptorSlot));
-            break;
-        }
-        }
-        sz += align(sizeof(GrBaseBlobChunk) + chunk->size, GR_CHUNK_ALIGNMENT);
-        chunk = (GrBaseBlobChunk*)&chunk->data[align(chunk->size, GR_CHUNK_ALIGNMENT)];
+    PipelineStats stats = { 0 };
+    LONGLONG startTime;
+    VkPipelineCreateFlags pipelineCreateFlags = blob->createFlags |
+        (grDevice->descriptorBufferSupported ? VK_PIPELINE_CREATE_DESCRIPTOR_BUFFER_BIT_EXT : 0);
+
+    // Slots and spec data are read from the blob, the pipeline gets its own copy when allocated
+    PipelineDescriptorSlot* storedSlots =
+        (PipelineDescriptorSlot*)&data[blob->descriptorSlots.offset];
+    unsigned descriptorSetCount = 0;
+    for (unsigned i = 0; i < GR_MAX_DESCRIPTOR_SETS; i++) {
+        descriptorSlots[i] = &storedSlots[descriptorSetCount];
+        descriptorSetCount += blob->descriptorSetCounts[i];
     }
 
-    LOGT("chunks loaded\n");
+    if (blob->isGraphics) {
+        const GrStoredGraphicsPipelineInfo* graphicsInfo = &blob->graphicsInfo;
+
+        createInfo = &graphicsCreateInfo;
+        *createInfo = (PipelineCreateInfo) {
+            .stageCreateInfos = { { 0 } }, // Initialized later
+            .topology = graphicsInfo->topology,
+            .patchControlPoints = graphicsInfo->patchControlPoints,
+            .depthClipEnable = graphicsInfo->depthClipEnable,
+            .alphaToCoverageEnable = graphicsInfo->alphaToCoverageEnable,
+            .logicOpEnable = graphicsInfo->logicOpEnable,
+            .logicOp = graphicsInfo->logicOp,
+            .colorFormats = { 0 }, // written below
+            .colorWriteMasks = { 0 }, // written below
+            .depthFormat = graphicsInfo->depthFormat,
+            .stencilFormat = graphicsInfo->stencilFormat,
+        };
 
-    if (createInfo != NULL) {
-        for (int i = 0; i < stageCount; i++) {
-            if (shaderCode[i] == NULL || stageFlags[i] == 0) {
-                goto bail;
-            }
-            if ((specInfos[i].mapEntryCount > 0) ^ (specInfos[i].dataSize > 0)) {
-                goto bail;
-            }
-        }
-    } else if (stageCount != 1 || stageFlags[0] != VK_SHADER_STAGE_COMPUTE_BIT) {
-        goto bail;
+        memcpy(createInfo->colorFormats, graphicsInfo->colorFormats, sizeof(createInfo->colorFormats));
+        memcpy(createInfo->colorWriteMasks, graphicsInfo->colorWriteMasks, sizeof(createInfo->colorWriteMasks));
     }
 
     VkPipelineShaderStageCreateInfo computeStageInfo;
 
-    for (int i = 0; i < stageCount; i++) {
-        /* TODO: validate spec infos */
-        if (shaderCode[i] == NULL || stageFlags[i] == 0) {
+    for (unsigned i = 0; i < stageCount; i++) {
+        const GrStoredPipelineStage* stage = &blob->stages[i];
+
+        // The SPIR-V is handed to the shader module cache straight from the blob
+        startTime = grPipelineStatsGetTime();
+        VkResult vkRes = grShaderModuleCacheAcquire(grDevice, &data[stage->code.offset],
+                                                    stage->code.size,
+                                                    &shaderCode[i], &shaderModules[i]);
+        stats.shaderModuleTime += grPipelineStatsGetTime() - startTime;
+        if (vkRes != VK_SUCCESS) {
+            res = GR_ERROR_BAD_PIPELINE_DATA;
             goto bail;
         }
+        shaderCodeSizes[i] = stage->code.size;
+
+        specInfos[i] = (VkSpecializationInfo) {
+            .mapEntryCount = stage->mapEntryCount,
+            .pMapEntries = (const VkSpecializationMapEntry*)&data[stage->mapEntries.offset],
+            .dataSize = stage->specData.size,
+            .pData = &data[stage->specData.offset],
+        };
 
-        const VkShaderModuleCreateInfo shaderCreateInfo = {
-            .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+        const VkPipelineShaderStageCreateInfo stageCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
             .pNext = NULL,
             .flags = 0,
-            .codeSize = shaderCodeSizes[i],
-            .pCode = shaderCode[i],
+            .stage = stage->stageFlags,
+            .module = shaderModules[i],
+            .pName = "main",
+            .pSpecializationInfo = &specInfos[i],
         };
-        VkResult vkRes = VKD.vkCreateShaderModule(grDevice->device, &shaderCreateInfo, NULL, &shaderModules[i]);
 
-        if (vkRes != VK_SUCCESS) {
-            res = GR_ERROR_BAD_PIPELINE_DATA;
-            goto bail;
-        }
         if (createInfo != NULL) {
-            createInfo->stageCreateInfos[i] = (VkPipelineShaderStageCreateInfo) {
-                .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-                .pNext = NULL,
-                .flags = 0,
-                .stage = stageFlags[i],
-                .module = shaderModules[i],
-                .pName = "main",
-                .pSpecializationInfo = &specInfos[i],
-            };
+            createInfo->stageCreateInfos[i] = stageCreateInfo;
         } else {
-            computeStageInfo = (VkPipelineShaderStageCreateInfo) {
-                .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-                .pNext = NULL,
-                .flags = 0,
-                .stage = stageFlags[i],
-                .module = shaderModules[i],
-                .pName = "main",
-                .pSpecializationInfo = &specInfos[i],
-            };
+            computeStageInfo = stageCreateInfo;
         }
     }
-    unsigned descriptorSetCount = 0;
-    for (unsigned i = 0; i < GR_MAX_DESCRIPTOR_SETS; i++) {
-        descriptorSetCount += descriptorSetCounts[i];
-    }
 
-    pipelineLayout = getVkPipelineLayout(grDevice, descriptorSetCount * (1 + grDevice->descriptorUseSingleDescriptor), VK_PIPELINE_BIND_POINT_COMPUTE);
+    pipelineLayout = getVkPipelineLayout(grDevice, descriptorSetCount * (1 + grDevice->descriptorUseSingleDescriptor),
+                                         createInfo != NULL ? VK_PIPELINE_BIND_POINT_GRAPHICS : VK_PIPELINE_BIND_POINT_COMPUTE);
     if (pipelineLayout == VK_NULL_HANDLE) {
         res = GR_ERROR_OUT_OF_MEMORY;
         goto bail;
     }
 
     if (createInfo == NULL) {
+        VkPipelineCreationFeedback feedback = { 0 };
+
+        const VkPipelineCreationFeedbackCreateInfo feedbackCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO,
+            .pNext = NULL,
+            .pPipelineCreationFeedback = &feedback,
+            .pipelineStageCreationFeedbackCount = 0,
+            .pPipelineStageCreationFeedbacks = NULL,
+        };
+
         const VkComputePipelineCreateInfo pipelineCreateInfo = {
             .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
-            .pNext = NULL,
-            .flags = pipelineCreateFlags |
-            (grDevice->descriptorBufferSupported ? VK_PIPELINE_CREATE_DESCRIPTOR_BUFFER_BIT_EXT : 0),
+            .pNext = &feedbackCreateInfo,
+            .flags = pipelineCreateFlags,
             .stage = computeStageInfo,
             .layout = pipelineLayout,
             .basePipelineHandle = VK_NULL_HANDLE,
             .basePipelineIndex = 0,
         };
 
-        VkResult vkRes = VKD.vkCreateComputePipelines(grDevice->device, VK_NULL_HANDLE, 1, &pipelineCreateInfo,
+        VkResult vkRes;
+
+        AcquireSRWLockShared(&grDevice->pipelineCacheLock);
+        vkRes = VKD.vkCreateComputePipelines(grDevice->device, grDevice->pipelineCache, 1, &pipelineCreateInfo,
                                              NULL, &vkPipeline);
+        ReleaseSRWLockShared(&grDevice->pipelineCacheLock);
         if (vkRes != VK_SUCCESS) {
             LOGE("vkCreateComputePipelines failed (%d)\n", vkRes);
             res = GR_ERROR_BAD_PIPELINE_DATA;
             goto bail;
         }
+
+        grPipelineStatsAddFeedback(&stats, &feedback);
     }
-    grPipeline = malloc(sizeof(GrPipeline));
+    grPipeline = malloc(getPipelineDataSize(createInfo, specInfos, blob->descriptorSetCounts));
     *grPipeline = (GrPipeline) {
         .grObj = { GR_OBJ_TYPE_PIPELINE, grDevice },
         .shaderModules = { VK_NULL_HANDLE },
         .shaderCode = { NULL },
         .shaderCodeSizes = { 0 },
         .createFlags = pipelineCreateFlags,
-        .createInfo = createInfo,
+        .createInfo = NULL, // Initialized below
+        .compileJob = { 0 }, // Initialized below
         .pipeline = vkPipeline,
+        .pipelineDepthFormat = VK_FORMAT_UNDEFINED, // Initialized below
+        .pipelineStencilFormat = VK_FORMAT_UNDEFINED, // Initialized below
+        .preRasterizationLibrary = VK_NULL_HANDLE,
+        .fragmentShaderLibrary = VK_NULL_HANDLE,
+        .vertexInputLibrary = VK_NULL_HANDLE,
+        .optimizeJob = { 0 },
+        .optimizedPipelineReady = 0,
+        .optimizedPipeline = VK_NULL_HANDLE,
+        .variantLock = SRWLOCK_INIT,
+        .variantCount = 0,
+        .variants = NULL,
+        .shaders = { VK_NULL_HANDLE },
+        .storedCacheDataLock = SRWLOCK_INIT,
+        .storedCacheDataBuilt = false,
+        .storedCacheData = NULL,
+        .storedCacheDataSize = 0,
         .pipelineLayout = pipelineLayout,
+        .manifestEntry = NULL,
+        .stats = NULL, // Initialized below
         .stageCount = stageCount,
-        .dynamicMappingUsed = dynamicMappingUsed,
-        .dynamicDescriptorSlot = dynamicDescriptorSlot,
+        .dynamicMappingUsed = blob->dynamicMappingUsed,
+        .dynamicDescriptorSlot = blob->dynamicDescriptorSlot,
         .descriptorSetCounts = { 0 }, // Initialized below
         .descriptorSlots = { NULL }, // Initialized below
+        .specInfos = { { 0 } }, // Initialized below
+        .specData = { NULL }, // Initialized below
+        .mapEntries = { NULL }, // Initialized below
     };
 
     memcpy(grPipeline->shaderModules, shaderModules,
@@ -1594,20 +3069,20 @@ GR_RESULT GR_STDCALL grLoadPipeline(
            sizeof(shaderCodeSizes));
     memcpy(grPipeline->shaderCode, shaderCode,
            sizeof(shaderCode));
-    memcpy(grPipeline->descriptorSetCounts, descriptorSetCounts,
+    memcpy(grPipeline->descriptorSetCounts, blob->descriptorSetCounts,
            sizeof(grPipeline->descriptorSetCounts));
-    memcpy(grPipeline->descriptorSlots, descriptorSlots,
-           sizeof(grPipeline->descriptorSlots));
-    memcpy(grPipeline->specInfos, specInfos,
-           sizeof(grPipeline->specInfos));
-    memcpy(grPipeline->mapEntries, mapEntries,
-           sizeof(grPipeline->mapEntries));
-    memcpy(grPipeline->specData, specData,
-           sizeof(grPipeline->specData));
+
+    initPipelineData(grPipeline, createInfo, specInfos, descriptorSlots);
+
+    // The shaders aren't known to the loaded pipeline, there's no IL translation to report
+    stats.isGraphics = createInfo != NULL;
+    stats.isLoaded = true;
+    grPipeline->stats = grPipelineStatsAdd(grDevice, &stats, 0, NULL);
+    grPipelineManifestRecord(grDevice, grPipeline);
+
     if (createInfo != NULL) {
-        for (uint32_t i = 0; i < MAX_STAGE_COUNT; i++) {
-            createInfo->stageCreateInfos[i].pSpecializationInfo = &grPipeline->specInfos[i];
-        }
+        threadPoolSubmit(grDevice->compilerPool, &grPipeline->compileJob,
+                         compileGraphicsPipeline, grPipeline);
     }
 
     *pPipeline = (GR_PIPELINE)grPipeline;
@@ -1617,19 +3092,10 @@ GR_RESULT GR_STDCALL grLoadPipeline(
 bail:
     LOGE("failed to load pipeline %d\n", res);
     for (unsigned i = 0; i < MAX_STAGE_COUNT; i++) {
-        VKD.vkDestroyShaderModule(grDevice->device, shaderModules[i], NULL);
-        free(shaderCode[i]);
-        free(specData[i]);
-        free(mapEntries[i]);
+        grShaderModuleCacheRelease(grDevice, shaderCode[i]);
     }
 
     VKD.vkDestroyPipeline(grDevice->device, vkPipeline, NULL);
-    VKD.vkDestroyPipelineLayout(grDevice->device, pipelineLayout, NULL);
-
-    for (unsigned i = 0; i < GR_MAX_DESCRIPTOR_SETS; i++) {
-        free(descriptorSlots[i]);
-    }
-    free(createInfo);
     return res;
 #else
     LOGW("stub\n");
@@ -669,6 +669,9 @@ GR_RESULT GR_STDCALL grWsiWinQueuePresent(
         return getGrResult(vkRes);
     }
 
+    // Periodically persist the pipeline cache in case the game doesn't exit cleanly
+    grPipelineCacheUpdate(grDevice);
+
     return GR_SUCCESS;
 }
 
@@ -0,0 +1,352 @@
+#include <stdio.h>
+#include "mantle_internal.h"
+#include "crc32.h"
+
+#define PIPELINE_CACHE_SAVE_INTERVAL_MS (60 * 1000)
+
+static INIT_ONCE mExeDirectoryInitOnce = INIT_ONCE_STATIC_INIT;
+static char mExeDirectory[MAX_PATH];
+
+static BOOL CALLBACK getExeDirectory(
+    PINIT_ONCE initOnce,
+    PVOID param,
+    PVOID* context)
+{
+    DWORD length = GetModuleFileNameA(NULL, mExeDirectory, MAX_PATH);
+
+    if (length == 0 || length >= MAX_PATH) {
+        LOGW("GetModuleFileNameA failed (%lu)\n", GetLastError());
+        strcpy(mExeDirectory, ".");
+        return TRUE;
+    }
+
+    // Strip the executable name
+    char* separator = strrchr(mExeDirectory, '\\');
+    if (separator == NULL) {
+        separator = strrchr(mExeDirectory, '/');
+    }
+    if (separator != NULL) {
+        *separator = '\0';
+    } else {
+        strcpy(mExeDirectory, ".");
+    }
+
+    return TRUE;
+}
+
+const char* grPipelineCacheGetDirectory()
+{
+    const char* envValue = getenv("GRVK_PIPELINE_CACHE_PATH");
+
+    if (envValue != NULL) {
+        if (strlen(envValue) == 0) {
+            return NULL;
+        } else {
+            return envValue;
+        }
+    }
+
+    // Default to the directory of the game executable, launchers don't always set the working
+    // directory to it
+    InitOnceExecuteOnce(&mExeDirectoryInitOnce, getExeDirectory, NULL, NULL);
+    return mExeDirectory;
+}
+
+bool grPipelineCacheWriteFile(
+    const char* fileName,
+    PipelineCacheWriteFunc writeFunc,
+    void* param)
+{
+    char tmpFileName[MAX_PATH];
+
+    // Write to a temporary file first so that a crash never leaves a partial file behind.
+    // Processes of the same title share the directory, each needs its own temporary file.
+    snprintf(tmpFileName, MAX_PATH, "%s.%lu.tmp", fileName, GetCurrentProcessId());
+
+    FILE* file = fopen(tmpFileName, "wb");
+    if (file == NULL) {
+        LOGW("failed to create %s\n", tmpFileName);
+        return false;
+    }
+
+    bool valid = writeFunc(file, param);
+    valid = fclose(file) == 0 && valid;
+
+    if (!valid || !MoveFileExA(tmpFileName, fileName, MOVEFILE_REPLACE_EXISTING)) {
+        LOGW("failed to write %s\n", fileName);
+        DeleteFileA(tmpFileName);
+        return false;
+    }
+
+    return true;
+}
+
+static bool isCacheDataValid(
+    const void* data,
+    size_t size,
+    const VkPipelineCacheHeaderVersionOne* expectedHeader)
+{
+    VkPipelineCacheHeaderVersionOne header;
+
+    // The driver checks it too, but don't hand over a cache from another device to buggy drivers
+    if (size < sizeof(header)) {
+        return false;
+    }
+
+    memcpy(&header, data, sizeof(header));
+    return header.headerSize >= sizeof(header) &&
+           header.headerVersion == expectedHeader->headerVersion &&
+           header.vendorID == expectedHeader->vendorID &&
+           header.deviceID == expectedHeader->deviceID &&
+           memcmp(header.pipelineCacheUUID, expectedHeader->pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+static void* readCacheFile(
+    const char* fileName,
+    size_t* size)
+{
+    FILE* file = fopen(fileName, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long fileSize = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    void* data = fileSize > 0 ? malloc(fileSize) : NULL;
+    if (data != NULL && fread(data, 1, fileSize, file) != (size_t)fileSize) {
+        free(data);
+        data = NULL;
+    }
+
+    fclose(file);
+    *size = fileSize;
+    return data;
+}
+
+typedef struct _CacheData {
+    const void* data;
+    size_t size;
+} CacheData;
+
+static bool writeCacheData(
+    FILE* file,
+    void* param)
+{
+    const CacheData* cacheData = param;
+
+    return fwrite(cacheData->data, 1, cacheData->size, file) == cacheData->size;
+}
+
+static void savePipelineCache(
+    void* param)
+{
+    GrDevice* grDevice = param;
+    void* data = NULL;
+    size_t size = 0;
+    VkResult vkRes;
+
+    // The cache may grow between both calls, retry with the new size until the data fits
+    do {
+        free(data);
+        data = NULL;
+
+        AcquireSRWLockShared(&grDevice->pipelineCacheLock);
+        vkRes = VKD.vkGetPipelineCacheData(grDevice->device, grDevice->pipelineCache, &size, NULL);
+        ReleaseSRWLockShared(&grDevice->pipelineCacheLock);
+        if (vkRes != VK_SUCCESS) {
+            break;
+        }
+
+        data = malloc(size);
+        if (data == NULL) {
+            LOGW("failed to allocate %zu bytes for the pipeline cache\n", size);
+            return;
+        }
+
+        AcquireSRWLockShared(&grDevice->pipelineCacheLock);
+        vkRes = VKD.vkGetPipelineCacheData(grDevice->device, grDevice->pipelineCache, &size, data);
+        ReleaseSRWLockShared(&grDevice->pipelineCacheLock);
+    } while (vkRes == VK_INCOMPLETE);
+
+    if (vkRes != VK_SUCCESS) {
+        LOGW("vkGetPipelineCacheData failed (%d)\n", vkRes);
+        free(data);
+        return;
+    }
+
+    // Entries can be replaced without changing the total size, compare the contents instead
+    uint32_t hash = crc32_fast(data, size, 0);
+    if (hash == grDevice->pipelineCacheSavedHash) {
+        // Nothing new got compiled
+        free(data);
+        return;
+    }
+
+    const CacheData cacheData = {
+        .data = data,
+        .size = size,
+    };
+
+    bool saved = grPipelineCacheWriteFile(grDevice->pipelineCacheFileName, writeCacheData,
+                                          (void*)&cacheData);
+    free(data);
+
+    if (saved) {
+        LOGV("saved %zu bytes to %s\n", size, grDevice->pipelineCacheFileName);
+        grDevice->pipelineCacheSavedHash = hash;
+    }
+}
+
+void grPipelineCacheInit(
+    GrDevice* grDevice,
+    const VkPhysicalDeviceProperties* props)
+{
+    const char* directory = grPipelineCacheGetDirectory();
+    void* initialData = NULL;
+    size_t initialDataSize = 0;
+    VkResult vkRes;
+
+    grDevice->pipelineCacheHeader = (VkPipelineCacheHeaderVersionOne) {
+        .headerSize = sizeof(VkPipelineCacheHeaderVersionOne),
+        .headerVersion = VK_PIPELINE_CACHE_HEADER_VERSION_ONE,
+        .vendorID = props->vendorID,
+        .deviceID = props->deviceID,
+        .pipelineCacheUUID = { 0 }, // Initialized below
+    };
+    memcpy(grDevice->pipelineCacheHeader.pipelineCacheUUID, props->pipelineCacheUUID, VK_UUID_SIZE);
+
+    if (directory != NULL) {
+        char uuid[2 * VK_UUID_SIZE + 1];
+
+        for (unsigned i = 0; i < VK_UUID_SIZE; i++) {
+            snprintf(&uuid[2 * i], 3, "%02x", props->pipelineCacheUUID[i]);
+        }
+
+        grDevice->pipelineCacheFileName = malloc(MAX_PATH);
+        snprintf(grDevice->pipelineCacheFileName, MAX_PATH, "%s\\grvk_%04x_%04x_%s.cache",
+                 directory, props->vendorID, props->deviceID, uuid);
+
+        initialData = readCacheFile(grDevice->pipelineCacheFileName, &initialDataSize);
+        if (initialData != NULL && !isCacheDataValid(initialData, initialDataSize,
+                                                      &grDevice->pipelineCacheHeader)) {
+            LOGW("ignoring invalid pipeline cache %s\n", grDevice->pipelineCacheFileName);
+            free(initialData);
+            initialData = NULL;
+        }
+    }
+
+    const VkPipelineCacheCreateInfo createInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .initialDataSize = initialData != NULL ? initialDataSize : 0,
+        .pInitialData = initialData,
+    };
+
+    vkRes = VKD.vkCreatePipelineCache(grDevice->device, &createInfo, NULL,
+                                      &grDevice->pipelineCache);
+    if (vkRes != VK_SUCCESS && initialData != NULL) {
+        // Retry from scratch
+        LOGW("vkCreatePipelineCache failed with initial data (%d)\n", vkRes);
+        free(initialData);
+        initialData = NULL;
+
+        const VkPipelineCacheCreateInfo emptyCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+            .pNext = NULL,
+            .flags = 0,
+            .initialDataSize = 0,
+            .pInitialData = NULL,
+        };
+
+        vkRes = VKD.vkCreatePipelineCache(grDevice->device, &emptyCreateInfo, NULL,
+                                          &grDevice->pipelineCache);
+    }
+    if (vkRes != VK_SUCCESS) {
+        LOGE("vkCreatePipelineCache failed (%d)\n", vkRes);
+        grDevice->pipelineCache = VK_NULL_HANDLE;
+    }
+
+    if (initialData != NULL) {
+        LOGI("loaded %zu bytes from %s\n", initialDataSize, grDevice->pipelineCacheFileName);
+        grDevice->pipelineCacheSavedHash = crc32_fast(initialData, initialDataSize, 0);
+        free(initialData);
+    }
+
+    grDevice->pipelineCacheSaveTime = GetTickCount64();
+}
+
+void grPipelineCacheUpdate(
+    GrDevice* grDevice)
+{
+    if (grDevice->pipelineCache == VK_NULL_HANDLE || grDevice->pipelineCacheFileName == NULL) {
+        return;
+    }
+
+    ULONGLONG time = GetTickCount64();
+
+    if (time - grDevice->pipelineCacheSaveTime < PIPELINE_CACHE_SAVE_INTERVAL_MS ||
+        !threadPoolIsJobDone(&grDevice->pipelineCacheSaveJob)) {
+        return;
+    }
+
+    grDevice->pipelineCacheSaveTime = time;
+    threadPoolSubmit(grDevice->compilerPool, &grDevice->pipelineCacheSaveJob,
+                     savePipelineCache, grDevice);
+}
+
+bool grPipelineCacheMerge(
+    GrDevice* grDevice,
+    const void* data,
+    size_t size)
+{
+    VkPipelineCache srcCache = VK_NULL_HANDLE;
+    VkResult vkRes;
+
+    if (grDevice->pipelineCache == VK_NULL_HANDLE ||
+        !isCacheDataValid(data, size, &grDevice->pipelineCacheHeader)) {
+        return false;
+    }
+
+    const VkPipelineCacheCreateInfo createInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .initialDataSize = size,
+        .pInitialData = data,
+    };
+
+    vkRes = VKD.vkCreatePipelineCache(grDevice->device, &createInfo, NULL, &srcCache);
+    if (vkRes != VK_SUCCESS) {
+        LOGW("vkCreatePipelineCache failed (%d)\n", vkRes);
+        return false;
+    }
+
+    // The destination cache must be externally synchronized, compiles and saves hold the lock shared
+    AcquireSRWLockExclusive(&grDevice->pipelineCacheLock);
+    vkRes = VKD.vkMergePipelineCaches(grDevice->device, grDevice->pipelineCache, 1, &srcCache);
+    ReleaseSRWLockExclusive(&grDevice->pipelineCacheLock);
+
+    VKD.vkDestroyPipelineCache(grDevice->device, srcCache, NULL);
+
+    if (vkRes != VK_SUCCESS) {
+        LOGW("vkMergePipelineCaches failed (%d)\n", vkRes);
+        return false;
+    }
+
+    return true;
+}
+
+void grPipelineCacheDestroy(
+    GrDevice* grDevice)
+{
+    // The compiler pool must be drained at this point
+    if (grDevice->pipelineCache != VK_NULL_HANDLE && grDevice->pipelineCacheFileName != NULL) {
+        savePipelineCache(grDevice);
+    }
+
+    VKD.vkDestroyPipelineCache(grDevice->device, grDevice->pipelineCache, NULL);
+    free(grDevice->pipelineCacheFileName);
+}
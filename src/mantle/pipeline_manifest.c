@@ -0,0 +1,372 @@
+#include <ctype.h>
+#include <stdio.h>
+#include "mantle_internal.h"
+#include "quirk.h"
+#include "crc32.h"
+
+#define PIPELINE_MANIFEST_MAGIC 0x4D565247 // "GRVM"
+#define PIPELINE_MANIFEST_VERSION 1
+
+typedef struct _PipelineManifestHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entryCount;
+} PipelineManifestHeader;
+
+// Followed by the depth-stencil variants and the stored pipeline blob
+typedef struct _PipelineManifestEntryHeader {
+    uint32_t size;
+    uint32_t formatCount;
+} PipelineManifestEntryHeader;
+
+static char* getManifestFileName()
+{
+    const char* directory = grPipelineCacheGetDirectory();
+    const char* appName = quirkGetAppName();
+    char title[64];
+    unsigned length = 0;
+
+    if (directory == NULL || appName == NULL) {
+        return NULL;
+    }
+
+    // Keep the title file system friendly
+    for (; appName[length] != '\0' && length < COUNT_OF(title) - 1; length++) {
+        title[length] = isalnum((unsigned char)appName[length]) ? appName[length] : '_';
+    }
+    title[length] = '\0';
+
+    if (length == 0) {
+        return NULL;
+    }
+
+    char* fileName = malloc(MAX_PATH);
+    snprintf(fileName, MAX_PATH, "%s\\grvk_%s.manifest", directory, title);
+    return fileName;
+}
+
+static PipelineManifestEntry* addEntry(
+    GrDevice* grDevice,
+    uint32_t hash,
+    void* data,
+    uint32_t size)
+{
+    PipelineManifestEntry* entry = malloc(sizeof(PipelineManifestEntry));
+    *entry = (PipelineManifestEntry) {
+        .next = grDevice->pipelineManifestEntries,
+        .grDevice = grDevice,
+        .hash = hash,
+        .size = size,
+        .data = data,
+        .formatCount = 0,
+        .formats = NULL,
+        .pendingFormatCount = 0,
+        .pendingFormats = NULL,
+        .stale = false,
+        .prewarmJob = { 0 },
+    };
+
+    grDevice->pipelineManifestEntries = entry;
+    grDevice->pipelineManifestEntryCount++;
+    return entry;
+}
+
+// Must be called with the manifest lock held
+static PipelineManifestEntry* findEntry(
+    GrDevice* grDevice,
+    uint32_t hash,
+    const void* data,
+    uint32_t size)
+{
+    for (PipelineManifestEntry* entry = grDevice->pipelineManifestEntries;
+         entry != NULL; entry = entry->next) {
+        if (entry->hash == hash && entry->size == size && memcmp(entry->data, data, size) == 0) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+static bool hasFormats(
+    unsigned formatCount,
+    const PipelineFormats* formats,
+    VkFormat depthFormat,
+    VkFormat stencilFormat)
+{
+    for (unsigned i = 0; i < formatCount; i++) {
+        if (formats[i].depthFormat == depthFormat && formats[i].stencilFormat == stencilFormat) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool addFormats(
+    unsigned* formatCount,
+    PipelineFormats** formats,
+    VkFormat depthFormat,
+    VkFormat stencilFormat)
+{
+    if (hasFormats(*formatCount, *formats, depthFormat, stencilFormat)) {
+        return false;
+    }
+
+    (*formatCount)++;
+    *formats = realloc(*formats, *formatCount * sizeof(PipelineFormats));
+    (*formats)[*formatCount - 1] = (PipelineFormats) {
+        .depthFormat = depthFormat,
+        .stencilFormat = stencilFormat,
+    };
+    return true;
+}
+
+// Must be called with the manifest lock held, once the prewarm job is done
+static void flushPendingFormats(
+    GrDevice* grDevice,
+    PipelineManifestEntry* entry)
+{
+    for (unsigned i = 0; i < entry->pendingFormatCount; i++) {
+        if (addFormats(&entry->formatCount, &entry->formats,
+                       entry->pendingFormats[i].depthFormat,
+                       entry->pendingFormats[i].stencilFormat)) {
+            grDevice->pipelineManifestDirty = true;
+        }
+    }
+
+    free(entry->pendingFormats);
+    entry->pendingFormatCount = 0;
+    entry->pendingFormats = NULL;
+}
+
+static void prewarmPipeline(
+    void* param)
+{
+    PipelineManifestEntry* entry = param;
+    GrDevice* grDevice = entry->grDevice;
+
+    if (!grPipelinePrewarm(grDevice, entry->data, entry->size, entry->formatCount, entry->formats)) {
+        // Drop it from the manifest unless the title creates it again
+        AcquireSRWLockExclusive(&grDevice->pipelineManifestLock);
+        entry->stale = true;
+        grDevice->pipelineManifestDirty = true;
+        ReleaseSRWLockExclusive(&grDevice->pipelineManifestLock);
+    }
+}
+
+static void loadManifest(
+    GrDevice* grDevice)
+{
+    PipelineManifestHeader header;
+
+    FILE* file = fopen(grDevice->pipelineManifestFileName, "rb");
+    if (file == NULL) {
+        return;
+    }
+
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        header.magic != PIPELINE_MANIFEST_MAGIC || header.version != PIPELINE_MANIFEST_VERSION) {
+        LOGW("ignoring invalid pipeline manifest %s\n", grDevice->pipelineManifestFileName);
+        fclose(file);
+        return;
+    }
+
+    for (unsigned i = 0; i < header.entryCount; i++) {
+        PipelineManifestEntryHeader entryHeader;
+
+        if (fread(&entryHeader, sizeof(entryHeader), 1, file) != 1 ||
+            entryHeader.size == 0 || entryHeader.formatCount > 0xFFFF) {
+            LOGW("truncated pipeline manifest %s\n", grDevice->pipelineManifestFileName);
+            break;
+        }
+
+        PipelineFormats* formats = malloc(entryHeader.formatCount * sizeof(PipelineFormats));
+        void* data = malloc(entryHeader.size);
+
+        if (fread(formats, sizeof(PipelineFormats), entryHeader.formatCount, file) !=
+            entryHeader.formatCount ||
+            fread(data, 1, entryHeader.size, file) != entryHeader.size) {
+            LOGW("truncated pipeline manifest %s\n", grDevice->pipelineManifestFileName);
+            free(formats);
+            free(data);
+            break;
+        }
+
+        // Blobs are validated when prewarmed
+        PipelineManifestEntry* entry = addEntry(grDevice, crc32_fast(data, entryHeader.size, 0),
+                                                data, entryHeader.size);
+        entry->formatCount = entryHeader.formatCount;
+        entry->formats = formats;
+    }
+
+    fclose(file);
+}
+
+static bool writeManifest(
+    FILE* file,
+    void* param)
+{
+    const GrDevice* grDevice = param;
+    unsigned entryCount = 0;
+
+    for (PipelineManifestEntry* entry = grDevice->pipelineManifestEntries;
+         entry != NULL; entry = entry->next) {
+        entryCount += entry->stale ? 0 : 1;
+    }
+
+    const PipelineManifestHeader header = {
+        .magic = PIPELINE_MANIFEST_MAGIC,
+        .version = PIPELINE_MANIFEST_VERSION,
+        .entryCount = entryCount,
+    };
+
+    bool valid = fwrite(&header, sizeof(header), 1, file) == 1;
+
+    for (PipelineManifestEntry* entry = grDevice->pipelineManifestEntries;
+         entry != NULL && valid; entry = entry->next) {
+        if (entry->stale) {
+            continue;
+        }
+
+        const PipelineManifestEntryHeader entryHeader = {
+            .size = entry->size,
+            .formatCount = entry->formatCount,
+        };
+
+        valid = fwrite(&entryHeader, sizeof(entryHeader), 1, file) == 1 &&
+                fwrite(entry->formats, sizeof(PipelineFormats), entry->formatCount, file) ==
+                entry->formatCount &&
+                fwrite(entry->data, 1, entry->size, file) == entry->size;
+    }
+
+    return valid;
+}
+
+static void saveManifest(
+    GrDevice* grDevice)
+{
+    if (grPipelineCacheWriteFile(grDevice->pipelineManifestFileName, writeManifest, grDevice)) {
+        LOGV("saved pipeline manifest to %s\n", grDevice->pipelineManifestFileName);
+    }
+}
+
+void grPipelineManifestInit(
+    GrDevice* grDevice)
+{
+    grDevice->pipelineManifestFileName = getManifestFileName();
+    if (grDevice->pipelineManifestFileName == NULL) {
+        return;
+    }
+
+    loadManifest(grDevice);
+
+    if (grDevice->pipelineManifestEntryCount == 0) {
+        return;
+    } else if (grDevice->compilerPool == NULL) {
+        // Not worth stalling device creation for
+        LOGW("no compiler threads, skipping pipeline prewarming\n");
+        return;
+    }
+
+    LOGI("prewarming %u pipelines from %s\n",
+         grDevice->pipelineManifestEntryCount, grDevice->pipelineManifestFileName);
+
+    for (PipelineManifestEntry* entry = grDevice->pipelineManifestEntries;
+         entry != NULL; entry = entry->next) {
+        threadPoolSubmit(grDevice->compilerPool, &entry->prewarmJob, prewarmPipeline, entry);
+    }
+}
+
+void grPipelineManifestRecord(
+    GrDevice* grDevice,
+    GrPipeline* grPipeline)
+{
+    uint32_t size;
+
+    if (grDevice->pipelineManifestFileName == NULL) {
+        return;
+    }
+
+    void* data = grPipelineSerialize(grPipeline, &size);
+    uint32_t hash = crc32_fast(data, size, 0);
+
+    AcquireSRWLockExclusive(&grDevice->pipelineManifestLock);
+
+    PipelineManifestEntry* entry = findEntry(grDevice, hash, data, size);
+    if (entry != NULL) {
+        free(data);
+    } else {
+        entry = addEntry(grDevice, hash, data, size);
+        grDevice->pipelineManifestDirty = true;
+    }
+
+    if (entry->stale) {
+        entry->stale = false;
+        grDevice->pipelineManifestDirty = true;
+    }
+
+    grPipeline->manifestEntry = entry;
+
+    ReleaseSRWLockExclusive(&grDevice->pipelineManifestLock);
+}
+
+void grPipelineManifestRecordVariant(
+    GrDevice* grDevice,
+    const GrPipeline* grPipeline,
+    VkFormat depthFormat,
+    VkFormat stencilFormat)
+{
+    PipelineManifestEntry* entry = grPipeline->manifestEntry;
+
+    if (entry == NULL) {
+        return;
+    }
+
+    AcquireSRWLockExclusive(&grDevice->pipelineManifestLock);
+
+    if (!threadPoolIsJobDone(&entry->prewarmJob)) {
+        // The prewarm job reads the formats, queue the variant until it's done
+        addFormats(&entry->pendingFormatCount, &entry->pendingFormats, depthFormat, stencilFormat);
+    } else {
+        flushPendingFormats(grDevice, entry);
+        if (addFormats(&entry->formatCount, &entry->formats, depthFormat, stencilFormat)) {
+            grDevice->pipelineManifestDirty = true;
+        }
+    }
+
+    ReleaseSRWLockExclusive(&grDevice->pipelineManifestLock);
+}
+
+void grPipelineManifestDestroy(
+    GrDevice* grDevice)
+{
+    PipelineManifestEntry* entry = grDevice->pipelineManifestEntries;
+
+    // Prewarming uses the device cache, it must be done before the cache goes away
+    for (; entry != NULL; entry = entry->next) {
+        if (!threadPoolCancel(grDevice->compilerPool, &entry->prewarmJob)) {
+            threadPoolWait(grDevice->compilerPool, &entry->prewarmJob);
+        }
+
+        AcquireSRWLockExclusive(&grDevice->pipelineManifestLock);
+        flushPendingFormats(grDevice, entry);
+        ReleaseSRWLockExclusive(&grDevice->pipelineManifestLock);
+    }
+
+    if (grDevice->pipelineManifestDirty) {
+        saveManifest(grDevice);
+    }
+
+    entry = grDevice->pipelineManifestEntries;
+    while (entry != NULL) {
+        PipelineManifestEntry* next = entry->next;
+
+        free(entry->data);
+        free(entry->formats);
+        free(entry);
+        entry = next;
+    }
+
+    free(grDevice->pipelineManifestFileName);
+}
@@ -0,0 +1,175 @@
+#include <stdio.h>
+#include "mantle_internal.h"
+
+static LONGLONG getTotalTime(
+    const PipelineStats* stats)
+{
+    return stats->ilCompileTime + stats->hullRecompileTime + stats->patchTime +
+           stats->shaderModuleTime + stats->driverCompileTime;
+}
+
+static int compareStats(
+    const void* a,
+    const void* b)
+{
+    LONGLONG totalA = getTotalTime(*(const PipelineStats**)a);
+    LONGLONG totalB = getTotalTime(*(const PipelineStats**)b);
+
+    // Slowest first
+    return totalA < totalB ? 1 : totalA > totalB ? -1 : 0;
+}
+
+static char* getShaderNames(
+    unsigned shaderCount,
+    const GrShader* const* grShaders)
+{
+    size_t length = 1;
+
+    for (unsigned i = 0; i < shaderCount; i++) {
+        length += (grShaders[i]->name != NULL ? strlen(grShaders[i]->name) : 1) + 1;
+    }
+
+    char* names = malloc(length);
+    names[0] = '\0';
+
+    for (unsigned i = 0; i < shaderCount; i++) {
+        if (i > 0) {
+            strcat(names, " ");
+        }
+        strcat(names, grShaders[i]->name != NULL ? grShaders[i]->name : "?");
+    }
+
+    return names;
+}
+
+static void writeReport(
+    GrDevice* grDevice)
+{
+    PipelineStats** sortedStats = malloc(grDevice->pipelineStatsCount * sizeof(PipelineStats*));
+    unsigned count = 0;
+
+    for (PipelineStats* stats = grDevice->pipelineStats; stats != NULL; stats = stats->next) {
+        sortedStats[count] = stats;
+        count++;
+    }
+
+    qsort(sortedStats, count, sizeof(PipelineStats*), compareStats);
+
+    FILE* file = fopen(grDevice->pipelineStatsFileName, "w");
+    if (file == NULL) {
+        LOGW("failed to create %s\n", grDevice->pipelineStatsFileName);
+        free(sortedStats);
+        return;
+    }
+
+    fprintf(file, "total_us,il_compile_us,hull_recompile_us,patch_us,shader_module_us,"
+                  "driver_compile_us,driver_compiles,driver_cache_hits,type,shaders\n");
+
+    for (unsigned i = 0; i < count; i++) {
+        const PipelineStats* stats = sortedStats[i];
+
+        fprintf(file, "%lld,%lld,%lld,%lld,%lld,%lld,%ld,%ld,%s,\"%s\"\n",
+                getTotalTime(stats), stats->ilCompileTime, stats->hullRecompileTime,
+                stats->patchTime, stats->shaderModuleTime, stats->driverCompileTime,
+                stats->driverCompileCount, stats->driverCacheHitCount,
+                stats->isGraphics ? "graphics" : "compute",
+                stats->isLoaded ? "(loaded)" : stats->shaderNames);
+    }
+
+    fclose(file);
+
+    if (count > 0) {
+        LOGI("wrote stats of %u pipelines to %s, slowest took %lld us (%s)\n",
+             count, grDevice->pipelineStatsFileName,
+             getTotalTime(sortedStats[0]), sortedStats[0]->shaderNames);
+    }
+
+    free(sortedStats);
+}
+
+void grPipelineStatsInit(
+    GrDevice* grDevice)
+{
+    const char* envValue = getenv("GRVK_PIPELINE_STATS_PATH");
+
+    if (envValue != NULL && strlen(envValue) > 0) {
+        grDevice->pipelineStatsFileName = strdup(envValue);
+    }
+}
+
+LONGLONG grPipelineStatsGetTime()
+{
+    static LARGE_INTEGER frequency = { 0 };
+    LARGE_INTEGER counter;
+
+    if (frequency.QuadPart == 0) {
+        QueryPerformanceFrequency(&frequency);
+    }
+
+    QueryPerformanceCounter(&counter);
+    return counter.QuadPart / frequency.QuadPart * 1000000 +
+           counter.QuadPart % frequency.QuadPart * 1000000 / frequency.QuadPart;
+}
+
+PipelineStats* grPipelineStatsAdd(
+    GrDevice* grDevice,
+    const PipelineStats* stats,
+    unsigned shaderCount,
+    const GrShader* const* grShaders)
+{
+    if (grDevice->pipelineStatsFileName == NULL) {
+        return NULL;
+    }
+
+    PipelineStats* deviceStats = malloc(sizeof(PipelineStats));
+    *deviceStats = *stats;
+    deviceStats->shaderNames = getShaderNames(shaderCount, grShaders);
+
+    // IL translation is shared by all pipelines using the shader, count it for each of them
+    for (unsigned i = 0; i < shaderCount; i++) {
+        deviceStats->ilCompileTime += grShaders[i]->compileTime;
+    }
+
+    AcquireSRWLockExclusive(&grDevice->pipelineStatsLock);
+    deviceStats->next = grDevice->pipelineStats;
+    grDevice->pipelineStats = deviceStats;
+    grDevice->pipelineStatsCount++;
+    ReleaseSRWLockExclusive(&grDevice->pipelineStatsLock);
+
+    return deviceStats;
+}
+
+void grPipelineStatsAddFeedback(
+    PipelineStats* stats,
+    const VkPipelineCreationFeedback* feedback)
+{
+    if (stats == NULL || !(feedback->flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT)) {
+        return;
+    }
+
+    InterlockedAdd64(&stats->driverCompileTime, feedback->duration / 1000);
+    InterlockedIncrement(&stats->driverCompileCount);
+    if (feedback->flags & VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT) {
+        InterlockedIncrement(&stats->driverCacheHitCount);
+    }
+}
+
+void grPipelineStatsDestroy(
+    GrDevice* grDevice)
+{
+    // The compiler pool must be drained at this point
+    if (grDevice->pipelineStatsFileName != NULL) {
+        writeReport(grDevice);
+    }
+
+    PipelineStats* stats = grDevice->pipelineStats;
+    while (stats != NULL) {
+        PipelineStats* next = stats->next;
+
+        free(stats->shaderNames);
+        free(stats);
+        stats = next;
+    }
+
+    free(grDevice->pipelineStatsFileName);
+}
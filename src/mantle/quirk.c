@@ -1,10 +1,15 @@
 #include "quirk.h"
 
 static QUIRK_FLAGS mQuirks = 0;
+static char* mAppName = NULL;
 
 void quirkInit(
     const GR_APPLICATION_INFO* appInfo)
 {
+    if (appInfo->pAppName != NULL && mAppName == NULL) {
+        mAppName = strdup(appInfo->pAppName);
+    }
+
     if (appInfo->pAppName == NULL || appInfo->pEngineName == NULL) {
         return;
     }
@@ -30,6 +35,11 @@ void quirkInit(
     }
 }
 
+const char* quirkGetAppName()
+{
+    return mAppName;
+}
+
 bool quirkHas(
     QUIRK_FLAGS flags) {
     return (mQuirks & flags) == flags;
@@ -39,6 +39,9 @@ typedef enum {
 void quirkInit(
     const GR_APPLICATION_INFO* appInfo);
 
+// Returns NULL if the application didn't provide a name
+const char* quirkGetAppName();
+
 bool quirkHas(
     QUIRK_FLAGS flags);
 
@@ -0,0 +1,155 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "scratch_arena.h"
+#include "logger.h"
+
+#define SCRATCH_BLOCK_SIZE (64 * 1024)
+#define SCRATCH_ALIGNMENT  (16)
+
+struct _ScratchBlock {
+    ScratchBlock* prev;
+    size_t size;
+    size_t offset;
+    uint8_t data[];
+};
+
+static DWORD mTlsIndex = TLS_OUT_OF_INDEXES;
+
+static ScratchBlock* allocBlock(
+    ScratchBlock* prev,
+    size_t minSize)
+{
+    // Leave room to align the first allocation
+    size_t size = minSize + SCRATCH_ALIGNMENT > SCRATCH_BLOCK_SIZE ?
+                  minSize + SCRATCH_ALIGNMENT : SCRATCH_BLOCK_SIZE;
+
+    ScratchBlock* block = malloc(sizeof(ScratchBlock) + size);
+    *block = (ScratchBlock) {
+        .prev = prev,
+        .size = size,
+        .offset = 0,
+    };
+
+    return block;
+}
+
+static void* allocFromBlock(
+    ScratchBlock* block,
+    size_t size)
+{
+    uintptr_t base = (uintptr_t)block->data;
+    uintptr_t address = (base + block->offset + SCRATCH_ALIGNMENT - 1) &
+                        ~(uintptr_t)(SCRATCH_ALIGNMENT - 1);
+
+    if (address + size > base + block->size) {
+        return NULL;
+    }
+
+    block->offset = address + size - base;
+    return (void*)address;
+}
+
+void scratchInit()
+{
+    mTlsIndex = TlsAlloc();
+    if (mTlsIndex == TLS_OUT_OF_INDEXES) {
+        LOGE("TlsAlloc failed (%lu)\n", GetLastError());
+    }
+}
+
+void scratchThreadDetach()
+{
+    if (mTlsIndex == TLS_OUT_OF_INDEXES) {
+        return;
+    }
+
+    ScratchBlock* block = TlsGetValue(mTlsIndex);
+    while (block != NULL) {
+        ScratchBlock* prev = block->prev;
+
+        free(block);
+        block = prev;
+    }
+
+    TlsSetValue(mTlsIndex, NULL);
+}
+
+void scratchDestroy()
+{
+    // Arenas of other threads are leaked, the process is going away
+    scratchThreadDetach();
+
+    if (mTlsIndex != TLS_OUT_OF_INDEXES) {
+        TlsFree(mTlsIndex);
+        mTlsIndex = TLS_OUT_OF_INDEXES;
+    }
+}
+
+ScratchMark scratchGetMark()
+{
+    ScratchBlock* block = TlsGetValue(mTlsIndex);
+
+    return (ScratchMark) {
+        .block = block,
+        .offset = block != NULL ? block->offset : 0,
+    };
+}
+
+void* scratchAlloc(
+    size_t size)
+{
+    ScratchBlock* block = TlsGetValue(mTlsIndex);
+    void* ptr = block != NULL ? allocFromBlock(block, size) : NULL;
+
+    if (ptr == NULL) {
+        // Older blocks stay around until released, pointers into them remain valid
+        block = allocBlock(block, size);
+        TlsSetValue(mTlsIndex, block);
+        ptr = allocFromBlock(block, size);
+    }
+
+    return ptr;
+}
+
+void* scratchRealloc(
+    void* ptr,
+    size_t oldSize,
+    size_t newSize)
+{
+    ScratchBlock* block = TlsGetValue(mTlsIndex);
+
+    if (ptr == NULL) {
+        return scratchAlloc(newSize);
+    }
+
+    if (block != NULL && (uint8_t*)ptr + oldSize == &block->data[block->offset] &&
+        (uint8_t*)ptr + newSize <= &block->data[block->size]) {
+        block->offset = (uint8_t*)ptr + newSize - block->data;
+        return ptr;
+    }
+
+    void* newPtr = scratchAlloc(newSize);
+    memcpy(newPtr, ptr, oldSize < newSize ? oldSize : newSize);
+    return newPtr;
+}
+
+void scratchRelease(
+    ScratchMark mark)
+{
+    ScratchBlock* block = TlsGetValue(mTlsIndex);
+
+    // Always keep one block around so that the next burst doesn't hit the allocator
+    while (block != mark.block && block->prev != NULL) {
+        ScratchBlock* prev = block->prev;
+
+        free(block);
+        block = prev;
+    }
+
+    if (block != NULL) {
+        block->offset = block == mark.block ? mark.offset : 0;
+    }
+
+    TlsSetValue(mTlsIndex, block);
+}
@@ -0,0 +1,39 @@
+#ifndef SCRATCH_ARENA_H_
+#define SCRATCH_ARENA_H_
+
+#include <stddef.h>
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+typedef struct _ScratchBlock ScratchBlock;
+
+// Position in the calling thread's arena, everything allocated after it is released at once
+typedef struct _ScratchMark {
+    ScratchBlock* block;
+    size_t offset;
+} ScratchMark;
+
+// Must be called from DllMain
+void scratchInit();
+
+// Frees the calling thread's arena, must be called from DllMain
+void scratchThreadDetach();
+
+void scratchDestroy();
+
+ScratchMark scratchGetMark();
+
+// Allocations are 16-byte aligned and thread-local, they're valid until released
+void* scratchAlloc(
+    size_t size);
+
+// Grows in place when the allocation is the last one made
+void* scratchRealloc(
+    void* ptr,
+    size_t oldSize,
+    size_t newSize);
+
+void scratchRelease(
+    ScratchMark mark);
+
+#endif // SCRATCH_ARENA_H_
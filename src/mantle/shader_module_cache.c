@@ -0,0 +1,172 @@
+#include "mantle_internal.h"
+#include "crc32.h"
+
+static ShaderModuleEntry* getShaderModuleEntry(
+    const void* sharedCode)
+{
+    return (ShaderModuleEntry*)((uint8_t*)sharedCode - OFFSET_OF(ShaderModuleEntry, code));
+}
+
+static ShaderModuleEntry** getShaderModuleBucket(
+    GrDevice* grDevice,
+    uint32_t hash)
+{
+    return &grDevice->shaderModuleBuckets[hash & (SHADER_MODULE_BUCKET_COUNT - 1)];
+}
+
+// Must be called with the shader module lock held
+static ShaderModuleEntry* findShaderModuleEntry(
+    GrDevice* grDevice,
+    uint32_t hash,
+    const void* code,
+    unsigned codeSize)
+{
+    for (ShaderModuleEntry* entry = *getShaderModuleBucket(grDevice, hash);
+         entry != NULL; entry = entry->next) {
+        if (entry->hash == hash && entry->codeSize == codeSize &&
+            memcmp(entry->code, code, codeSize) == 0) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+VkResult grShaderModuleCacheAcquire(
+    GrDevice* grDevice,
+    const void* code,
+    unsigned codeSize,
+    void** sharedCode,
+    VkShaderModule* module)
+{
+    uint32_t hash = crc32_fast(code, codeSize, 0);
+    ShaderModuleEntry* entry;
+    VkResult vkRes;
+
+    AcquireSRWLockExclusive(&grDevice->shaderModuleLock);
+    entry = findShaderModuleEntry(grDevice, hash, code, codeSize);
+    if (entry != NULL) {
+        entry->refCount++;
+        grDevice->shaderModuleHitCount++;
+    }
+    ReleaseSRWLockExclusive(&grDevice->shaderModuleLock);
+
+    if (entry != NULL) {
+        *sharedCode = entry->code;
+        *module = entry->module;
+        return VK_SUCCESS;
+    }
+
+    // Don't hold the lock while the driver parses the code
+    entry = malloc(sizeof(ShaderModuleEntry) + codeSize);
+    *entry = (ShaderModuleEntry) {
+        .next = NULL,
+        .hash = hash,
+        .refCount = 1,
+        .module = VK_NULL_HANDLE, // Initialized below
+        .codeSize = codeSize,
+    };
+    memcpy(entry->code, code, codeSize);
+
+    const VkShaderModuleCreateInfo createInfo = {
+        .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = 0,
+        .codeSize = codeSize,
+        .pCode = entry->code,
+    };
+
+    vkRes = VKD.vkCreateShaderModule(grDevice->device, &createInfo, NULL, &entry->module);
+    if (vkRes != VK_SUCCESS) {
+        LOGE("vkCreateShaderModule failed (%d)\n", vkRes);
+        free(entry);
+        *sharedCode = NULL;
+        *module = VK_NULL_HANDLE;
+        return vkRes;
+    }
+
+    AcquireSRWLockExclusive(&grDevice->shaderModuleLock);
+
+    // Another thread may have created the same module in the meantime
+    ShaderModuleEntry* existingEntry = findShaderModuleEntry(grDevice, hash, code, codeSize);
+    if (existingEntry != NULL) {
+        existingEntry->refCount++;
+        grDevice->shaderModuleHitCount++;
+    } else {
+        ShaderModuleEntry** bucket = getShaderModuleBucket(grDevice, hash);
+
+        entry->next = *bucket;
+        *bucket = entry;
+        grDevice->shaderModuleCount++;
+    }
+
+    ReleaseSRWLockExclusive(&grDevice->shaderModuleLock);
+
+    if (existingEntry != NULL) {
+        VKD.vkDestroyShaderModule(grDevice->device, entry->module, NULL);
+        free(entry);
+        entry = existingEntry;
+    }
+
+    *sharedCode = entry->code;
+    *module = entry->module;
+    return VK_SUCCESS;
+}
+
+void grShaderModuleCacheRelease(
+    GrDevice* grDevice,
+    void* sharedCode)
+{
+    if (sharedCode == NULL) {
+        return;
+    }
+
+    ShaderModuleEntry* entry = getShaderModuleEntry(sharedCode);
+    bool unused;
+
+    AcquireSRWLockExclusive(&grDevice->shaderModuleLock);
+
+    entry->refCount--;
+    unused = entry->refCount == 0;
+    if (unused) {
+        ShaderModuleEntry** link = getShaderModuleBucket(grDevice, entry->hash);
+
+        while (*link != entry) {
+            link = &(*link)->next;
+        }
+        *link = entry->next;
+        grDevice->shaderModuleCount--;
+    }
+
+    ReleaseSRWLockExclusive(&grDevice->shaderModuleLock);
+
+    if (unused) {
+        VKD.vkDestroyShaderModule(grDevice->device, entry->module, NULL);
+        free(entry);
+    }
+}
+
+void grShaderModuleCacheDestroy(
+    GrDevice* grDevice)
+{
+    LOGI("%u shader modules alive, %u reused\n",
+         grDevice->shaderModuleCount, grDevice->shaderModuleHitCount);
+
+    if (quirkHas(QUIRK_KEEP_VK_DEVICE)) {
+        // Pipelines destroyed after the device still release their modules
+        return;
+    }
+
+    // Clean up after pipelines that were never destroyed
+    for (unsigned i = 0; i < SHADER_MODULE_BUCKET_COUNT; i++) {
+        ShaderModuleEntry* entry = grDevice->shaderModuleBuckets[i];
+
+        while (entry != NULL) {
+            ShaderModuleEntry* next = entry->next;
+
+            VKD.vkDestroyShaderModule(grDevice->device, entry->module, NULL);
+            free(entry);
+            entry = next;
+        }
+    }
+}
@@ -0,0 +1,213 @@
+#include <stdlib.h>
+#include "thread_pool.h"
+#include "logger.h"
+
+static void unlinkJob(
+    ThreadPool* pool,
+    ThreadPoolJob* job)
+{
+    if (job->prev != NULL) {
+        job->prev->next = job->next;
+    } else {
+        pool->head = job->next;
+    }
+    if (job->next != NULL) {
+        job->next->prev = job->prev;
+    } else {
+        pool->tail = job->prev;
+    }
+
+    job->prev = NULL;
+    job->next = NULL;
+}
+
+// Must be called with the pool lock held, the lock is released while the job runs
+static void runJob(
+    ThreadPool* pool,
+    ThreadPoolJob* job)
+{
+    unlinkJob(pool, job);
+    job->state = THREAD_POOL_JOB_RUNNING;
+    ReleaseSRWLockExclusive(&pool->lock);
+
+    job->func(job->param);
+
+    AcquireSRWLockExclusive(&pool->lock);
+    InterlockedExchange(&job->state, THREAD_POOL_JOB_DONE);
+    WakeAllConditionVariable(&pool->jobDone);
+}
+
+static DWORD WINAPI threadPoolWorker(
+    LPVOID param)
+{
+    ThreadPool* pool = param;
+
+    AcquireSRWLockExclusive(&pool->lock);
+
+    for (;;) {
+        if (pool->head != NULL) {
+            runJob(pool, pool->head);
+        } else if (pool->stopping) {
+            break;
+        } else {
+            SleepConditionVariableSRW(&pool->jobAvailable, &pool->lock, INFINITE, 0);
+        }
+    }
+
+    ReleaseSRWLockExclusive(&pool->lock);
+    return 0;
+}
+
+ThreadPool* threadPoolCreate(
+    unsigned threadCount)
+{
+    if (threadCount == 0) {
+        SYSTEM_INFO systemInfo;
+        GetSystemInfo(&systemInfo);
+        threadCount = systemInfo.dwNumberOfProcessors > 1 ? systemInfo.dwNumberOfProcessors - 1 : 1;
+    }
+
+    ThreadPool* pool = malloc(sizeof(ThreadPool));
+    *pool = (ThreadPool) {
+        .lock = SRWLOCK_INIT,
+        .jobAvailable = CONDITION_VARIABLE_INIT,
+        .jobDone = CONDITION_VARIABLE_INIT,
+        .head = NULL,
+        .tail = NULL,
+        .stopping = false,
+        .threadCount = 0, // Initialized below
+        .threads = malloc(threadCount * sizeof(HANDLE)),
+    };
+
+    for (unsigned i = 0; i < threadCount; i++) {
+        HANDLE thread = CreateThread(NULL, 0, threadPoolWorker, pool, 0, NULL);
+        if (thread == NULL) {
+            LOGW("failed to create worker thread (%lu)\n", GetLastError());
+            break;
+        }
+
+        pool->threads[pool->threadCount] = thread;
+        pool->threadCount++;
+    }
+
+    if (pool->threadCount == 0) {
+        free(pool->threads);
+        free(pool);
+        return NULL;
+    }
+
+    return pool;
+}
+
+void threadPoolDestroy(
+    ThreadPool* pool)
+{
+    if (pool == NULL) {
+        return;
+    }
+
+    AcquireSRWLockExclusive(&pool->lock);
+    pool->stopping = true;
+    WakeAllConditionVariable(&pool->jobAvailable);
+    ReleaseSRWLockExclusive(&pool->lock);
+
+    for (unsigned i = 0; i < pool->threadCount; i++) {
+        WaitForSingleObject(pool->threads[i], INFINITE);
+        CloseHandle(pool->threads[i]);
+    }
+
+    free(pool->threads);
+    free(pool);
+}
+
+void threadPoolSubmit(
+    ThreadPool* pool,
+    ThreadPoolJob* job,
+    ThreadPoolFunc func,
+    void* param)
+{
+    *job = (ThreadPoolJob) {
+        .prev = NULL,
+        .next = NULL,
+        .func = func,
+        .param = param,
+        .state = THREAD_POOL_JOB_PENDING,
+    };
+
+    if (pool == NULL) {
+        // No workers available, run synchronously
+        func(param);
+        InterlockedExchange(&job->state, THREAD_POOL_JOB_DONE);
+        return;
+    }
+
+    AcquireSRWLockExclusive(&pool->lock);
+
+    job->prev = pool->tail;
+    if (pool->tail != NULL) {
+        pool->tail->next = job;
+    } else {
+        pool->head = job;
+    }
+    pool->tail = job;
+
+    WakeConditionVariable(&pool->jobAvailable);
+    ReleaseSRWLockExclusive(&pool->lock);
+}
+
+bool threadPoolCancel(
+    ThreadPool* pool,
+    ThreadPoolJob* job)
+{
+    bool cancelled = false;
+
+    if (pool == NULL || threadPoolIsJobDone(job)) {
+        return false;
+    }
+
+    AcquireSRWLockExclusive(&pool->lock);
+
+    if (job->state == THREAD_POOL_JOB_PENDING) {
+        unlinkJob(pool, job);
+        job->state = THREAD_POOL_JOB_IDLE;
+        cancelled = true;
+    }
+
+    ReleaseSRWLockExclusive(&pool->lock);
+
+    return cancelled;
+}
+
+bool threadPoolIsJobDone(
+    const ThreadPoolJob* job)
+{
+    if (job->state == THREAD_POOL_JOB_DONE || job->state == THREAD_POOL_JOB_IDLE) {
+        // Make sure the job results are visible to the caller
+        MemoryBarrier();
+        return true;
+    }
+
+    return false;
+}
+
+void threadPoolWait(
+    ThreadPool* pool,
+    ThreadPoolJob* job)
+{
+    if (threadPoolIsJobDone(job)) {
+        return;
+    }
+
+    AcquireSRWLockExclusive(&pool->lock);
+
+    if (job->state == THREAD_POOL_JOB_PENDING) {
+        // Nobody picked it up yet, don't wait for a worker to become available
+        runJob(pool, job);
+    }
+
+    while (job->state != THREAD_POOL_JOB_DONE) {
+        SleepConditionVariableSRW(&pool->jobDone, &pool->lock, INFINITE, 0);
+    }
+
+    ReleaseSRWLockExclusive(&pool->lock);
+}
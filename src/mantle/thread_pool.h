@@ -0,0 +1,64 @@
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#include <stdbool.h>
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+typedef void (*ThreadPoolFunc)(void* param);
+
+typedef enum _ThreadPoolJobState {
+    THREAD_POOL_JOB_IDLE,
+    THREAD_POOL_JOB_PENDING,
+    THREAD_POOL_JOB_RUNNING,
+    THREAD_POOL_JOB_DONE,
+} ThreadPoolJobState;
+
+// Jobs are embedded in the object they work on, the pool doesn't own them
+typedef struct _ThreadPoolJob {
+    struct _ThreadPoolJob* prev;
+    struct _ThreadPoolJob* next;
+    ThreadPoolFunc func;
+    void* param;
+    volatile LONG state;
+} ThreadPoolJob;
+
+typedef struct _ThreadPool {
+    SRWLOCK lock;
+    CONDITION_VARIABLE jobAvailable;
+    CONDITION_VARIABLE jobDone;
+    ThreadPoolJob* head;
+    ThreadPoolJob* tail;
+    bool stopping;
+    unsigned threadCount;
+    HANDLE* threads;
+} ThreadPool;
+
+// A thread count of 0 picks one thread per CPU, minus the application thread
+ThreadPool* threadPoolCreate(
+    unsigned threadCount);
+
+// Runs all pending jobs to completion before returning
+void threadPoolDestroy(
+    ThreadPool* pool);
+
+void threadPoolSubmit(
+    ThreadPool* pool,
+    ThreadPoolJob* job,
+    ThreadPoolFunc func,
+    void* param);
+
+// Removes a job that hasn't started yet, returns false if it's running or done
+bool threadPoolCancel(
+    ThreadPool* pool,
+    ThreadPoolJob* job);
+
+bool threadPoolIsJobDone(
+    const ThreadPoolJob* job);
+
+// Blocks until the job is done, running it on the calling thread if no worker picked it up yet
+void threadPoolWait(
+    ThreadPool* pool,
+    ThreadPoolJob* job);
+
+#endif // THREAD_POOL_H_
@@ -446,50 +446,65 @@ VkImageUsageFlags getVkImageUsageFlags(
     return flags;
 }
 
-VkAccessFlags getVkAccessFlagsImage(
-    GR_IMAGE_STATE imageState)
+// Stages and accesses are narrowed down to the operations recorded for each state
+VkAccessFlags2 getVkAccessFlags2Image(
+    GR_IMAGE_STATE imageState,
+    VkImageAspectFlags aspectMask)
 {
     switch (imageState) {
     case GR_IMAGE_STATE_DATA_TRANSFER:
-        return VK_ACCESS_TRANSFER_READ_BIT |
-               VK_ACCESS_TRANSFER_WRITE_BIT |
-               VK_ACCESS_HOST_READ_BIT |
-               VK_ACCESS_HOST_WRITE_BIT;
+        return VK_ACCESS_2_TRANSFER_READ_BIT |
+               VK_ACCESS_2_TRANSFER_WRITE_BIT |
+               VK_ACCESS_2_HOST_READ_BIT |
+               VK_ACCESS_2_HOST_WRITE_BIT;
     case GR_IMAGE_STATE_GRAPHICS_SHADER_READ_ONLY:
     case GR_IMAGE_STATE_COMPUTE_SHADER_READ_ONLY:
     case GR_IMAGE_STATE_MULTI_SHADER_READ_ONLY:
+        return VK_ACCESS_2_SHADER_SAMPLED_READ_BIT |
+               VK_ACCESS_2_SHADER_STORAGE_READ_BIT;
     case GR_EXT_IMAGE_STATE_GRAPHICS_SHADER_FMASK_LOOKUP:
     case GR_EXT_IMAGE_STATE_COMPUTE_SHADER_FMASK_LOOKUP:
-        return VK_ACCESS_SHADER_READ_BIT;
+        return VK_ACCESS_2_SHADER_SAMPLED_READ_BIT;
     case GR_IMAGE_STATE_GRAPHICS_SHADER_WRITE_ONLY:
     case GR_IMAGE_STATE_COMPUTE_SHADER_WRITE_ONLY:
-        return VK_ACCESS_SHADER_WRITE_BIT;
+        return VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
     case GR_IMAGE_STATE_GRAPHICS_SHADER_READ_WRITE:
     case GR_IMAGE_STATE_COMPUTE_SHADER_READ_WRITE:
-        return VK_ACCESS_SHADER_READ_BIT |
-               VK_ACCESS_SHADER_WRITE_BIT;
+        return VK_ACCESS_2_SHADER_SAMPLED_READ_BIT |
+               VK_ACCESS_2_SHADER_STORAGE_READ_BIT |
+               VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
     case GR_IMAGE_STATE_TARGET_AND_SHADER_READ_ONLY:
         // Depth or stencil aspect can be read-only, but we don't know which one until it's bound
         // as a target. See "Read-only Depth-Stencil Views" in Mantle spec.
-        return VK_ACCESS_SHADER_READ_BIT |
-               VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
-               VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        return VK_ACCESS_2_SHADER_SAMPLED_READ_BIT |
+               VK_ACCESS_2_SHADER_STORAGE_READ_BIT |
+               VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+               VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
     case GR_IMAGE_STATE_UNINITIALIZED:
-        return 0;
+        return VK_ACCESS_2_NONE;
     case GR_IMAGE_STATE_TARGET_RENDER_ACCESS_OPTIMAL:
-    case GR_IMAGE_STATE_TARGET_SHADER_ACCESS_OPTIMAL:
-        return VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
-               VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
-               VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
-               VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    case GR_IMAGE_STATE_TARGET_SHADER_ACCESS_OPTIMAL: {
+        VkAccessFlags2 flags = VK_ACCESS_2_NONE;
+
+        // The aspect tells color targets apart from depth-stencil targets
+        if (aspectMask == 0 || (aspectMask & VK_IMAGE_ASPECT_COLOR_BIT)) {
+            flags |= VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT |
+                     VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT;
+        }
+        if (aspectMask == 0 || (aspectMask & (VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT))) {
+            flags |= VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                     VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        }
+        return flags;
+    }
     case GR_IMAGE_STATE_CLEAR:
-        return VK_ACCESS_TRANSFER_WRITE_BIT;
+        return VK_ACCESS_2_TRANSFER_WRITE_BIT;
     case GR_IMAGE_STATE_DISCARD:
-        return 0;
+        return VK_ACCESS_2_NONE;
     case GR_IMAGE_STATE_RESOLVE_SOURCE:
-        return VK_ACCESS_TRANSFER_READ_BIT;
+        return VK_ACCESS_2_TRANSFER_READ_BIT;
     case GR_IMAGE_STATE_RESOLVE_DESTINATION:
-        return VK_ACCESS_TRANSFER_WRITE_BIT;
+        return VK_ACCESS_2_TRANSFER_WRITE_BIT;
     default:
         break;
     }
@@ -497,65 +512,66 @@ VkAccessFlags getVkAccessFlagsImage(
     switch ((GR_WSI_WIN_IMAGE_STATE)imageState) {
     case GR_WSI_WIN_IMAGE_STATE_PRESENT_WINDOWED:
     case GR_WSI_WIN_IMAGE_STATE_PRESENT_FULLSCREEN:
-        return VK_ACCESS_TRANSFER_READ_BIT;
+        return VK_ACCESS_2_TRANSFER_READ_BIT;
     }
 
     LOGW("unsupported image state 0x%X\n", imageState);
-    return 0;
+    return VK_ACCESS_2_NONE;
 }
 
-VkPipelineStageFlags getVkPipelineStageFlagsImage(
-    GR_IMAGE_STATE imageState)
+VkPipelineStageFlags2 getVkPipelineStageFlags2Image(
+    GR_IMAGE_STATE imageState,
+    VkImageAspectFlags aspectMask)
 {
     switch (imageState) {
     case GR_IMAGE_STATE_DATA_TRANSFER:
-        return VK_PIPELINE_STAGE_TRANSFER_BIT |
-               VK_PIPELINE_STAGE_HOST_BIT;
+        // Clears issued in that state are tolerated
+        return VK_PIPELINE_STAGE_2_COPY_BIT |
+               VK_PIPELINE_STAGE_2_CLEAR_BIT |
+               VK_PIPELINE_STAGE_2_HOST_BIT;
     case GR_IMAGE_STATE_GRAPHICS_SHADER_READ_ONLY:
     case GR_IMAGE_STATE_GRAPHICS_SHADER_WRITE_ONLY:
     case GR_IMAGE_STATE_GRAPHICS_SHADER_READ_WRITE:
     case GR_EXT_IMAGE_STATE_GRAPHICS_SHADER_FMASK_LOOKUP:
-        return VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
-               VK_PIPELINE_STAGE_TESSELLATION_CONTROL_SHADER_BIT |
-               VK_PIPELINE_STAGE_TESSELLATION_EVALUATION_SHADER_BIT |
-               VK_PIPELINE_STAGE_GEOMETRY_SHADER_BIT |
-               VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        return VK_PIPELINE_STAGE_2_PRE_RASTERIZATION_SHADERS_BIT |
+               VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
     case GR_IMAGE_STATE_COMPUTE_SHADER_READ_ONLY:
     case GR_IMAGE_STATE_COMPUTE_SHADER_WRITE_ONLY:
     case GR_IMAGE_STATE_COMPUTE_SHADER_READ_WRITE:
     case GR_EXT_IMAGE_STATE_COMPUTE_SHADER_FMASK_LOOKUP:
-        return VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        return VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
     case GR_IMAGE_STATE_MULTI_SHADER_READ_ONLY:
-        return VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
-               VK_PIPELINE_STAGE_TESSELLATION_CONTROL_SHADER_BIT |
-               VK_PIPELINE_STAGE_TESSELLATION_EVALUATION_SHADER_BIT |
-               VK_PIPELINE_STAGE_GEOMETRY_SHADER_BIT |
-               VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
-               VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        return VK_PIPELINE_STAGE_2_PRE_RASTERIZATION_SHADERS_BIT |
+               VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT |
+               VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
     case GR_IMAGE_STATE_TARGET_AND_SHADER_READ_ONLY:
-        return VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
-               VK_PIPELINE_STAGE_TESSELLATION_CONTROL_SHADER_BIT |
-               VK_PIPELINE_STAGE_TESSELLATION_EVALUATION_SHADER_BIT |
-               VK_PIPELINE_STAGE_GEOMETRY_SHADER_BIT |
-               VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
-               VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
-               VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
-               VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        return VK_PIPELINE_STAGE_2_PRE_RASTERIZATION_SHADERS_BIT |
+               VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT |
+               VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT |
+               VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT |
+               VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
     case GR_IMAGE_STATE_UNINITIALIZED:
-        return VK_PIPELINE_STAGE_NONE;
+        return VK_PIPELINE_STAGE_2_NONE;
     case GR_IMAGE_STATE_TARGET_RENDER_ACCESS_OPTIMAL:
-    case GR_IMAGE_STATE_TARGET_SHADER_ACCESS_OPTIMAL:
-        return VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
-               VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
-               VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    case GR_IMAGE_STATE_TARGET_SHADER_ACCESS_OPTIMAL: {
+        VkPipelineStageFlags2 flags = VK_PIPELINE_STAGE_2_NONE;
+
+        if (aspectMask == 0 || (aspectMask & VK_IMAGE_ASPECT_COLOR_BIT)) {
+            flags |= VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+        }
+        if (aspectMask == 0 || (aspectMask & (VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT))) {
+            flags |= VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT |
+                     VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT;
+        }
+        return flags;
+    }
     case GR_IMAGE_STATE_CLEAR:
-        return VK_PIPELINE_STAGE_TRANSFER_BIT;
+        return VK_PIPELINE_STAGE_2_CLEAR_BIT;
     case GR_IMAGE_STATE_DISCARD:
-        return VK_PIPELINE_STAGE_NONE;
+        return VK_PIPELINE_STAGE_2_NONE;
     case GR_IMAGE_STATE_RESOLVE_SOURCE:
-        return VK_PIPELINE_STAGE_TRANSFER_BIT;
     case GR_IMAGE_STATE_RESOLVE_DESTINATION:
-        return VK_PIPELINE_STAGE_TRANSFER_BIT;
+        return VK_PIPELINE_STAGE_2_RESOLVE_BIT;
     default:
         break;
     }
@@ -563,101 +579,105 @@ VkPipelineStageFlags getVkPipelineStageFlagsImage(
     switch ((GR_WSI_WIN_IMAGE_STATE)imageState) {
     case GR_WSI_WIN_IMAGE_STATE_PRESENT_WINDOWED:
     case GR_WSI_WIN_IMAGE_STATE_PRESENT_FULLSCREEN:
-        return VK_PIPELINE_STAGE_TRANSFER_BIT;
+        // Presentable images are blitted to the swapchain
+        return VK_PIPELINE_STAGE_2_BLIT_BIT;
     }
 
     LOGW("unsupported image state 0x%X\n", imageState);
-    return 0;
+    return VK_PIPELINE_STAGE_2_NONE;
 }
 
-VkAccessFlags getVkAccessFlagsMemory(
+VkAccessFlags2 getVkAccessFlags2Memory(
     GR_MEMORY_STATE memoryState)
 {
     switch (memoryState) {
     case GR_MEMORY_STATE_DATA_TRANSFER:
-        return VK_ACCESS_TRANSFER_READ_BIT |
-               VK_ACCESS_TRANSFER_WRITE_BIT |
-               VK_ACCESS_HOST_READ_BIT |
-               VK_ACCESS_HOST_WRITE_BIT;
+        return VK_ACCESS_2_TRANSFER_READ_BIT |
+               VK_ACCESS_2_TRANSFER_WRITE_BIT |
+               VK_ACCESS_2_HOST_READ_BIT |
+               VK_ACCESS_2_HOST_WRITE_BIT;
     case GR_MEMORY_STATE_GRAPHICS_SHADER_READ_ONLY:
     case GR_MEMORY_STATE_COMPUTE_SHADER_READ_ONLY:
-        return VK_ACCESS_SHADER_READ_BIT;
+        // Memory views are bound as uniform texel buffers or storage buffers
+        return VK_ACCESS_2_SHADER_SAMPLED_READ_BIT |
+               VK_ACCESS_2_SHADER_STORAGE_READ_BIT;
     case GR_MEMORY_STATE_GRAPHICS_SHADER_WRITE_ONLY:
     case GR_MEMORY_STATE_COMPUTE_SHADER_WRITE_ONLY:
-        return VK_ACCESS_SHADER_WRITE_BIT;
+        return VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
     case GR_MEMORY_STATE_GRAPHICS_SHADER_READ_WRITE:
     case GR_MEMORY_STATE_COMPUTE_SHADER_READ_WRITE:
-        return VK_ACCESS_SHADER_READ_BIT |
-               VK_ACCESS_SHADER_WRITE_BIT;
+        return VK_ACCESS_2_SHADER_SAMPLED_READ_BIT |
+               VK_ACCESS_2_SHADER_STORAGE_READ_BIT |
+               VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
     case GR_MEMORY_STATE_MULTI_USE_READ_ONLY:
-        return VK_ACCESS_INDIRECT_COMMAND_READ_BIT |
-               VK_ACCESS_INDEX_READ_BIT |
-               VK_ACCESS_SHADER_READ_BIT;
+        return VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT |
+               VK_ACCESS_2_INDEX_READ_BIT |
+               VK_ACCESS_2_SHADER_SAMPLED_READ_BIT |
+               VK_ACCESS_2_SHADER_STORAGE_READ_BIT;
     case GR_MEMORY_STATE_INDEX_DATA:
-        return VK_ACCESS_INDEX_READ_BIT;
+        return VK_ACCESS_2_INDEX_READ_BIT;
     case GR_MEMORY_STATE_INDIRECT_ARG:
-        return VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+        return VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT;
     case GR_MEMORY_STATE_WRITE_TIMESTAMP:
-        return VK_ACCESS_TRANSFER_WRITE_BIT;
+        return VK_ACCESS_2_TRANSFER_WRITE_BIT;
     case GR_MEMORY_STATE_DISCARD:
-        return 0;
+        return VK_ACCESS_2_NONE;
     case GR_MEMORY_STATE_DATA_TRANSFER_SOURCE:
-        return VK_ACCESS_TRANSFER_READ_BIT;
+        return VK_ACCESS_2_TRANSFER_READ_BIT;
     case GR_MEMORY_STATE_DATA_TRANSFER_DESTINATION:
-        return VK_ACCESS_TRANSFER_WRITE_BIT;
+        return VK_ACCESS_2_TRANSFER_WRITE_BIT;
     default:
         break;
     }
 
     LOGW("unsupported memory state 0x%X\n", memoryState);
-    return 0;
+    return VK_ACCESS_2_NONE;
 }
 
-VkPipelineStageFlags getVkPipelineStageFlagsMemory(
+VkPipelineStageFlags2 getVkPipelineStageFlags2Memory(
     GR_MEMORY_STATE memoryState)
 {
     switch (memoryState) {
     case GR_MEMORY_STATE_DATA_TRANSFER:
-        return VK_PIPELINE_STAGE_TRANSFER_BIT |
-               VK_PIPELINE_STAGE_HOST_BIT;
+        // Includes vkCmdFillBuffer and vkCmdUpdateBuffer
+        return VK_PIPELINE_STAGE_2_COPY_BIT |
+               VK_PIPELINE_STAGE_2_CLEAR_BIT |
+               VK_PIPELINE_STAGE_2_HOST_BIT;
     case GR_MEMORY_STATE_GRAPHICS_SHADER_READ_ONLY:
     case GR_MEMORY_STATE_GRAPHICS_SHADER_WRITE_ONLY:
     case GR_MEMORY_STATE_GRAPHICS_SHADER_READ_WRITE:
-        return VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
-               VK_PIPELINE_STAGE_TESSELLATION_CONTROL_SHADER_BIT |
-               VK_PIPELINE_STAGE_TESSELLATION_EVALUATION_SHADER_BIT |
-               VK_PIPELINE_STAGE_GEOMETRY_SHADER_BIT |
-               VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        return VK_PIPELINE_STAGE_2_PRE_RASTERIZATION_SHADERS_BIT |
+               VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
     case GR_MEMORY_STATE_COMPUTE_SHADER_WRITE_ONLY:
     case GR_MEMORY_STATE_COMPUTE_SHADER_READ_ONLY:
     case GR_MEMORY_STATE_COMPUTE_SHADER_READ_WRITE:
-        return VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        return VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
     case GR_MEMORY_STATE_MULTI_USE_READ_ONLY:
-        return VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT |
-               VK_PIPELINE_STAGE_VERTEX_INPUT_BIT |
-               VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
-               VK_PIPELINE_STAGE_TESSELLATION_CONTROL_SHADER_BIT |
-               VK_PIPELINE_STAGE_TESSELLATION_EVALUATION_SHADER_BIT |
-               VK_PIPELINE_STAGE_GEOMETRY_SHADER_BIT |
-               VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
-               VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        return VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT |
+               VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT |
+               VK_PIPELINE_STAGE_2_PRE_RASTERIZATION_SHADERS_BIT |
+               VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT |
+               VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
     case GR_MEMORY_STATE_INDEX_DATA:
-        return VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+        return VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT;
     case GR_MEMORY_STATE_INDIRECT_ARG:
-        return VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+        return VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT;
     case GR_MEMORY_STATE_WRITE_TIMESTAMP:
-        return VK_PIPELINE_STAGE_TRANSFER_BIT;
+        // Timestamps are copied out of the query pool
+        return VK_PIPELINE_STAGE_2_COPY_BIT;
     case GR_MEMORY_STATE_DISCARD:
-        return VK_PIPELINE_STAGE_NONE;
+        return VK_PIPELINE_STAGE_2_NONE;
     case GR_MEMORY_STATE_DATA_TRANSFER_SOURCE:
+        return VK_PIPELINE_STAGE_2_COPY_BIT;
     case GR_MEMORY_STATE_DATA_TRANSFER_DESTINATION:
-        return VK_PIPELINE_STAGE_TRANSFER_BIT;
+        return VK_PIPELINE_STAGE_2_COPY_BIT |
+               VK_PIPELINE_STAGE_2_CLEAR_BIT;
     default:
         break;
     }
 
     LOGW("unsupported memory state 0x%X\n", memoryState);
-    return 0;
+    return VK_PIPELINE_STAGE_2_NONE;
 }
 
 VkImageAspectFlags getVkImageAspectFlags(
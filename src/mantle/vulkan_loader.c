@@ -109,6 +109,7 @@ void vulkanLoaderDeviceInit(
     LOAD_VULKAN_DEV_FN(vkd, device, vkCmdFillBuffer);
     LOAD_VULKAN_DEV_FN(vkd, device, vkCmdNextSubpass);
     LOAD_VULKAN_DEV_FN(vkd, device, vkCmdPipelineBarrier);
+    LOAD_VULKAN_DEV_FN(vkd, device, vkCmdPipelineBarrier2);
     LOAD_VULKAN_DEV_FN(vkd, device, vkCmdPushConstants);
     LOAD_VULKAN_DEV_FN(vkd, device, vkCmdResetEvent);
     LOAD_VULKAN_DEV_FN(vkd, device, vkCmdResetQueryPool);
@@ -238,6 +239,23 @@ void vulkanLoaderDeviceInit(
     LOAD_VULKAN_DEV_FN(vkd, device, vkCmdSetSampleMaskEXT);
 #endif
 
+#ifdef VK_EXT_shader_object
+    LOAD_VULKAN_DEV_FN(vkd, device, vkCmdBindShadersEXT);
+    LOAD_VULKAN_DEV_FN(vkd, device, vkCmdSetAlphaToCoverageEnableEXT);
+    LOAD_VULKAN_DEV_FN(vkd, device, vkCmdSetColorWriteMaskEXT);
+    LOAD_VULKAN_DEV_FN(vkd, device, vkCmdSetDepthBiasEnableEXT);
+    LOAD_VULKAN_DEV_FN(vkd, device, vkCmdSetDepthClampEnableEXT);
+    LOAD_VULKAN_DEV_FN(vkd, device, vkCmdSetLogicOpEnableEXT);
+    LOAD_VULKAN_DEV_FN(vkd, device, vkCmdSetLogicOpEXT);
+    LOAD_VULKAN_DEV_FN(vkd, device, vkCmdSetPatchControlPointsEXT);
+    LOAD_VULKAN_DEV_FN(vkd, device, vkCmdSetPrimitiveRestartEnableEXT);
+    LOAD_VULKAN_DEV_FN(vkd, device, vkCmdSetRasterizerDiscardEnableEXT);
+    LOAD_VULKAN_DEV_FN(vkd, device, vkCmdSetTessellationDomainOriginEXT);
+    LOAD_VULKAN_DEV_FN(vkd, device, vkCmdSetVertexInputEXT);
+    LOAD_VULKAN_DEV_FN(vkd, device, vkCreateShadersEXT);
+    LOAD_VULKAN_DEV_FN(vkd, device, vkDestroyShaderEXT);
+#endif
+
 #ifdef VK_KHR_push_descriptor
     LOAD_VULKAN_DEV_FN(vkd, device, vkCmdPushDescriptorSetKHR);
 #endif
@@ -90,6 +90,7 @@ typedef struct _VULKAN_DEVICE {
     VULKAN_FN(vkCmdFillBuffer);
     VULKAN_FN(vkCmdNextSubpass);
     VULKAN_FN(vkCmdPipelineBarrier);
+    VULKAN_FN(vkCmdPipelineBarrier2);
     VULKAN_FN(vkCmdPushConstants);
     VULKAN_FN(vkCmdResetEvent);
     VULKAN_FN(vkCmdResetQueryPool);
@@ -219,6 +220,23 @@ typedef struct _VULKAN_DEVICE {
     VULKAN_FN(vkCmdSetSampleMaskEXT);
 #endif
 
+#ifdef VK_EXT_shader_object
+    VULKAN_FN(vkCmdBindShadersEXT);
+    VULKAN_FN(vkCmdSetAlphaToCoverageEnableEXT);
+    VULKAN_FN(vkCmdSetColorWriteMaskEXT);
+    VULKAN_FN(vkCmdSetDepthBiasEnableEXT);
+    VULKAN_FN(vkCmdSetDepthClampEnableEXT);
+    VULKAN_FN(vkCmdSetLogicOpEnableEXT);
+    VULKAN_FN(vkCmdSetLogicOpEXT);
+    VULKAN_FN(vkCmdSetPatchControlPointsEXT);
+    VULKAN_FN(vkCmdSetPrimitiveRestartEnableEXT);
+    VULKAN_FN(vkCmdSetRasterizerDiscardEnableEXT);
+    VULKAN_FN(vkCmdSetTessellationDomainOriginEXT);
+    VULKAN_FN(vkCmdSetVertexInputEXT);
+    VULKAN_FN(vkCreateShadersEXT);
+    VULKAN_FN(vkDestroyShaderEXT);
+#endif
+
 #ifdef VK_KHR_push_descriptor
     VULKAN_FN(vkCmdPushDescriptorSetKHR);
 #endif
@@ -0,0 +1,68 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include "amdilc.h"
+#include "logger.h"
+
+#define ITERATION_COUNT (20)
+
+static void freeShader(
+    IlcShader* shader)
+{
+    free(shader->code);
+    free(shader->bindings);
+    free(shader->inputs);
+    free(shader->outputLocations);
+    free(shader->name);
+}
+
+int main(int argc, char *args[])
+{
+    if (argc < 2) {
+        printf("usage: %s il.bin ...\n", args[0]);
+        return 1;
+    }
+
+    LARGE_INTEGER frequency;
+    double totalMs = 0.0;
+
+    logInit("", "");
+    QueryPerformanceFrequency(&frequency);
+
+    for (int i = 1; i < argc; i++) {
+        FILE* inFile = fopen(args[i], "rb");
+        assert(inFile != NULL);
+
+        unsigned inSize;
+        uint8_t* inBuf;
+        fseek(inFile, 0, SEEK_END);
+        inSize = ftell(inFile);
+        inBuf = malloc(inSize);
+        fseek(inFile, 0, SEEK_SET);
+        fread(inBuf, 1, inSize, inFile);
+        fclose(inFile);
+
+        // Warm up, this also gets the crypto provider acquired
+        IlcShader shader = ilcCompileShader(inBuf, inSize, NULL);
+        freeShader(&shader);
+
+        LARGE_INTEGER start, end;
+        QueryPerformanceCounter(&start);
+        for (int j = 0; j < ITERATION_COUNT; j++) {
+            shader = ilcCompileShader(inBuf, inSize, NULL);
+            freeShader(&shader);
+        }
+        QueryPerformanceCounter(&end);
+
+        double ms = 1000.0 * (end.QuadPart - start.QuadPart) / frequency.QuadPart / ITERATION_COUNT;
+        printf("%-40s %10.3f ms\n", args[i], ms);
+        totalMs += ms;
+        free(inBuf);
+    }
+
+    printf("%-40s %10.3f ms\n", "total", totalMs);
+
+    return 0;
+}
@@ -0,0 +1,12 @@
+#!/usr/bin/python
+
+import glob
+import os
+import subprocess
+import sys
+
+dirPath = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'res')
+binPaths = sorted(glob.glob(os.path.join(dirPath, 'il_*.bin')))
+
+result = subprocess.run(['wine', 'test/amdil-bench.exe'] + binPaths)
+exit(result.returncode)
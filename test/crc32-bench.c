@@ -0,0 +1,149 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include "crc32.h"
+
+#define MAX_SIZE        (1024 * 1024)
+#define BYTES_PER_SIZE  (64 * 1024 * 1024)
+
+typedef uint32_t (*Crc32Func)(const void* data, size_t length, uint32_t previousCrc32);
+
+typedef struct _Variant {
+    const char* name;
+    Crc32Func func;
+} Variant;
+
+static uint32_t crc32_16bytes_prefetch256(
+    const void* data,
+    size_t length,
+    uint32_t previousCrc32)
+{
+    return crc32_16bytes_prefetch(data, length, previousCrc32, 256);
+}
+
+static const Variant mVariants[] = {
+    { "bitwise", crc32_bitwise },
+    { "halfbyte", crc32_halfbyte },
+    { "1byte", crc32_1byte },
+    { "1byte_tableless", crc32_1byte_tableless },
+    { "1byte_tableless2", crc32_1byte_tableless2 },
+    { "4bytes", crc32_4bytes },
+    { "8bytes", crc32_8bytes },
+    { "4x8bytes", crc32_4x8bytes },
+    { "16bytes", crc32_16bytes },
+    { "16bytes_prefetch", crc32_16bytes_prefetch256 },
+#ifdef CRC32_USE_PCLMUL
+    { "pclmul", crc32_pclmul },
+#endif
+    { "fast", crc32_fast },
+};
+
+// Pipeline blobs range from a few hundred bytes to hundreds of kilobytes
+static const size_t mSizes[] = { 256, 4 * 1024, 64 * 1024, MAX_SIZE };
+
+static bool isVariantSupported(
+    const Variant* variant)
+{
+#ifdef CRC32_USE_PCLMUL
+    if (variant->func == crc32_pclmul) {
+        return crc32_pclmul_supported();
+    }
+#endif
+    return true;
+}
+
+static unsigned verify(
+    const uint8_t* buf)
+{
+    unsigned failCount = 0;
+
+    // Cover all tail lengths and misalignments against the reference implementation
+    for (unsigned i = 0; i < sizeof(mVariants) / sizeof(mVariants[0]); i++) {
+        const Variant* variant = &mVariants[i];
+
+        if (!isVariantSupported(variant)) {
+            continue;
+        }
+
+        for (size_t offset = 0; offset < 16; offset++) {
+            for (size_t length = 0; length <= 1024; length++) {
+                uint32_t previousCrc = (uint32_t)(length * 0x9E3779B9);
+                uint32_t expected = crc32_bitwise(buf + offset, length, previousCrc);
+                uint32_t actual = variant->func(buf + offset, length, previousCrc);
+
+                if (actual != expected) {
+                    printf("%s: mismatch at offset %zu, length %zu (0x%08X != 0x%08X)\n",
+                           variant->name, offset, length, actual, expected);
+                    failCount++;
+                    break;
+                }
+            }
+        }
+    }
+
+    return failCount;
+}
+
+int main(int argc, char *args[])
+{
+    bool verifyOnly = argc > 1 && strcmp(args[1], "-v") == 0;
+    uint8_t* buf = malloc(MAX_SIZE + 16);
+    LARGE_INTEGER frequency;
+
+    srand(1);
+    for (unsigned i = 0; i < MAX_SIZE + 16; i++) {
+        buf[i] = rand() & 0xFF;
+    }
+
+    unsigned failCount = verify(buf);
+    if (failCount > 0 || verifyOnly) {
+        printf("%u variant(s) failed verification\n", failCount);
+        free(buf);
+        return failCount > 0 ? 1 : 0;
+    }
+
+    QueryPerformanceFrequency(&frequency);
+
+    printf("%-20s", "MB/s");
+    for (unsigned j = 0; j < sizeof(mSizes) / sizeof(mSizes[0]); j++) {
+        printf(" %10zu", mSizes[j]);
+    }
+    printf("\n");
+
+    for (unsigned i = 0; i < sizeof(mVariants) / sizeof(mVariants[0]); i++) {
+        const Variant* variant = &mVariants[i];
+
+        if (!isVariantSupported(variant)) {
+            continue;
+        }
+
+        printf("%-20s", variant->name);
+        for (unsigned j = 0; j < sizeof(mSizes) / sizeof(mSizes[0]); j++) {
+            size_t size = mSizes[j];
+            unsigned iterationCount = BYTES_PER_SIZE / size;
+            volatile uint32_t crc = 0;
+
+            // The bitwise reference is slow, keep its run short
+            if (variant->func == crc32_bitwise) {
+                iterationCount = iterationCount / 16 + 1;
+            }
+
+            LARGE_INTEGER start, end;
+            QueryPerformanceCounter(&start);
+            for (unsigned k = 0; k < iterationCount; k++) {
+                crc = variant->func(buf, size, crc);
+            }
+            QueryPerformanceCounter(&end);
+
+            double seconds = (double)(end.QuadPart - start.QuadPart) / frequency.QuadPart;
+            printf(" %10.1f", (double)size * iterationCount / seconds / (1024.0 * 1024.0));
+        }
+        printf("\n");
+    }
+
+    free(buf);
+    return 0;
+}